@@ -54,6 +54,16 @@ extern "C" {
  * attached to multiple control, each of the controls can present the table
  * in other way (e.g. have another dimensions for each cell etc.).
  *
+ * Leading columns and/or rows can be frozen with @c MC_GM_SETFROZENCOUNT.
+ * Frozen columns (rows) stay in place next to the row (column) headers when
+ * the control is scrolled horizontally (vertically), so they remain visible
+ * all the time.
+ *
+ * Split panes with independent scrolling can be made of multiple controls
+ * sharing the same table (see @c MC_GM_SETTABLE). Each control has its own
+ * scroll position and keeps its own rendering of the table, and all of them
+ * are refreshed whenever the table changes.
+ *
  * These standard messages are handled by @c MC_WC_GRID control:
  * - @c WM_GETFONT
  * - @c WM_SETFONT
@@ -133,6 +143,24 @@ typedef struct MC_GCELL_tag {
     MC_HVALUE hValue;
 } MC_GCELL;
 
+/**
+ * @brief Structure for setting and getting cell of the table.
+ *
+ * Same as @ref MC_GCELL but with 32-bit cell coordinates.
+ *
+ * @sa MC_GM_SETCELLEX MC_GM_GETCELLEX
+ */
+typedef struct MC_GCELLEX_tag {
+    /** @brief Column index */
+    DWORD dwCol;
+    /** @brief Row index */
+    DWORD dwRow;
+    /** @brief Handle of value type */
+    MC_HVALUETYPE hType;
+    /** @brief Handle of the value */
+    MC_HVALUE hValue;
+} MC_GCELLEX;
+
 /**
  * @anchor MC_GGM_xxxx
  * @name MC_GGEOMETRY::fMask Bits
@@ -183,6 +211,42 @@ typedef struct MC_GGEOMETRY_tag {
     WORD wPaddingVert;
 } MC_GGEOMETRY;
 
+/**
+ * @anchor MC_GHT_xxxx
+ * @name MC_GHITTESTINFO::flags Bits
+ */
+/*@{*/
+/** @brief The point is not over any cell nor header of the grid. */
+#define MC_GHT_NOWHERE                (1 << 0)
+/** @brief The point is over a regular cell. */
+#define MC_GHT_ONCELL                 (1 << 1)
+/** @brief The point is over a column header. */
+#define MC_GHT_ONCOLUMNHEADER         (1 << 2)
+/** @brief The point is over a row header. */
+#define MC_GHT_ONROWHEADER            (1 << 3)
+/*@}*/
+
+/**
+ * @brief Structure for message @ref MC_GM_HITTEST.
+ *
+ * Over a header, the column (or row) index of the header is set to zero if
+ * the header displays the table cell (styles @ref MC_GS_COLUMNHEADERCUSTOM
+ * and @ref MC_GS_ROWHEADERCUSTOM), or to @c (DWORD)-1 otherwise. (The top
+ * left corner is considered to be on both the column and the row header.)
+ *
+ * @sa MC_GM_HITTEST
+ */
+typedef struct MC_GHITTESTINFO_tag {
+    /** @brief [in] The point to test, in client coordinates. */
+    POINT pt;
+    /** @brief [out] Where the point is. See @ref MC_GHT_xxxx. */
+    UINT flags;
+    /** @brief [out] Column index of the cell (in the table). */
+    DWORD dwCol;
+    /** @brief [out] Row index of the cell (in the table). */
+    DWORD dwRow;
+} MC_GHITTESTINFO;
+
 /**
  * @name Control Messages
  */
@@ -223,7 +287,7 @@ typedef struct MC_GGEOMETRY_tag {
  *
  * @param wParam Reserved, set to zero.
  * @param lParam Reserved, set to zero.
- * @return (@c WORD) Returns count of table columns.
+ * @return (@c DWORD) Returns count of table columns.
  */
 #define MC_GM_GETCOLUMNCOUNT      (WM_USER + 102)
 
@@ -232,7 +296,7 @@ typedef struct MC_GGEOMETRY_tag {
  *
  * @param wParam Reserved, set to zero.
  * @param lParam Reserved, set to zero.
- * @return (@c WORD) Returns count of table rows.
+ * @return (@c DWORD) Returns count of table rows.
  */
 #define MC_GM_GETROWCOUNT         (WM_USER + 103)
 
@@ -246,6 +310,44 @@ typedef struct MC_GGEOMETRY_tag {
  */
 #define MC_GM_RESIZE              (WM_USER + 104)
 
+/**
+ * @brief Resizes table attached to the control.
+ *
+ * Same as @ref MC_GM_RESIZE but allows to resize the table to more then 65535
+ * columns or rows.
+ *
+ * @param[in] wParam (@c DWORD) Count of columns.
+ * @param[in] lParam (@c DWORD) Count of rows.
+ * @return (@c BOOL) @c TRUE on success, @c FALSE on failure.
+ */
+#define MC_GM_RESIZEEX            (WM_USER + 105)
+
+/**
+ * @brief Sets a table cell.
+ *
+ * Same as @ref MC_GM_SETCELL but allows to address cells beyond the 65535th
+ * column or row.
+ *
+ * @param wParam Reserved, set to zero.
+ * @param[in] lParam (@ref MC_GCELLEX*) Pointer to structure describing
+ * the cell.
+ * @return (@c BOOL) @c TRUE on success, @c FALSE on failure.
+ */
+#define MC_GM_SETCELLEX           (WM_USER + 106)
+
+/**
+ * @brief Gets a table cell.
+ *
+ * Same as @ref MC_GM_GETCELL but allows to address cells beyond the 65535th
+ * column or row.
+ *
+ * @param wParam Reserved, set to zero.
+ * @param[in,out] lParam (@ref MC_GCELLEX*) Pointer to structure describing
+ * the cell.
+ * @return (@c BOOL) @c TRUE on success, @c FALSE on failure.
+ */
+#define MC_GM_GETCELLEX           (WM_USER + 107)
+
 /**
  * @brief Clears the table.
  *
@@ -299,6 +401,122 @@ typedef struct MC_GGEOMETRY_tag {
  */
 #define MC_GM_GETGEOMETRY         (WM_USER + 113)
 
+/**
+ * @brief Sets width of a column.
+ *
+ * By default, all columns have the width specified by
+ * @ref MC_GGEOMETRY::wColumnWidth. This message sets a different width
+ * of a single column.
+ *
+ * The width is associated with the column index. When the table is resized,
+ * the added columns get the default width.
+ *
+ * @param[in] wParam (@c DWORD) Index of the column (in the table).
+ * @param[in] lParam (@c WORD) The new width in pixels, or @c 0xffff to reset
+ * the column to the default width.
+ * @return (@c BOOL) @c TRUE on success, @c FALSE on failure.
+ */
+#define MC_GM_SETCOLUMNWIDTH      (WM_USER + 114)
+
+/**
+ * @brief Gets width of a column.
+ *
+ * @param[in] wParam (@c DWORD) Index of the column (in the table).
+ * @param lParam Reserved, set to zero.
+ * @return (@c WORD) The width in pixels, or @c -1 on failure.
+ */
+#define MC_GM_GETCOLUMNWIDTH      (WM_USER + 115)
+
+/**
+ * @brief Sets height of a row.
+ *
+ * Same as @ref MC_GM_SETCOLUMNWIDTH but for rows. The default height is
+ * specified by @ref MC_GGEOMETRY::wRowHeight.
+ *
+ * The heights move along with the rows when rows are inserted or deleted
+ * with @ref mcTable_InsertRows() or @ref mcTable_DeleteRows(). However if
+ * more such operations are batched between @ref mcTable_BeginUpdate() and
+ * @ref mcTable_EndUpdate(), heights of all rows are reset to the default.
+ *
+ * @param[in] wParam (@c DWORD) Index of the row (in the table).
+ * @param[in] lParam (@c WORD) The new height in pixels, or @c 0xffff to reset
+ * the row to the default height.
+ * @return (@c BOOL) @c TRUE on success, @c FALSE on failure.
+ */
+#define MC_GM_SETROWHEIGHT        (WM_USER + 116)
+
+/**
+ * @brief Gets height of a row.
+ *
+ * @param[in] wParam (@c DWORD) Index of the row (in the table).
+ * @param lParam Reserved, set to zero.
+ * @return (@c WORD) The height in pixels, or @c -1 on failure.
+ */
+#define MC_GM_GETROWHEIGHT        (WM_USER + 117)
+
+/**
+ * @brief Determines which cell (if any) is at the given point.
+ *
+ * @param wParam Reserved, set to zero.
+ * @param[in,out] lParam (@ref MC_GHITTESTINFO*) Pointer to the structure.
+ * The caller sets @c MC_GHITTESTINFO::pt, and the control fills the rest.
+ * @return (@c BOOL) @c TRUE if the point is over some cell or header,
+ * @c FALSE otherwise.
+ */
+#define MC_GM_HITTEST             (WM_USER + 118)
+
+/**
+ * @brief Limits how often the control repaints itself in response to
+ * changes of the table.
+ *
+ * By default, the control invalidates the changed cells immediately on every
+ * change of the table. When the table changes very often (e.g. thousands of
+ * cells per second), that alone may keep the control busy. With non-zero
+ * interval, the control only remembers the changed regions (merging the
+ * overlapping ones) and repaints them at most once per the interval.
+ *
+ * @param[in] wParam (@c DWORD) The interval in milliseconds, or zero to
+ * repaint on every change.
+ * @param lParam Reserved, set to zero.
+ * @return Not defined, do not rely on return value.
+ */
+#define MC_GM_SETREFRESHINTERVAL  (WM_USER + 119)
+
+/**
+ * @brief Gets the interval set by @ref MC_GM_SETREFRESHINTERVAL.
+ *
+ * @param wParam Reserved, set to zero.
+ * @param lParam Reserved, set to zero.
+ * @return (@c DWORD) The interval in milliseconds.
+ */
+#define MC_GM_GETREFRESHINTERVAL  (WM_USER + 120)
+
+/**
+ * @brief Freezes leading columns and rows so they do not scroll.
+ *
+ * The counts do not include the column (row) used as the row (column)
+ * header with the style @c MC_GS_ROWHEADERCUSTOM (@c MC_GS_COLUMNHEADERCUSTOM).
+ * If the table has less columns (rows), all of them are frozen. By default,
+ * no column nor row is frozen.
+ *
+ * @param[in] wParam (@c DWORD) Count of the frozen columns.
+ * @param[in] lParam (@c DWORD) Count of the frozen rows.
+ * @return Not defined, do not rely on return value.
+ */
+#define MC_GM_SETFROZENCOUNT      (WM_USER + 121)
+
+/**
+ * @brief Gets counts of the frozen columns and rows.
+ *
+ * @param[out] wParam (@c DWORD*) Pointer to a variable receiving the count
+ * of the frozen columns. May be @c NULL.
+ * @param[out] lParam (@c DWORD*) Pointer to a variable receiving the count
+ * of the frozen rows. May be @c NULL.
+ * @return Not defined, do not rely on return value.
+ * @sa MC_GM_SETFROZENCOUNT
+ */
+#define MC_GM_GETFROZENCOUNT      (WM_USER + 122)
+
 /*@}*/
 
 
@@ -297,6 +297,9 @@ typedef struct MC_MTHITTESTINFO_tag {
 
 /**
  * @brief Inserts new tab into the tab control (unicode variant).
+ *
+ * The control can hold at most 65535 tabs.
+ *
  * @param[in] wParam (@c int) Index of the new item.
  * @param[in] lParam (@ref MC_MTITEM*) Pointer to detailed data of the new
  * tab.
@@ -306,6 +309,9 @@ typedef struct MC_MTHITTESTINFO_tag {
 
 /**
  * @brief Inserts new tab into the tab control (ANSI variant).
+ *
+ * The control can hold at most 65535 tabs.
+ *
  * @param[in] wParam (@c int) Index of the new item.
  * @param[in] lParam (@ref MC_MTITEM*) Pointer to detailed data of the new
  * tab.
@@ -205,6 +205,82 @@ int MCTRL_API mcPropSet_InsertItemW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItem
  */
 int MCTRL_API mcPropSet_InsertItemA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItem);
 
+/**
+ * @brief Insert multiple items into the property set (unicode variant).
+ *
+ * This is much faster then inserting the items one by one. If the property
+ * set was created with the flag @c MC_PSF_SORTITEMS, the new items are
+ * sorted and merged into the set in a single pass. Otherwise they are
+ * inserted, in the order of the array, at the position @c pItems[0].iItem
+ * (@c iItem of the other items is ignored).
+ *
+ * Either all the items are inserted, or none of them if the function fails.
+ *
+ * @param[in] hPropSet The property set.
+ * @param[in] pItems Array of the items.
+ * @param[in] uCount Count of the items in the array.
+ * @return @c TRUE on success, @c FALSE on failure.
+ */
+BOOL MCTRL_API mcPropSet_InsertItemsW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItems, UINT uCount);
+
+/**
+ * @brief Insert multiple items into the property set (ANSI variant).
+ *
+ * This is much faster then inserting the items one by one. If the property
+ * set was created with the flag @c MC_PSF_SORTITEMS, the new items are
+ * sorted and merged into the set in a single pass. Otherwise they are
+ * inserted, in the order of the array, at the position @c pItems[0].iItem
+ * (@c iItem of the other items is ignored).
+ *
+ * Either all the items are inserted, or none of them if the function fails.
+ *
+ * @param[in] hPropSet The property set.
+ * @param[in] pItems Array of the items.
+ * @param[in] uCount Count of the items in the array.
+ * @return @c TRUE on success, @c FALSE on failure.
+ */
+BOOL MCTRL_API mcPropSet_InsertItemsA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItems, UINT uCount);
+
+/**
+ * @brief Find an item in the property set by its label (unicode variant).
+ *
+ * The label is compared case-insensitively. The member @c pItem->fMask
+ * must include @c MC_PSIM_TEXT and @c pItem->pszText has to be set to the
+ * label. If @c pItem->fMask also includes @c MC_PSIM_LPARAM, only an item
+ * with the same @c lParam is found.
+ *
+ * The lookup uses a hash index, so it takes constant time on average. The
+ * index is rebuilt on the first lookup after any insertion or deletion in
+ * the middle of the set, or after changing label of any item; i.e. many
+ * lookups are cheap as long as the set does not change between them.
+ *
+ * @param[in] hPropSet The property set.
+ * @param[in] pItem Item structure describing the item to find.
+ * @return Index of the first such item, or @c -1 if there is no such item
+ * or on failure.
+ */
+int MCTRL_API mcPropSet_FindItemW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItem);
+
+/**
+ * @brief Find an item in the property set by its label (ANSI variant).
+ *
+ * The label is compared case-insensitively. The member @c pItem->fMask
+ * must include @c MC_PSIM_TEXT and @c pItem->pszText has to be set to the
+ * label. If @c pItem->fMask also includes @c MC_PSIM_LPARAM, only an item
+ * with the same @c lParam is found.
+ *
+ * The lookup uses a hash index, so it takes constant time on average. The
+ * index is rebuilt on the first lookup after any insertion or deletion in
+ * the middle of the set, or after changing label of any item; i.e. many
+ * lookups are cheap as long as the set does not change between them.
+ *
+ * @param[in] hPropSet The property set.
+ * @param[in] pItem Item structure describing the item to find.
+ * @return Index of the first such item, or @c -1 if there is no such item
+ * or on failure.
+ */
+int MCTRL_API mcPropSet_FindItemA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItem);
+
 /**
  * @brief Get some attributes of an item in the property set (unicode variant).
  *
@@ -276,8 +352,12 @@ BOOL MCTRL_API mcPropSet_DeleteAllItems(MC_HPROPSET hPropSet);
 #define MC_PROPSETITEM          MCTRL_NAME_AW(MC_PROPSETITEM)
 /** @brief Unicode-resolution alias. @sa mcPropSet_InsertItemW mcPropSet_InsertItemA */
 #define mcPropSet_InsertItem    MCTRL_NAME_AW(mcPropSet_InsertItem)
+/** @brief Unicode-resolution alias. @sa mcPropSet_InsertItemsW mcPropSet_InsertItemsA */
+#define mcPropSet_InsertItems   MCTRL_NAME_AW(mcPropSet_InsertItems)
 /** @brief Unicode-resolution alias. @sa mcPropSet_SetItemW mcPropSet_SetItemA */
 #define mcPropSet_SetItem       MCTRL_NAME_AW(mcPropSet_SetItem)
+/** @brief Unicode-resolution alias. @sa mcPropSet_FindItemW mcPropSet_FindItemA */
+#define mcPropSet_FindItem      MCTRL_NAME_AW(mcPropSet_FindItem)
 /** @brief Unicode-resolution alias. @sa mcPropSet_GetItemW mcPropSet_GetItemA */
 #define mcPropSet_GetItem       MCTRL_NAME_AW(mcPropSet_GetItem)
 
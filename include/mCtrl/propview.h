@@ -212,6 +212,31 @@ void MCTRL_API mcPropView_Terminate(void);
  */
 #define MC_PVM_GETITEMCOUNT       (WM_USER + 110)
 
+/**
+ * @brief Limits how often the control repaints itself in response to
+ * changes of the property set.
+ *
+ * By default, the control invalidates the affected items immediately on
+ * every change of the property set. With non-zero interval, the control only
+ * remembers the range of affected items and repaints it at most once per
+ * the interval.
+ *
+ * @param[in] wParam (@c DWORD) The interval in milliseconds, or zero to
+ * repaint on every change.
+ * @param lParam Reserved, set to zero.
+ * @return Not defined, do not rely on return value.
+ */
+#define MC_PVM_SETREFRESHINTERVAL (WM_USER + 116)
+
+/**
+ * @brief Gets the interval set by @ref MC_PVM_SETREFRESHINTERVAL.
+ *
+ * @param wParam Reserved, set to zero.
+ * @param lParam Reserved, set to zero.
+ * @return (@c DWORD) The interval in milliseconds.
+ */
+#define MC_PVM_GETREFRESHINTERVAL (WM_USER + 117)
+
 //#define MC_PVM_SETITEMCOUNT       (WM_USER + 111)
 //#define MC_PVM_SETHOTITEM         (WM_USER + 112)
 //#define MC_PVM_GETHOTITEM         (WM_USER + 113)
@@ -42,7 +42,9 @@ extern "C" {
  *
  * Using homogenous table and/or setting one or more of those flags can be
  * used to save some memory if you know your application never sets certain
- * attributes of table cells.
+ * attributes of table cells. (Note the table stores cell colors and flags
+ * in a compact way as long as only a small fraction of cells uses them, so
+ * the flags matter mainly for tables where many cells do.)
  *
  * If application sets some of such flags (e.g. @c MC_TF_NOCELLFOREGROUND) and
  * later it attempts to set he corresponding attribute of the cell (e.g. 
@@ -53,6 +55,12 @@ extern "C" {
  * If appplication attemps to insert a value of another type into a homogenous
  * table expecting other value type, the operation fails.
  *
+ * The original API uses @c WORD for table dimensions and cell coordinates,
+ * which limits the table to 65535 columns and rows. Functions with the suffix
+ * @c Ex (or @c Ex2 where the @c Ex name has already been taken) use @c DWORD
+ * instead and they should be preferred in new code. The @c WORD variants are
+ * kept for backward compatibility.
+ *
  *
  * @section sec_grid_homo Homogenous tables
  *
@@ -71,6 +79,12 @@ extern "C" {
  * set to @c NULL. It depends on particular value type how this value is
  * interpreted.
  *
+ * Homogenous tables of 64-bit integer types store the integers directly
+ * in the table in 32-bit builds (where the values otherwise need a heap
+ * allocation each). Such table disposes the value set into a cell
+ * immediately, and cells initially hold zero. The value handle retrieved by
+ * @ref mcTable_GetCell() is then only valid until the table is modified.
+ *
  *
  * @section sec_grid_hetero Heterogenous tables
  *
@@ -84,6 +98,72 @@ extern "C" {
  * This allows to set values of any type arbitrarily and types of cells can
  * change dynamically during the table lifetime as different types are
  * specified in @ref mcTable_SetCell().
+ *
+ *
+ * @section sec_table_columnar Column-oriented tables
+ *
+ * Table created with @ref mcTable_CreateColumnar() stores values of each
+ * column separately, and each column has its own value type (so it is
+ * something between homogenous and heterogenous table). This fits data sets
+ * where each column holds one kind of data.
+ *
+ * Growing such table by adding rows with @ref mcTable_AppendRows() is cheap:
+ * the table reserves some spare room in each column, so existing values do
+ * not need to be moved. On the other hand, count of columns of such table
+ * cannot be changed.
+ *
+ *
+ * @section sec_table_snapshot Snapshots
+ *
+ * @ref mcTable_Snapshot() returns a read-only copy of the table. The copy
+ * shares the cell storage with the original table, so it is cheap to make
+ * even for large tables: The storage is split into blocks of rows, and only
+ * a block which is modified afterwards is copied, when the original table
+ * modifies it for the first time.
+ *
+ * The snapshot may be read from another thread (e.g. to export or compute
+ * something from the data) while the original table continues to be
+ * modified and painted in the thread which owns it.
+ *
+ *
+ * @section sec_table_threads Updating from other threads
+ *
+ * Functions of the table (as well as of the controls displaying it) may only
+ * be called from the thread owning the table (usually the thread of the
+ * grid control which displays it).
+ *
+ * The only exception is @ref mcTable_PostCell(): It may be called from any
+ * thread. It does not change the cell immediately; it only queues the change
+ * in a lock-free queue, so threads producing data at a high rate do not wait
+ * for the table or its views. The owner thread later applies all the queued
+ * changes at once, with @ref mcTable_ProcessPostedCells(), so the views get
+ * refreshed only once for the whole batch.
+ *
+ * When the table is displayed in a grid control, the control processes the
+ * posted cells automatically (it gets notified via a posted message).
+ *
+ *
+ * @section sec_table_virtual Virtual tables
+ *
+ * Virtual table, created with @ref mcTable_CreateVirtual(), does not store
+ * any cells. Whenever a cell is needed (typically when a grid control paints
+ * the visible part of the table), the table calls an application-provided
+ * callback to get it. Memory consumption and the time needed to set up such
+ * table therefore do not depend on the size of the data set.
+ *
+ * To avoid asking the application for the same cells repeatedly (e.g. when
+ * the grid is scrolled back and forth), the table remembers the given count
+ * of the most recently fetched cells. When the cache is full, the least
+ * recently used cell is discarded.
+ *
+ * Virtual tables cannot be modified with @ref mcTable_SetCell() and similar
+ * functions. When the underlying data change, the application should call
+ * @ref mcTable_Clear(): For virtual table it just discards all the cached
+ * cells and repaints all views of the table.
+ *
+ * Note that the value retrieved with @ref mcTable_GetCell() from a virtual
+ * table is only guaranteed to stay valid until the next call to any function
+ * of the table.
  */
 
 
@@ -122,6 +202,39 @@ typedef void* MC_HTABLE;
 MC_HTABLE MCTRL_API mcTable_Create(WORD wColumnCount, WORD wRowCount,
                                    MC_HVALUETYPE hType, DWORD dwFlags);
 
+/**
+ * @brief Create new table.
+ *
+ * Same as @ref mcTable_Create() but allows to create table with more then
+ * 65535 columns or rows.
+ *
+ * @param[in] dwColumnCount Column count.
+ * @param[in] dwRowCount Row count.
+ * @param[in] hType Type of all cells for homogenous table, or @c NULL for
+ * heterogenous table.
+ * @param[in] dwFlags Table flags. See @ref MC_TF_xxxx.
+ * @return Handle of the new table or @c NULL on failure.
+ */
+MC_HTABLE MCTRL_API mcTable_CreateEx(DWORD dwColumnCount, DWORD dwRowCount,
+                                     MC_HVALUETYPE hType, DWORD dwFlags);
+
+/**
+ * @brief Create new column-oriented table.
+ *
+ * The table is initially empty and has its reference counter set to 1.
+ * See @ref sec_table_columnar for more info.
+ *
+ * @param[in] dwColumnCount Column count.
+ * @param[in] dwRowCount Row count.
+ * @param[in] phColumnTypes Array of @c dwColumnCount value types, one for
+ * each column. None of them may be @c NULL.
+ * @param[in] dwFlags Table flags. See @ref MC_TF_xxxx.
+ * @return Handle of the new table or @c NULL on failure.
+ */
+MC_HTABLE MCTRL_API mcTable_CreateColumnar(DWORD dwColumnCount, DWORD dwRowCount,
+                                           const MC_HVALUETYPE* phColumnTypes,
+                                           DWORD dwFlags);
+
 /**
  * @brief Increment reference counter of the table.
  *
@@ -143,18 +256,36 @@ void MCTRL_API mcTable_Release(MC_HTABLE hTable);
  * @brief Retrieve count of table columns.
  *
  * @param[in] hTable The table.
- * @return The count.
+ * @return The count. If the table has more then 65535 columns, 65535 is
+ * returned.
  */
 WORD MCTRL_API mcTable_ColumnCount(MC_HTABLE hTable);
 
 /**
- * @brief Retrieve count of table rows.
+ * @brief Retrieve count of table columns.
  *
  * @param[in] hTable The table.
  * @return The count.
  */
+DWORD MCTRL_API mcTable_ColumnCountEx(MC_HTABLE hTable);
+
+/**
+ * @brief Retrieve count of table rows.
+ *
+ * @param[in] hTable The table.
+ * @return The count. If the table has more then 65535 rows, 65535 is
+ * returned.
+ */
 WORD MCTRL_API mcTable_RowCount(MC_HTABLE hTable);
 
+/**
+ * @brief Retrieve count of table rows.
+ *
+ * @param[in] hTable The table.
+ * @return The count.
+ */
+DWORD MCTRL_API mcTable_RowCountEx(MC_HTABLE hTable);
+
 /**
  * @brief Resize the table.
  *
@@ -170,6 +301,64 @@ WORD MCTRL_API mcTable_RowCount(MC_HTABLE hTable);
  */
 BOOL MCTRL_API mcTable_Resize(MC_HTABLE hTable, WORD wColumnCount, WORD wRowCount);
 
+/**
+ * @brief Resize the table.
+ *
+ * Same as @ref mcTable_Resize() but allows to resize the table to more then
+ * 65535 columns or rows.
+ *
+ * Note that count of columns of column-oriented table cannot be changed
+ * (see @ref sec_table_columnar).
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwColumnCount Column count.
+ * @param[in] dwRowCount Row count.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_ResizeEx(MC_HTABLE hTable, DWORD dwColumnCount, DWORD dwRowCount);
+
+/**
+ * @brief Insert rows into the table.
+ *
+ * New empty rows are inserted before the row @c dwRow. Rows below it are
+ * moved down. Pass the current row count as @c dwRow to add the rows to
+ * the end of the table (see also @ref mcTable_AppendRows()).
+ *
+ * The table grows its storage geometrically, so inserting rows one by one
+ * at the end of the table is amortized constant time. Only the affected
+ * rows are repainted by the views of the table.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwRow Index of row where to insert the new rows.
+ * @param[in] dwCount Count of rows to insert.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_InsertRows(MC_HTABLE hTable, DWORD dwRow, DWORD dwCount);
+
+/**
+ * @brief Append rows to the end of the table.
+ *
+ * Same as @ref mcTable_InsertRows() with the current row count as @c dwRow.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCount Count of rows to append.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_AppendRows(MC_HTABLE hTable, DWORD dwCount);
+
+/**
+ * @brief Delete rows from the table.
+ *
+ * Values in the deleted rows are destroyed and rows below them are moved up.
+ * The table keeps the freed storage for later reuse.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwRow Index of the first row to delete.
+ * @param[in] dwCount Count of rows to delete.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_DeleteRows(MC_HTABLE hTable, DWORD dwRow, DWORD dwCount);
+
 /**
  * @brief Clear the table.
  *
@@ -177,6 +366,9 @@ BOOL MCTRL_API mcTable_Resize(MC_HTABLE hTable, WORD wColumnCount, WORD wRowCoun
  * to @c NULL values of the particular value type, in case of homogenous
  * table the table becomes empty.
  *
+ * In case of virtual table, only the cells cached by the table are
+ * discarded (see @ref sec_table_virtual).
+ *
  * @param[in] hTable The table.
  */
 void MCTRL_API mcTable_Clear(MC_HTABLE hTable);
@@ -298,11 +490,26 @@ typedef struct MC_TABLECELL_tag {
  * @param[in] pCell Specifies attributes of the cell to set.
  * @return @c TRUE on success, @c FALSE otherwise.
  *
- * @sa mcTable_SetCell
+ * @sa mcTable_SetCell mcTable_SetCellEx2
  */
 BOOL MCTRL_API mcTable_SetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow,
                                  MC_TABLECELL* pCell);
 
+/**
+ * @brief Set contents of a cell.
+ *
+ * Same as @ref mcTable_SetCellEx() but allows to address cells beyond
+ * the 65535th column or row.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index.
+ * @param[in] dwRow Row index.
+ * @param[in] pCell Specifies attributes of the cell to set.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_SetCellEx2(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                  MC_TABLECELL* pCell);
+
 /**
  * @brief Get contents of a cell.
  *
@@ -315,11 +522,249 @@ BOOL MCTRL_API mcTable_SetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow,
  * @param[out] pCell Specifies retrieved attributes of the cell.
  * @return @c TRUE on success, @c FALSE otherwise.
  *
- * @sa mcTable_GetCell
+ * @sa mcTable_GetCell mcTable_GetCellEx2
  */
 BOOL MCTRL_API mcTable_GetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow,
                                  MC_TABLECELL* pCell);
 
+/**
+ * @brief Get contents of a cell.
+ *
+ * Same as @ref mcTable_GetCellEx() but allows to address cells beyond
+ * the 65535th column or row.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index.
+ * @param[in] dwRow Row index.
+ * @param[out] pCell Specifies retrieved attributes of the cell.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_GetCellEx2(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                  MC_TABLECELL* pCell);
+
+/**
+ * @brief Set contents of a rectangular range of cells.
+ *
+ * The cells are described by an array of @ref MC_TABLECELL structures, one
+ * for each cell of the range, ordered row by row. Each structure is
+ * interpreted as with @ref mcTable_SetCellEx2().
+ *
+ * All the cells are validated, and all the memory needed is allocated,
+ * before the table is modified. So on failure (including lack of memory),
+ * the function has no effect and the caller keeps the responsibility for
+ * all the values. Views of the table are refreshed only once, after all
+ * the cells are set.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index of the top left cell of the range.
+ * @param[in] dwRow Row index of the top left cell of the range.
+ * @param[in] dwColCount Count of columns of the range.
+ * @param[in] dwRowCount Count of rows of the range.
+ * @param[in] pCells Array of @c dwColCount * @c dwRowCount cells.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_SetCellRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                    DWORD dwColCount, DWORD dwRowCount,
+                                    MC_TABLECELL* pCells);
+
+/**
+ * @brief Get contents of a rectangular range of cells.
+ *
+ * Before calling this function, the member @c fMask of each item of
+ * @c pCells must specify what members of the structure to retrieve.
+ * The array is ordered row by row.
+ *
+ * In case of virtual table, the range must not have more cells than the
+ * cache size of the table, otherwise the function fails with
+ * @c ERROR_INVALID_PARAMETER. (The retrieved values live in the cache.)
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index of the top left cell of the range.
+ * @param[in] dwRow Row index of the top left cell of the range.
+ * @param[in] dwColCount Count of columns of the range.
+ * @param[in] dwRowCount Count of rows of the range.
+ * @param[in,out] pCells Array of @c dwColCount * @c dwRowCount cells.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_GetCellRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                    DWORD dwColCount, DWORD dwRowCount,
+                                    MC_TABLECELL* pCells);
+
+/**
+ * @brief Set values of a rectangular range of cells.
+ *
+ * Same as @ref mcTable_SetCellRange() but only values are set, and they are
+ * passed in parallel arrays of types and values, ordered row by row.
+ *
+ * For homogenous and column-oriented tables, @c phTypes may be @c NULL. Each
+ * value is then considered to be of the type its column requires.
+ *
+ * The function either fails without any effect, or the table takes
+ * responsibility for all the values.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index of the top left cell of the range.
+ * @param[in] dwRow Row index of the top left cell of the range.
+ * @param[in] dwColCount Count of columns of the range.
+ * @param[in] dwRowCount Count of rows of the range.
+ * @param[in] phTypes Array of @c dwColCount * @c dwRowCount value types,
+ * or @c NULL.
+ * @param[in] phValues Array of @c dwColCount * @c dwRowCount values.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_SetValueRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                     DWORD dwColCount, DWORD dwRowCount,
+                                     const MC_HVALUETYPE* phTypes,
+                                     const MC_HVALUE* phValues);
+
+/**
+ * @brief Get values of a rectangular range of cells.
+ *
+ * Same as @ref mcTable_GetCellRange() but only values are retrieved, into
+ * parallel arrays of types and values, ordered row by row.
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index of the top left cell of the range.
+ * @param[in] dwRow Row index of the top left cell of the range.
+ * @param[in] dwColCount Count of columns of the range.
+ * @param[in] dwRowCount Count of rows of the range.
+ * @param[out] phTypes Array of @c dwColCount * @c dwRowCount value types
+ * to fill, or @c NULL.
+ * @param[out] phValues Array of @c dwColCount * @c dwRowCount values to fill,
+ * or @c NULL.
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_GetValueRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                     DWORD dwColCount, DWORD dwRowCount,
+                                     MC_HVALUETYPE* phTypes, MC_HVALUE* phValues);
+
+/**
+ * @brief Create read-only snapshot of the table.
+ *
+ * The snapshot is a table with the same contents as the table has at the time
+ * of the call. It shares the storage with the table, copy-on-write, so later
+ * changes of the table do not affect the snapshot.
+ *
+ * The snapshot cannot be modified: All functions changing a table fail with
+ * @c ERROR_NOT_SUPPORTED for it. It can be read from any thread, but the
+ * snapshot has to be created in the thread which modifies the table.
+ *
+ * Snapshots of virtual tables are not supported.
+ *
+ * When no longer needed, release the snapshot with @ref mcTable_Release().
+ *
+ * @param[in] hTable The table.
+ * @return Handle of the snapshot, or @c NULL on failure.
+ */
+MC_HTABLE MCTRL_API mcTable_Snapshot(MC_HTABLE hTable);
+
+/**
+ * @brief Set a cell from any thread.
+ *
+ * Unlike @ref mcTable_SetCellEx2(), this function may be called from any
+ * thread. The cell is not set immediately: The function only queues the
+ * change. It is applied later, when the thread owning the table calls
+ * @ref mcTable_ProcessPostedCells(). (Grid control displaying the table does
+ * that automatically.)
+ *
+ * Because the change is applied later, the cell coordinates are validated
+ * only then: If the table is meanwhile resized so that the cell is out of
+ * it, the change is discarded.
+ *
+ * The caller has to hold a reference to the table (see
+ * @ref mcTable_AddRef()) while posting. When the function succeeds, the table
+ * takes responsibility for the value, even if the change is later discarded.
+ *
+ * @param[in] hTable The table. It cannot be a virtual table or a snapshot.
+ * @param[in] dwCol Column index.
+ * @param[in] dwRow Row index.
+ * @param[in] pCell Specification of the cell change, as for
+ * @ref mcTable_SetCellEx2().
+ * @return @c TRUE on success, @c FALSE otherwise.
+ */
+BOOL MCTRL_API mcTable_PostCell(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                                MC_TABLECELL* pCell);
+
+/**
+ * @brief Apply all cells posted with @ref mcTable_PostCell().
+ *
+ * The changes are applied in the order they have been posted, and views of
+ * the table are refreshed only once for all of them.
+ *
+ * This has to be called from the thread owning the table. Applications
+ * which display the table in a grid control do not need to call it.
+ *
+ * @param[in] hTable The table.
+ */
+void MCTRL_API mcTable_ProcessPostedCells(MC_HTABLE hTable);
+
+/**
+ * @brief Start a batch of changes of the table.
+ *
+ * Until the matching @ref mcTable_EndUpdate() is called, views of the table
+ * (e.g. grid controls) are not refreshed on each change. Instead, the table
+ * remembers bounding rectangle of all the changed cells and refreshes the
+ * views only once, when the batch ends.
+ *
+ * The calls may be nested. The views are refreshed when the outermost batch
+ * ends.
+ *
+ * @param[in] hTable The table.
+ */
+void MCTRL_API mcTable_BeginUpdate(MC_HTABLE hTable);
+
+/**
+ * @brief End a batch of changes of the table.
+ *
+ * @param[in] hTable The table.
+ * @sa mcTable_BeginUpdate
+ */
+void MCTRL_API mcTable_EndUpdate(MC_HTABLE hTable);
+
+/**
+ * @brief Prototype of callback function providing cells of virtual table.
+ *
+ * On input, @c pCell->fMask specifies what members the table asks for, and
+ * all the members are preset to their defaults (i.e. an empty cell).
+ *
+ * If the callback provides a value (@c pCell->hType and @c pCell->hValue),
+ * the table takes responsibility for it and destroys it when it is no longer
+ * needed. Therefore the callback should normally hand over a new value,
+ * e.g. created with @ref mcValue_Duplicate().
+ *
+ * @param[in] hTable The table.
+ * @param[in] dwCol Column index.
+ * @param[in] dwRow Row index.
+ * @param[in,out] pCell The cell to fill.
+ * @param[in] pUserData The pointer passed to @ref mcTable_CreateVirtual().
+ * @return @c TRUE on success, @c FALSE otherwise. On failure the table
+ * ignores contents of @c pCell.
+ *
+ * @sa sec_table_virtual
+ */
+typedef BOOL (CALLBACK* MC_TABLECALLBACK)(MC_HTABLE hTable, DWORD dwCol,
+                                          DWORD dwRow, MC_TABLECELL* pCell,
+                                          void* pUserData);
+
+/**
+ * @brief Create new virtual table.
+ *
+ * The virtual table has no storage for its cells. Instead it calls the
+ * provided callback whenever some cell is needed (e.g. when grid control
+ * paints it). See @ref sec_table_virtual for more info.
+ *
+ * @param[in] dwColumnCount Column count.
+ * @param[in] dwRowCount Row count.
+ * @param[in] pfnCallback The callback providing the cells.
+ * @param[in] pUserData User data passed into the callback.
+ * @param[in] dwCacheSize Count of recently fetched cells the table remembers.
+ * Zero means (nearly) no caching.
+ * @return Handle of the new table or @c NULL on failure.
+ */
+MC_HTABLE MCTRL_API mcTable_CreateVirtual(DWORD dwColumnCount, DWORD dwRowCount,
+                                          MC_TABLECALLBACK pfnCallback,
+                                          void* pUserData, DWORD dwCacheSize);
+
 
 #ifdef __cplusplus
 }  /* extern "C" */
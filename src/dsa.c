@@ -34,9 +34,10 @@
 
 
 void
-dsa_init(dsa_t* dsa, WORD item_size)
+dsa_init(dsa_t* dsa, size_t item_size)
 {
-    DSA_TRACE("dsa_init(%p, %d)", dsa, (int)item_size);
+    DSA_TRACE("dsa_init(%p, %lu)", dsa, (ULONG)item_size);
+    MC_ASSERT(item_size > 0);
 
     dsa->buffer = NULL;
     dsa->item_size = item_size;
@@ -49,52 +50,79 @@ dsa_fini(dsa_t* dsa, dsa_dtor_t dtor_func)
 {
     DSA_TRACE("dsa_fini(%p)", dsa);
 
-    if(dsa->buffer != NULL)
-        free(dsa->buffer);
+    dsa_clear(dsa, dtor_func);
 }
 
-int
-dsa_reserve(dsa_t* dsa, WORD size)
+/* Resizes the buffer to exactly the given capacity. All the arithmetic is
+ * checked so huge capacity cannot wrap around into small allocation. */
+static int
+dsa_realloc(dsa_t* dsa, DWORD capacity)
 {
     BYTE* buffer;
 
-    DSA_TRACE("dsa_reserve(%p, %d)", dsa, (int)size);
+    MC_ASSERT(capacity >= dsa->size);
 
-    if((WORD)(dsa->size + size) <= dsa->capacity)
-        return 0;
+    if(MC_ERR(capacity > DSA_MAX_SIZE  ||
+              (size_t)capacity > ((size_t)-1) / dsa->item_size)) {
+        MC_TRACE("dsa_realloc: Capacity %lu too large.", (ULONG)capacity);
+        return -1;
+    }
 
-    buffer = (BYTE*) malloc((dsa->size + size) * dsa->item_size);
+    buffer = (BYTE*) realloc(dsa->buffer, (size_t)capacity * dsa->item_size);
     if(MC_ERR(buffer == NULL)) {
-        MC_TRACE("dsa_reserve: malloc() failed.");
+        MC_TRACE("dsa_realloc: realloc() failed.");
         return -1;
     }
 
-    if(dsa->buffer != NULL) {
-        memcpy(buffer, dsa->buffer, dsa->size * dsa->item_size);
-        free(dsa->buffer);
+    dsa->buffer = buffer;
+    dsa->capacity = capacity;
+    return 0;
+}
+
+int
+dsa_reserve(dsa_t* dsa, DWORD size)
+{
+    DSA_TRACE("dsa_reserve(%p, %lu)", dsa, (ULONG)size);
+
+    if(size <= dsa->capacity - dsa->size)
+        return 0;
+
+    if(MC_ERR(size > DSA_MAX_SIZE - dsa->size)) {
+        MC_TRACE("dsa_reserve: Size %lu + %lu too large.",
+                 (ULONG)dsa->size, (ULONG)size);
+        return -1;
+    }
+
+    if(MC_ERR(dsa_realloc(dsa, dsa->size + size) != 0)) {
+        MC_TRACE("dsa_reserve: dsa_realloc() failed.");
+        return -1;
     }
 
-    dsa->buffer = buffer;
-    dsa->capacity = dsa->size + size;
     return 0;
 }
 
 void*
-dsa_insert_raw(dsa_t* dsa, WORD index)
+dsa_insert_raw(dsa_t* dsa, DWORD index)
 {
-    DSA_TRACE("dsa_insert_raw(%p, %d)", dsa, (int)index);
+    DSA_TRACE("dsa_insert_raw(%p, %lu)", dsa, (ULONG)index);
     MC_ASSERT(index <= dsa->size);
 
     if(dsa->capacity - dsa->size == 0) {
-        if(MC_ERR(dsa_reserve(dsa, DSA_DEFAULT_GROW_SIZE) != 0)) {
-            MC_TRACE("dsa_insert_raw: dsa_reserve() failed.");
+        /* Grow geometrically (by half of the current size) so series of
+         * inserts has amortized constant cost. */
+        DWORD grow = MC_MAX(dsa->size / 2, DSA_DEFAULT_GROW_SIZE);
+
+        if(grow > DSA_MAX_SIZE - dsa->size)
+            grow = DSA_MAX_SIZE - dsa->size;
+        if(MC_ERR(grow == 0  ||  dsa_realloc(dsa, dsa->size + grow) != 0)) {
+            MC_TRACE("dsa_insert_raw: dsa_realloc() failed.");
             return NULL;
         }
     }
 
     if(index < dsa->size) {
         memmove(dsa_item(dsa, index+1), dsa_item(dsa, index),
-                (dsa->size - index) * dsa->item_size);
+                (size_t)(dsa->size - index) * dsa->item_size);
     }
 
     dsa->size++;
@@ -102,11 +130,11 @@ dsa_insert_raw(dsa_t* dsa, WORD index)
 }
 
 int
-dsa_insert(dsa_t* dsa, WORD index, void* item)
+dsa_insert(dsa_t* dsa, DWORD index, void* item)
 {
     void* ptr;
 
-    DSA_TRACE("dsa_insert(%p, %d, %p)", dsa, (int)index, item);
+    DSA_TRACE("dsa_insert(%p, %lu, %p)", dsa, (ULONG)index, item);
     MC_ASSERT(index <= dsa->size);
 
     ptr = dsa_insert_raw(dsa, index);
@@ -116,15 +144,13 @@ dsa_insert(dsa_t* dsa, WORD index, void* item)
     }
 
     mc_inlined_memcpy(ptr, item, dsa->item_size);
-    return index;
+    return (int) index;
 }
 
 void
-dsa_remove(dsa_t* dsa, WORD index, dsa_dtor_t dtor_func)
+dsa_remove(dsa_t* dsa, DWORD index, dsa_dtor_t dtor_func)
 {
-    BYTE* buffer;
-
-    DSA_TRACE("dsa_remove(%p, %d)", dsa, (int)index);
+    DSA_TRACE("dsa_remove(%p, %lu)", dsa, (ULONG)index);
     MC_ASSERT(index < dsa->size);
 
     if(dtor_func != NULL)
@@ -140,32 +166,21 @@ dsa_remove(dsa_t* dsa, WORD index, dsa_dtor_t dtor_func)
         return;
     }
 
-    if(dsa->size + 7 > dsa->capacity) {
-no_realloc:
-        memmove(dsa_item(dsa, index), dsa_item(dsa, index+1),
-                (dsa->size - index - 1) * dsa->item_size);
-        dsa->size--;
-        return;
-    }
-
-    buffer = (BYTE*) malloc((dsa->size - 1) * dsa->item_size);
-    if(MC_ERR(buffer == NULL))
-        goto no_realloc;
-
-    memcpy(buffer, dsa->buffer, index * dsa->item_size);
-    memcpy(buffer + index * dsa->item_size, dsa_item(dsa, index+1),
-           (dsa->size - index - 1) * dsa->item_size);
-
-    free(dsa->buffer);
-    dsa->buffer = buffer;
+    memmove(dsa_item(dsa, index), dsa_item(dsa, index+1),
+            (size_t)(dsa->size - index - 1) * dsa->item_size);
     dsa->size--;
-    dsa->capacity = dsa->size;
+
+    /* Shrink only when the array is mostly empty, and then only by half, so
+     * alternating inserts and removes do not reallocate all the time. If the
+     * realloc() fails, we just keep the bigger buffer. */
+    if(dsa->capacity > DSA_DEFAULT_GROW_SIZE  &&  dsa->size < dsa->capacity / 4)
+        dsa_realloc(dsa, dsa->capacity / 2);
 }
 
 void
 dsa_clear(dsa_t* dsa, dsa_dtor_t dtor_func)
 {
-    WORD index;
+    DWORD index;
 
     DSA_TRACE("dsa_clear(%p)", dsa);
 
@@ -182,208 +197,600 @@ dsa_clear(dsa_t* dsa, dsa_dtor_t dtor_func)
     dsa->capacity = 0;
 }
 
-/* dsa_sort() below is adapted qsort() from glibc-2.13.
- * Copyright (C) 1991,1992,1996,1997,1999,2004 Free Software Foundation, Inc.
- * Written by Douglas C. Schmidt (schmidt@ics.uci.edu). */
+/* dsa_sort() below is pattern-defeating quicksort (pdqsort) as described by
+ * Orson Peters: introsort-like quicksort which falls back to heapsort when
+ * it detects too many bad partitions (so the worst case is O(n log n)),
+ * breaks patterns which would lead to those, and finishes already (or
+ * nearly) sorted partitions with cheap insertion sort.
+ *
+ * dsa_sort_stable() is bottom-up merge sort with a temporary buffer.
+ *
+ * Items are moved with memmove() in bulk and swapped by words, never byte
+ * by byte (unless the item size is not a multiple of the word size). */
+
+#define DSA_SORT_INSERTION_THRESHOLD        24
+#define DSA_SORT_NINTHER_THRESHOLD         128
+#define DSA_SORT_PARTIAL_INSERTION_LIMIT     8
+#define DSA_SORT_TMP_SIZE                   64
+
+typedef struct dsa_sorter_tag dsa_sorter_t;
+struct dsa_sorter_tag {
+    dsa_t* dsa;
+    dsa_cmp_t cmp_func;
+    size_t item_size;
+    BYTE* tmp;            /* room for one item, or NULL if not available */
+};
+
+#define DSA_LESS(s, a, b)    ((s)->cmp_func((s)->dsa, (a), (b)) < 0)
+
+static inline void
+dsa_swap(BYTE* a, BYTE* b, size_t item_size)
+{
+    /* Items in the buffer are aligned to the word size if their size is a
+     * multiple of it (the buffer comes from malloc()). */
+    if(item_size % sizeof(size_t) == 0) {
+        size_t* wa = (size_t*) a;
+        size_t* wb = (size_t*) b;
+        size_t n = item_size / sizeof(size_t);
+        size_t w;
+
+        while(n-- > 0) {
+            w = *wa;
+            *wa++ = *wb;
+            *wb++ = w;
+        }
+    } else {
+        mc_inlined_memswap(a, b, item_size);
+    }
+}
+
+static inline void
+dsa_sort2(dsa_sorter_t* s, BYTE* a, BYTE* b)
+{
+    if(DSA_LESS(s, b, a))
+        dsa_swap(a, b, s->item_size);
+}
+
+static inline void
+dsa_sort3(dsa_sorter_t* s, BYTE* a, BYTE* b, BYTE* c)
+{
+    dsa_sort2(s, a, b);
+    dsa_sort2(s, b, c);
+    dsa_sort2(s, a, b);
+}
+
+/* Moves item src to dst (dst < src), shifting items [dst, src) to the right
+ * by one. */
+static void
+dsa_sort_rotate(dsa_sorter_t* s, BYTE* dst, BYTE* src)
+{
+    if(s->tmp != NULL) {
+        memcpy(s->tmp, src, s->item_size);
+        memmove(dst + s->item_size, dst, src - dst);
+        memcpy(dst, s->tmp, s->item_size);
+    } else {
+        while(src > dst) {
+            dsa_swap(src - s->item_size, src, s->item_size);
+            src -= s->item_size;
+        }
+    }
+}
+
+/* Insertion sort of [begin, end). If guarded is FALSE, the caller
+ * guarantees there is an item not greater then any in the range just before
+ * begin, so the search for the place does not need to check for begin.
+ * If limit is non-zero, the sort gives up (and returns FALSE) after moving
+ * more then that many items. */
+static BOOL
+dsa_sort_insertion(dsa_sorter_t* s, BYTE* begin, BYTE* end,
+                   BOOL guarded, size_t limit)
+{
+    const size_t item_size = s->item_size;
+    size_t moved = 0;
+    BYTE* cur;
+    BYTE* sift;
+
+    if(begin == end)
+        return TRUE;
+
+    for(cur = begin + item_size; cur < end; cur += item_size) {
+        if(!DSA_LESS(s, cur, cur - item_size))
+            continue;
+
+        sift = cur - item_size;
+        while((!guarded || sift > begin)  &&  DSA_LESS(s, cur, sift - item_size))
+            sift -= item_size;
+        dsa_sort_rotate(s, sift, cur);
+
+        if(limit > 0) {
+            moved += (cur - sift) / item_size;
+            if(moved > limit)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+dsa_sort_heap_sift(dsa_sorter_t* s, BYTE* base, size_t root, size_t n)
+{
+    const size_t item_size = s->item_size;
+    size_t child;
+
+    while((child = 2 * root + 1) < n) {
+        if(child + 1 < n  &&
+           DSA_LESS(s, base + child * item_size, base + (child+1) * item_size))
+            child++;
+        if(!DSA_LESS(s, base + root * item_size, base + child * item_size))
+            break;
+        dsa_swap(base + root * item_size, base + child * item_size, item_size);
+        root = child;
+    }
+}
+
+static void
+dsa_sort_heap(dsa_sorter_t* s, BYTE* begin, BYTE* end)
+{
+    size_t n = (end - begin) / s->item_size;
+    size_t i;
+
+    for(i = n / 2; i-- > 0; )
+        dsa_sort_heap_sift(s, begin, i, n);
+    for(i = n - 1; i > 0; i--) {
+        dsa_swap(begin, begin + i * s->item_size, s->item_size);
+        dsa_sort_heap_sift(s, begin, 0, i);
+    }
+}
+
+/* Partitions [begin, end) around the pivot at begin so that items less
+ * then the pivot go to its left. Returns the final position of the pivot,
+ * and whether the range has already been partitioned (no swap needed). */
+static BYTE*
+dsa_sort_partition_right(dsa_sorter_t* s, BYTE* begin, BYTE* end,
+                         BOOL* already_partitioned)
+{
+    const size_t item_size = s->item_size;
+    BYTE* first = begin;
+    BYTE* last = end;
+
+    /* The pivot stays at begin until the end: only items behind it are
+     * swapped. */
+    do {
+        first += item_size;
+    } while(DSA_LESS(s, first, begin));
+
+    if(first - item_size == begin) {
+        while(first < last) {
+            last -= item_size;
+            if(DSA_LESS(s, last, begin))
+                break;
+        }
+    } else {
+        do {
+            last -= item_size;
+        } while(!DSA_LESS(s, last, begin));
+    }
+
+    *already_partitioned = (first >= last);
+
+    while(first < last) {
+        dsa_swap(first, last, item_size);
+        do {
+            first += item_size;
+        } while(DSA_LESS(s, first, begin));
+        do {
+            last -= item_size;
+        } while(!DSA_LESS(s, last, begin));
+    }
+
+    first -= item_size;
+    if(first != begin)
+        dsa_swap(begin, first, item_size);
+    return first;
+}
+
+/* Partitions [begin, end) around the pivot at begin so that items equal to
+ * the pivot go to its left. Used when the pivot is equal to the item
+ * preceding the range: all of those are then already in place. */
+static BYTE*
+dsa_sort_partition_left(dsa_sorter_t* s, BYTE* begin, BYTE* end)
+{
+    const size_t item_size = s->item_size;
+    BYTE* first = begin;
+    BYTE* last = end;
+
+    do {
+        last -= item_size;
+    } while(DSA_LESS(s, begin, last));
+
+    if(last + item_size == end) {
+        while(first < last) {
+            first += item_size;
+            if(DSA_LESS(s, begin, first))
+                break;
+        }
+    } else {
+        do {
+            first += item_size;
+        } while(!DSA_LESS(s, begin, first));
+    }
 
-#define MAX_THRESH 4
+    while(first < last) {
+        dsa_swap(first, last, item_size);
+        do {
+            last -= item_size;
+        } while(DSA_LESS(s, begin, last));
+        do {
+            first += item_size;
+        } while(!DSA_LESS(s, begin, first));
+    }
 
-typedef struct {
-    BYTE* lo;
-    BYTE* hi;
-} stack_node;
+    if(last != begin)
+        dsa_swap(begin, last, item_size);
+    return last;
+}
 
-#define STACK_SIZE      (CHAR_BIT * sizeof(WORD))
-#define PUSH(low, high) ((void)((top->lo = (low)), (top->hi = (high)), ++top))
-#define POP(low, high)  ((void)(--top, (low = top->lo), (high = top->hi)))
-#define STACK_NOT_EMPTY (stack < top)
+/* Swaps few items of the partition with items from its other part, to break
+ * patterns causing the bad partitioning. */
+static void
+dsa_sort_break_patterns(dsa_sorter_t* s, BYTE* begin, BYTE* end)
+{
+    const size_t item_size = s->item_size;
+    size_t n = (end - begin) / item_size;
+    size_t q = n / 4;
+
+    if(n < DSA_SORT_INSERTION_THRESHOLD)
+        return;
+
+    dsa_swap(begin, begin + q * item_size, item_size);
+    dsa_swap(end - item_size, end - q * item_size, item_size);
+    if(n > DSA_SORT_NINTHER_THRESHOLD) {
+        dsa_swap(begin + item_size, begin + (q+1) * item_size, item_size);
+        dsa_swap(begin + 2 * item_size, begin + (q+2) * item_size, item_size);
+        dsa_swap(end - 2 * item_size, end - (q+1) * item_size, item_size);
+        dsa_swap(end - 3 * item_size, end - (q+2) * item_size, item_size);
+    }
+}
+
+static void
+dsa_sort_loop(dsa_sorter_t* s, BYTE* begin, BYTE* end, int bad_allowed,
+              BOOL leftmost)
+{
+    const size_t item_size = s->item_size;
+
+    while(TRUE) {
+        size_t n = (end - begin) / item_size;
+        size_t half = n / 2;
+        size_t l_size, r_size;
+        BYTE* pivot;
+        BOOL already_partitioned;
+
+        if(n < DSA_SORT_INSERTION_THRESHOLD) {
+            dsa_sort_insertion(s, begin, end, leftmost, 0);
+            return;
+        }
+
+        /* Choose pivot as median of 3 or, for bigger ranges, pseudomedian
+         * of 9 items, and move it to begin. */
+        if(n > DSA_SORT_NINTHER_THRESHOLD) {
+            dsa_sort3(s, begin, begin + half * item_size, end - item_size);
+            dsa_sort3(s, begin + item_size, begin + (half-1) * item_size,
+                      end - 2 * item_size);
+            dsa_sort3(s, begin + 2 * item_size, begin + (half+1) * item_size,
+                      end - 3 * item_size);
+            dsa_sort3(s, begin + (half-1) * item_size, begin + half * item_size,
+                      begin + (half+1) * item_size);
+            dsa_swap(begin, begin + half * item_size, item_size);
+        } else {
+            dsa_sort3(s, begin + half * item_size, begin, end - item_size);
+        }
+
+        /* If the pivot is equal to the preceding item (which is not greater
+         * then anything in the range), there is lots of equal items. Put
+         * all the equal items to the left and skip them. */
+        if(!leftmost  &&  !DSA_LESS(s, begin - item_size, begin)) {
+            begin = dsa_sort_partition_left(s, begin, end) + item_size;
+            continue;
+        }
+
+        pivot = dsa_sort_partition_right(s, begin, end, &already_partitioned);
+        l_size = (pivot - begin) / item_size;
+        r_size = (end - pivot) / item_size - 1;
+
+        if(l_size < n / 8  ||  r_size < n / 8) {
+            if(--bad_allowed == 0) {
+                dsa_sort_heap(s, begin, end);
+                return;
+            }
+            dsa_sort_break_patterns(s, begin, pivot);
+            dsa_sort_break_patterns(s, pivot + item_size, end);
+        } else if(already_partitioned) {
+            /* Maybe the range is (nearly) sorted already. */
+            if(dsa_sort_insertion(s, begin, pivot, leftmost, DSA_SORT_PARTIAL_INSERTION_LIMIT)  &&
+               dsa_sort_insertion(s, pivot + item_size, end, FALSE, DSA_SORT_PARTIAL_INSERTION_LIMIT))
+                return;
+        }
+
+        /* Recurse into the smaller part and iterate over the bigger one, so
+         * the recursion depth is at most log2(n). */
+        if(l_size < r_size) {
+            dsa_sort_loop(s, begin, pivot, bad_allowed, leftmost);
+            begin = pivot + item_size;
+            leftmost = FALSE;
+        } else {
+            dsa_sort_loop(s, pivot + item_size, end, bad_allowed, FALSE);
+            end = pivot;
+        }
+    }
+}
+
+static void
+dsa_sorter_init(dsa_sorter_t* s, dsa_t* dsa, dsa_cmp_t cmp_func, BYTE* tmp_buf)
+{
+    s->dsa = dsa;
+    s->cmp_func = cmp_func;
+    s->item_size = dsa->item_size;
+    if(dsa->item_size <= DSA_SORT_TMP_SIZE) {
+        s->tmp = tmp_buf;
+    } else {
+        /* Without the buffer we only get slower, so do not report error. */
+        s->tmp = (BYTE*) malloc(dsa->item_size);
+    }
+}
+
+static void
+dsa_sorter_fini(dsa_sorter_t* s, BYTE* tmp_buf)
+{
+    if(s->tmp != NULL  &&  s->tmp != tmp_buf)
+        free(s->tmp);
+}
 
 void
 dsa_sort(dsa_t* dsa, dsa_cmp_t cmp_func)
 {
-    register BYTE* base_ptr = (BYTE*) dsa->buffer;
-    const WORD size = dsa->size;
-    const WORD item_size = dsa->item_size;
-    const WORD max_thresh = MAX_THRESH * item_size;
+    dsa_sorter_t s;
+    BYTE tmp_buf[DSA_SORT_TMP_SIZE];
+    BYTE* begin = (BYTE*) dsa->buffer;
+    BYTE* end = begin + (size_t)dsa->size * dsa->item_size;
+    int bad_allowed = 1;
+    DWORD n;
 
     DSA_TRACE("dsa_sort(%p, %p)", dsa, cmp_func);
 
-    if (size == 0)
+    if(dsa->size < 2)
         return;
 
-    if (size > MAX_THRESH) {
-        BYTE* lo = base_ptr;
-        BYTE* hi = &lo[item_size * (size - 1)];
-        stack_node stack[STACK_SIZE];
-        stack_node *top = stack;
-
-        PUSH (NULL, NULL);
-
-        while (STACK_NOT_EMPTY) {
-            BYTE* left_ptr;
-            BYTE* right_ptr;
-
-            /* Select median value from among LO, MID, and HI. Rearrange
-               LO and HI so the three values are sorted. This lowers the
-               probability of picking a pathological pivot value and
-               skips a comparison for both the LEFT_PTR and RIGHT_PTR in
-               the while loops. */
-
-            BYTE* mid = lo + item_size * ((hi - lo) / item_size >> 1);
-
-            if(cmp_func(dsa, (void*)mid, (void*)lo) < 0)
-                mc_inlined_memswap(mid, lo, item_size);
-            if(cmp_func(dsa, (void*)hi, (void*)mid) < 0)
-                mc_inlined_memswap(mid, hi, item_size);
-            else
-                goto jump_over;
-            if (cmp_func(dsa, (void*)mid, (void*)lo) < 0)
-                mc_inlined_memswap(mid, lo, item_size);
-jump_over:
-            left_ptr  = lo + item_size;
-            right_ptr = hi - item_size;
-
-            /* Here's the famous ``collapse the walls'' section of quicksort.
-               Gotta like those tight inner loops!  They are the main reason
-               that this algorithm runs much faster than others. */
-            do {
-                while(cmp_func(dsa, (void*)left_ptr, (void*)mid) < 0)
-                    left_ptr += item_size;
-                while(cmp_func(dsa, (void*)mid, (void*)right_ptr) < 0)
-                    right_ptr -= item_size;
-
-                if(left_ptr < right_ptr) {
-                    mc_inlined_memswap(left_ptr, right_ptr, item_size);
-                    if(mid == left_ptr)
-                        mid = right_ptr;
-                    else if(mid == right_ptr)
-                        mid = left_ptr;
-                    left_ptr += item_size;
-                    right_ptr -= item_size;
-                } else if(left_ptr == right_ptr) {
-                    left_ptr += item_size;
-                    right_ptr -= item_size;
-                    break;
-                }
-            } while(left_ptr <= right_ptr);
-
-            /* Set up pointers for next iteration.  First determine whether
-               left and right partitions are below the threshold size.  If so,
-               ignore one or both.  Otherwise, push the larger partition's
-               bounds on the stack and continue sorting the smaller one. */
-
-            if ((WORD)(right_ptr - lo) <= max_thresh) {
-                if((WORD)(hi - left_ptr) <= max_thresh)
-                    POP(lo, hi);   /* Ignore both small partitions. */
-                else
-                    lo = left_ptr; /* Ignore small left partition. */
-            } else if((WORD)(hi - left_ptr) <= max_thresh) {
-                hi = right_ptr;    /* Ignore small right partition. */
-            } else if((right_ptr - lo) > (hi - left_ptr)) {
-                /* Push larger left partition indices. */
-                PUSH(lo, right_ptr);
-                lo = left_ptr;
-            } else {
-                /* Push larger right partition indices. */
-                PUSH(left_ptr, hi);
-                hi = right_ptr;
-            }
+    /* Allow log2(n) bad partitions before falling back to heapsort. */
+    for(n = dsa->size; n > 1; n >>= 1)
+        bad_allowed++;
+
+    dsa_sorter_init(&s, dsa, cmp_func, tmp_buf);
+    dsa_sort_loop(&s, begin, end, bad_allowed, TRUE);
+    dsa_sorter_fini(&s, tmp_buf);
+}
+
+/* Merges sorted runs [src, mid) and [mid, end) into dst. On equal items,
+ * the one from the left run goes first. */
+static void
+dsa_sort_merge(dsa_sorter_t* s, BYTE* src, BYTE* mid, BYTE* end, BYTE* dst)
+{
+    const size_t item_size = s->item_size;
+    BYTE* left = src;
+    BYTE* right = mid;
+
+    while(left < mid  &&  right < end) {
+        if(DSA_LESS(s, right, left)) {
+            memcpy(dst, right, item_size);
+            right += item_size;
+        } else {
+            memcpy(dst, left, item_size);
+            left += item_size;
         }
+        dst += item_size;
     }
 
-    /* Once the BASE_PTR array is partially sorted by quicksort the rest
-       is completely sorted using insertion sort, since this is efficient
-       for partitions below MAX_THRESH size. BASE_PTR points to the beginning
-       of the array to sort, and END_PTR points at the very last element in
-       the array (*not* one beyond it!). */
+    if(left < mid)
+        memcpy(dst, left, mid - left);
+    else if(right < end)
+        memcpy(dst, right, end - right);
+}
+
+void
+dsa_sort_stable(dsa_t* dsa, dsa_cmp_t cmp_func)
+{
+    dsa_sorter_t s;
+    BYTE tmp_buf[DSA_SORT_TMP_SIZE];
+    size_t total = (size_t)dsa->size * dsa->item_size;
+    size_t run = DSA_SORT_INSERTION_THRESHOLD / 2 * dsa->item_size;
+    BYTE* src = (BYTE*) dsa->buffer;
+    BYTE* dst;
+    BYTE* swap;
+    BYTE* buffer;
+    size_t off;
 
-    {
-        BYTE* const end_ptr = &base_ptr[item_size * (size - 1)];
-        BYTE* tmp_ptr = base_ptr;
-        BYTE* thresh = MC_MIN(end_ptr, base_ptr + max_thresh);
-        register BYTE* run_ptr;
+    DSA_TRACE("dsa_sort_stable(%p, %p)", dsa, cmp_func);
 
-        /* Find smallest element in first threshold and place it at the
-           array's beginning.  This is the smallest array element,
-           and the operation speeds up insertion sort's inner loop. */
+    if(dsa->size < 2)
+        return;
 
-        for(run_ptr = tmp_ptr + item_size; run_ptr <= thresh; run_ptr += item_size) {
-            if (cmp_func(dsa, (void*)run_ptr, (void*)tmp_ptr) < 0)
-                tmp_ptr = run_ptr;
-        }
+    dsa_sorter_init(&s, dsa, cmp_func, tmp_buf);
 
-        if(tmp_ptr != base_ptr)
-            mc_inlined_memswap(tmp_ptr, base_ptr, item_size);
+    buffer = (BYTE*) malloc(total);
+    if(MC_ERR(buffer == NULL)) {
+        /* Insertion sort is stable too; just slow for big arrays. */
+        MC_TRACE("dsa_sort_stable: malloc() failed. Using insertion sort.");
+        dsa_sort_insertion(&s, src, src + total, TRUE, 0);
+        dsa_sorter_fini(&s, tmp_buf);
+        return;
+    }
 
-        /* Insertion sort, running from left-hand-side up to right-hand-side.  */
+    /* Sort short runs in place, then merge them, alternating the direction
+     * between the array and the temporary buffer. */
+    for(off = 0; off < total; off += run)
+        dsa_sort_insertion(&s, src + off, src + MC_MIN(off + run, total), TRUE, 0);
+
+    dst = buffer;
+    for(; run < total; run *= 2) {
+        for(off = 0; off < total; off += 2 * run) {
+            size_t mid = MC_MIN(off + run, total);
+            size_t end = MC_MIN(off + 2 * run, total);
+            dsa_sort_merge(&s, src + off, src + mid, src + end, dst + off);
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
 
-        run_ptr = base_ptr + item_size;
-        while((run_ptr += item_size) <= end_ptr) {
-            tmp_ptr = run_ptr - item_size;
-            while(cmp_func(dsa, (void*)run_ptr, (void*)tmp_ptr) < 0)
-                tmp_ptr -= item_size;
+    if(src == buffer)
+        memcpy(dsa->buffer, buffer, total);
+    free(buffer);
+    dsa_sorter_fini(&s, tmp_buf);
+}
 
-            tmp_ptr += item_size;
-            if(tmp_ptr != run_ptr) {
-                BYTE* trav;
+/* Returns the first index in [lo, hi) whose item is greater then the given
+ * one, or hi if there is none. Searching for the upper bound places new
+ * items behind the equal ones. */
+static DWORD
+dsa_upper_bound(dsa_t* dsa, const void* item, DWORD lo, DWORD hi,
+                dsa_cmp_t cmp_func)
+{
+    DWORD mid;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(cmp_func(dsa, item, dsa_item(dsa, mid)) < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
 
-                trav = run_ptr + item_size;
-                while(--trav >= run_ptr) {
-                    BYTE c = *trav;
-                    BYTE* hi;
-                    BYTE* lo;
+    return lo;
+}
 
-                    for(hi = lo = trav; (lo -= item_size) >= tmp_ptr; hi = lo)
-                        *hi = *lo;
-                    *hi = c;
-                }
-            }
+/* Same as dsa_upper_bound(dsa, item, 0, hi, cmp_func) but it probes from hi
+ * with exponentially growing steps first. It is much cheaper when the result
+ * is close to hi, as it is usual when merging sorted sequences. */
+static DWORD
+dsa_upper_bound_from_end(dsa_t* dsa, const void* item, DWORD hi,
+                         dsa_cmp_t cmp_func)
+{
+    DWORD lo = 0;
+    DWORD step = 1;
+    DWORD probe;
+
+    while(hi > 0) {
+        probe = (hi > step ? hi - step : 0);
+        if(cmp_func(dsa, item, dsa_item(dsa, probe)) < 0) {
+            hi = probe;
+            step *= 2;
+        } else {
+            lo = probe + 1;
+            break;
         }
     }
+
+    return dsa_upper_bound(dsa, item, lo, hi, cmp_func);
 }
 
 int
 dsa_insert_sorted(dsa_t* dsa, void* item, dsa_cmp_t cmp_func)
 {
-    WORD index0, index1;
-    WORD index;
-    int cmp;
+    DWORD index;
 
     DSA_TRACE("dsa_insert_sorted(%p, %p, %p)", dsa, item, cmp_func);
 
     /* App. developers may try to optimize and insert multiple items in the
      * correct order whenever possible. If they do, we can skip the bsearch. */
-    if(dsa->size == 0 || cmp_func(dsa, item, dsa_item(dsa, dsa->size-1)) >= 0) {
+    if(dsa->size == 0 || cmp_func(dsa, item, dsa_item(dsa, dsa->size-1)) >= 0)
         index = dsa->size;
-        goto found_index;
-    }
-
-    /* Binary search */
-    index0 = 0;
-    index1 = dsa->size - 1;
-    while(index0 < index1) {
-        index = (index0 + index1) / 2;
-        cmp = cmp_func(dsa, item, dsa_item(dsa, index));
-        if(cmp < 0)
-            index1 = index;
-        else if(cmp > 0)
-            index0 = index + 1;
-        else
-            goto found_index;
+    else
+        index = dsa_upper_bound(dsa, item, 0, dsa->size - 1, cmp_func);
+
+    return dsa_insert(dsa, index, item);
+}
+
+int
+dsa_insert_bulk(dsa_t* dsa, DWORD index, const void* items, DWORD n)
+{
+    DSA_TRACE("dsa_insert_bulk(%p, %lu, %p, %lu)", dsa, (ULONG)index, items, (ULONG)n);
+    MC_ASSERT(index <= dsa->size);
+
+    if(MC_ERR(dsa_reserve(dsa, n) != 0)) {
+        MC_TRACE("dsa_insert_bulk: dsa_reserve() failed.");
+        return -1;
     }
 
-    MC_ASSERT(index0 == index1);
-    index = index1;
+    if(n == 0)
+        return 0;
 
-found_index:
-    return dsa_insert(dsa, index, item);
+    if(index < dsa->size) {
+        memmove(dsa_item(dsa, index + n), dsa_item(dsa, index),
+                (size_t)(dsa->size - index) * dsa->item_size);
+    }
+    memcpy(dsa_item(dsa, index), items, (size_t)n * dsa->item_size);
+    dsa->size += n;
+    return 0;
 }
 
 int
-dsa_move_sorted(dsa_t* dsa, WORD index, dsa_cmp_t cmp_func)
+dsa_insert_sorted_bulk(dsa_t* dsa, const void* items, DWORD n,
+                       dsa_cmp_t cmp_func)
 {
-    WORD index0, index1;
-    WORD old_index = index;
+    const size_t item_size = dsa->item_size;
+    dsa_t batch;
+    DWORD old_end;   /* old items [0, old_end) not merged yet */
+    DWORD dst;       /* first already merged slot */
+    DWORD pos;
+    DWORD i;
+
+    DSA_TRACE("dsa_insert_sorted_bulk(%p, %p, %lu, %p)", dsa, items, (ULONG)n, cmp_func);
+
+    if(n == 0)
+        return 0;
+
+    if(MC_ERR(dsa_reserve(dsa, n) != 0)) {
+        MC_TRACE("dsa_insert_sorted_bulk: dsa_reserve() failed.");
+        return -1;
+    }
+
+    /* Sort copy of the new items. */
+    dsa_init(&batch, item_size);
+    if(MC_ERR(dsa_insert_bulk(&batch, 0, items, n) != 0)) {
+        MC_TRACE("dsa_insert_sorted_bulk: dsa_insert_bulk() failed.");
+        return -1;
+    }
+    dsa_sort_stable(&batch, cmp_func);
+
+    /* Merge it with the old items from the end, so each old item is moved
+     * at most once, and in runs with single memmove(). */
+    old_end = dsa->size;
+    dst = dsa->size + n;
+    for(i = n; i > 0; i--) {
+        const void* item = dsa_item(&batch, i - 1);
+
+        pos = dsa_upper_bound_from_end(dsa, item, old_end, cmp_func);
+        if(pos < old_end) {
+            dst -= old_end - pos;
+            memmove(dsa_item(dsa, dst), dsa_item(dsa, pos),
+                    (size_t)(old_end - pos) * item_size);
+            old_end = pos;
+        }
+
+        dst--;
+        memcpy(dsa_item(dsa, dst), item, item_size);
+    }
+
+    MC_ASSERT(dst == old_end);
+    dsa->size += n;
+    dsa_fini(&batch, NULL);
+    return 0;
+}
+
+int
+dsa_move_sorted(dsa_t* dsa, DWORD index, dsa_cmp_t cmp_func)
+{
+    DWORD old_index = index;
 #ifdef __GNUC__
     BYTE tmp[dsa->item_size];
 #else
@@ -391,61 +798,66 @@ dsa_move_sorted(dsa_t* dsa, WORD index, dsa_cmp_t cmp_func)
     MC_ASSERT(dsa->item_size <= sizeof(tmp));
 #endif
 
-    DSA_TRACE("dsa_move_sorted(%p, %d, %p)", dsa, (int)index, cmp_func);
+    DSA_TRACE("dsa_move_sorted(%p, %lu, %p)", dsa, (ULONG)index, cmp_func);
     MC_ASSERT(index < dsa->size);
 
     if(index < dsa->size-1  &&  cmp_func(dsa, dsa_item(dsa, index+1), dsa_item(dsa, index)) < 0) {
-        /* We have to move the item to right */
-        index0 = index + 1;
-        index1 = dsa->size;
+        /* We have to move the item to right, behind the last item which is
+         * not greater. */
+        index = dsa_upper_bound(dsa, dsa_item(dsa, old_index),
+                                old_index + 1, dsa->size, cmp_func) - 1;
     } else if(index > 0  &&  cmp_func(dsa, dsa_item(dsa, index), dsa_item(dsa, index-1)) < 0) {
-        /* We have to move the item to left */
-        index0 = 0;
-        index1 = index;
+        /* We have to move the item to left, before the first greater item. */
+        index = dsa_upper_bound(dsa, dsa_item(dsa, old_index),
+                                0, old_index, cmp_func);
     } else {
-        return index;
-    }
-
-    /* Binary search */
-    while(index0 < index1) {
-        int cmp;
-
-        index = (index0 + index1) / 2;
-        cmp = cmp_func(dsa, dsa_item(dsa, index), dsa_item(dsa, old_index));
-        if(cmp < 0)
-            index1 = index;
-        else if(cmp > 0)
-            index0 = index + 1;
-        else
-            goto found_index;
+        return (int) index;
     }
 
-    MC_ASSERT(index0 == index1);
-    index = index1;
-
-found_index:
-    if(index == old_index)
-        return index;
-
-    /* Do the move */
+    /* Do the move: shift the items in between by one slot with single
+     * memmove(). */
     mc_inlined_memcpy(tmp, dsa_item(dsa, old_index), dsa->item_size);
     if(index < old_index) {
         memmove(dsa_item(dsa, index+1), dsa_item(dsa, index),
-                (old_index - index) * dsa->item_size);
+                (size_t)(old_index - index) * dsa->item_size);
     } else {
         memmove(dsa_item(dsa, old_index), dsa_item(dsa, old_index+1),
-                (index - old_index) * dsa->item_size);
+                (size_t)(index - old_index) * dsa->item_size);
     }
     mc_inlined_memcpy(dsa_item(dsa, index), tmp, dsa->item_size);
-    return index;
+    return (int) index;
+}
+
+int
+dsa_find_sorted(dsa_t* dsa, const void* item, dsa_cmp_t cmp_func)
+{
+    DWORD lo = 0;
+    DWORD hi = dsa->size;
+    DWORD mid;
+
+    DSA_TRACE("dsa_find_sorted(%p, %p, %p)", dsa, item, cmp_func);
+
+    /* Lower bound, i.e. the first item not less then the given one. */
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(cmp_func(dsa, dsa_item(dsa, mid), item) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if(lo < dsa->size  &&  cmp_func(dsa, item, dsa_item(dsa, lo)) == 0)
+        return (int) lo;
+    return -1;
 }
 
 int
-dsa_insert_smart(dsa_t* dsa, WORD index, void* item, dsa_cmp_t cmp_func)
+dsa_insert_smart(dsa_t* dsa, DWORD index, void* item, dsa_cmp_t cmp_func)
 {
     BOOL need_sorted_insert = FALSE;
+    int ret;
 
-    DSA_TRACE("dsa_insert_smart(%p, %d, %p, %p)", dsa, (int)index, item, cmp_func);
+    DSA_TRACE("dsa_insert_smart(%p, %lu, %p, %p)", dsa, (ULONG)index, item, cmp_func);
     MC_ASSERT(index <= dsa->size);
 
     /* Check if [index] is OK with the respect to the order. */
@@ -458,15 +870,15 @@ dsa_insert_smart(dsa_t* dsa, WORD index, void* item, dsa_cmp_t cmp_func)
 
     /* Do the insert */
     if(need_sorted_insert) {
-        index = dsa_insert_sorted(dsa, item, cmp_func);
-        if(MC_ERR(index < 0))
+        ret = dsa_insert_sorted(dsa, item, cmp_func);
+        if(MC_ERR(ret < 0))
             MC_TRACE("dsa_insert_smart: dsa_insert_sorted() failed.");
     } else {
-        index = dsa_insert(dsa, index, item);
-        if(MC_ERR(index < 0))
+        ret = dsa_insert(dsa, index, item);
+        if(MC_ERR(ret < 0))
             MC_TRACE("dsa_insert_smart: dsa_insert() failed.");
     }
 
-    return index;
+    return ret;
 }
 
@@ -21,15 +21,21 @@
 
 #include "misc.h"
 
+#include <limits.h>
+
 
 typedef struct dsa_tag dsa_t;
 struct dsa_tag {
     void* buffer;
-    WORD item_size;
-    WORD size;
-    WORD capacity;
+    size_t item_size;
+    DWORD size;
+    DWORD capacity;
 };
 
+/* Max. count of items. Indexes are returned as int by some functions below
+ * (with -1 meaning failure), so they must never exceed INT_MAX. */
+#define DSA_MAX_SIZE     ((DWORD) INT_MAX)
+
 /* destructor */
 typedef void (*dsa_dtor_t)(dsa_t* dsa, void* item);
 
@@ -37,49 +43,63 @@ typedef void (*dsa_dtor_t)(dsa_t* dsa, void* item);
 typedef int (*dsa_cmp_t)(dsa_t*, const void*, const void*);
 
 
-static inline WORD
+static inline DWORD
 dsa_size(dsa_t* dsa)
 {
     return dsa->size;
 }
 
-static inline WORD
+static inline DWORD
 dsa_index(dsa_t* dsa, const void* item)
 {
-    return (int) (((BYTE*)item - (BYTE*)dsa->buffer) / dsa->item_size);
+    return (DWORD) (((BYTE*)item - (BYTE*)dsa->buffer) / dsa->item_size);
 }
 
 static inline void*
-dsa_item(dsa_t* dsa, WORD index)
+dsa_item(dsa_t* dsa, DWORD index)
 {
-    return (void*)&((BYTE*)dsa->buffer)[index * dsa->item_size];
+    return (void*)&((BYTE*)dsa->buffer)[(size_t)index * dsa->item_size];
 }
 
 /* This is harder to use, but it should lead to better optimization
  * (asssuming item_size is compile-time known constant). */
 static inline void*
-dsa_item_(dsa_t* dsa, WORD index, WORD item_size)
+dsa_item_(dsa_t* dsa, DWORD index, size_t item_size)
 {
     MC_ASSERT(item_size == dsa->item_size);
-    return (void*)&((BYTE*)dsa->buffer)[index * item_size];
+    return (void*)&((BYTE*)dsa->buffer)[(size_t)index * item_size];
 }
 
 
-void dsa_init(dsa_t* dsa, WORD item_size);
+void dsa_init(dsa_t* dsa, size_t item_size);
 void dsa_fini(dsa_t* dsa, dsa_dtor_t dtor_func);
 
-int dsa_reserve(dsa_t* dsa, WORD size);
+int dsa_reserve(dsa_t* dsa, DWORD size);
 
-void* dsa_insert_raw(dsa_t* dsa, WORD index);
-int dsa_insert(dsa_t* dsa, WORD index, void* item);
-void dsa_remove(dsa_t* dsa, WORD index, dsa_dtor_t dtor_func);
+void* dsa_insert_raw(dsa_t* dsa, DWORD index);
+int dsa_insert(dsa_t* dsa, DWORD index, void* item);
+void dsa_remove(dsa_t* dsa, DWORD index, dsa_dtor_t dtor_func);
 void dsa_clear(dsa_t* dsa, dsa_dtor_t dtor_func);
 
 void dsa_sort(dsa_t* dsa, dsa_cmp_t cmp_func);
+void dsa_sort_stable(dsa_t* dsa, dsa_cmp_t cmp_func);
 int dsa_insert_sorted(dsa_t* dsa, void* item, dsa_cmp_t cmp_func);
-int dsa_move_sorted(dsa_t* dsa, WORD index, dsa_cmp_t cmp_func);
-
-int dsa_insert_smart(dsa_t* dsa, WORD index, void* item, dsa_cmp_t cmp_func);
+int dsa_move_sorted(dsa_t* dsa, DWORD index, dsa_cmp_t cmp_func);
+
+/* Returns index of the first item equal to the given one in the sorted dsa,
+ * or -1 if there is none. */
+int dsa_find_sorted(dsa_t* dsa, const void* item, dsa_cmp_t cmp_func);
+
+/* Bulk inserts of n items (copied from the array items). Both return 0 on
+ * success, -1 on failure (then the dsa is left intact).
+ * dsa_insert_bulk() puts them at index, in the given order.
+ * dsa_insert_sorted_bulk() sorts them (note cmp_func then gets a temporary
+ * dsa_t) and merges them into the sorted dsa in one pass, which is much
+ * cheaper then inserting them one by one. */
+int dsa_insert_bulk(dsa_t* dsa, DWORD index, const void* items, DWORD n);
+int dsa_insert_sorted_bulk(dsa_t* dsa, const void* items, DWORD n, dsa_cmp_t cmp_func);
+
+int dsa_insert_smart(dsa_t* dsa, DWORD index, void* item, dsa_cmp_t cmp_func);
 
 
 #endif  /* MC_DSA_H */
@@ -19,6 +19,7 @@
 #include "grid.h"
 #include "theme.h"
 #include "table.h"
+#include "textcache.h"
 
 
 /* Uncomment this to have more verbose traces about MC_GRID control. */
@@ -35,6 +36,11 @@
 #define PADDING_V                    2
 #define DEFAULT_GRIDLINE_COLOR   RGB(220,220,220)
 
+#define GRID_REFRESH_TIMER_ID        1
+
+/* Max. count of distinct regions remembered for a rate-limited refresh. */
+#define GRID_MAX_REFRESH_REGIONS     4
+
 
 #define MC_GS_COLUMNHEADERMASK                                             \
             (MC_GS_COLUMNHEADERNONE | MC_GS_COLUMNHEADERNUMBERED |         \
@@ -48,31 +54,353 @@
 static const TCHAR grid_wc[] = MC_WC_GRID;    /* window class name */
 
 
+/****************************
+ *** Column and row sizes ***
+ ****************************/
+
+/* Sizes of grid columns (or rows), indexed as in the table. As long as all
+ * of them have the default size, nothing is allocated, and offsets are just
+ * multiples of the default size. When some size is set explicitly, the sizes
+ * are stored in an array, and their prefix sums in a Fenwick tree. Then
+ * getting offset of an item, finding an item at an offset, and changing
+ * a size are all O(log n). Items added or removed at the end are O(log n)
+ * too (amortized), only a change in the middle rebuilds the tree in O(n). */
+
+#define GRID_SIZE_DEFAULT     0xffff   /* item has the default size */
+#define GRID_SIZES_MIN_GROW   64
+
+typedef struct grid_sizes_tag grid_sizes_t;
+struct grid_sizes_tag {
+    WORD* sizes;          /* NULL if all items have the default size */
+    UINT64* tree;         /* Fenwick tree, 1-based (tree[0] is unused) */
+    DWORD count;
+    DWORD capacity;       /* allocated items in sizes (and tree, minus one) */
+    DWORD top_bit;        /* highest power of 2 <= count */
+    WORD default_size;
+};
+
+static void
+grid_sizes_init(grid_sizes_t* s, WORD default_size)
+{
+    s->sizes = NULL;
+    s->tree = NULL;
+    s->count = 0;
+    s->capacity = 0;
+    s->top_bit = 0;
+    s->default_size = default_size;
+}
+
+static void
+grid_sizes_fini(grid_sizes_t* s)
+{
+    free(s->sizes);
+    free(s->tree);
+    s->sizes = NULL;
+    s->tree = NULL;
+    s->capacity = 0;
+}
+
+static inline WORD
+grid_sizes_get(const grid_sizes_t* s, DWORD i)
+{
+    if(s->sizes == NULL  ||  i >= s->count  ||  s->sizes[i] == GRID_SIZE_DEFAULT)
+        return s->default_size;
+    return s->sizes[i];
+}
+
+static void
+grid_sizes_update_top_bit(grid_sizes_t* s)
+{
+    s->top_bit = 1;
+    while(s->top_bit <= s->count / 2)
+        s->top_bit <<= 1;
+}
+
+/* (Re)computes the Fenwick tree from the sizes in O(n). */
+static void
+grid_sizes_build(grid_sizes_t* s)
+{
+    DWORD i, j;
+
+    grid_sizes_update_top_bit(s);
+
+    for(i = 1; i <= s->count; i++)
+        s->tree[i] = grid_sizes_get(s, i-1);
+    for(i = 1; i <= s->count; i++) {
+        j = i + (i & (~i + 1));
+        if(j <= s->count)
+            s->tree[j] += s->tree[i];
+    }
+}
+
+/* Computes the tree node of the i-th item in O(log n), assuming the nodes
+ * of all the preceding items are already valid. (The node covers the item
+ * and the ranges of the nodes right before it.) */
+static void
+grid_sizes_build_node(grid_sizes_t* s, DWORD i)
+{
+    DWORD j = i + 1;
+    DWORD low_bit = (j & (~j + 1));
+    DWORD k;
+
+    s->tree[j] = grid_sizes_get(s, i);
+    for(k = 1; k < low_bit; k <<= 1)
+        s->tree[j] += s->tree[j - k];
+}
+
+/* Offset of the i-th item, i.e. sum of sizes of all items before it. */
+static UINT64
+grid_sizes_offset(const grid_sizes_t* s, DWORD i)
+{
+    UINT64 offset = 0;
+    DWORD j;
+
+    if(s->sizes == NULL)
+        return (UINT64)i * s->default_size;
+
+    if(i > s->count) {
+        offset = (UINT64)(i - s->count) * s->default_size;
+        i = s->count;
+    }
+    for(j = i; j > 0; j &= j - 1)
+        offset += s->tree[j];
+    return offset;
+}
+
+/* Index of the item at the offset. (It may be >= count if the offset is
+ * beyond all the items.) */
+static DWORD
+grid_sizes_index(const grid_sizes_t* s, UINT64 offset)
+{
+    DWORD i = 0;
+    DWORD bit;
+
+    if(s->sizes == NULL) {
+        if(s->default_size == 0)
+            return s->count;
+        return (DWORD) MC_MIN(offset / s->default_size, (UINT64)0xffffffff);
+    }
+
+    /* Find the greatest i such that offset of the i-th item is <= offset. */
+    for(bit = s->top_bit; bit > 0; bit >>= 1) {
+        if(i + bit <= s->count  &&  s->tree[i + bit] <= offset) {
+            i += bit;
+            offset -= s->tree[i];
+        }
+    }
+
+    if(i == s->count  &&  s->default_size > 0)
+        i += (DWORD) MC_MIN(offset / s->default_size, (UINT64)(0xffffffff - i));
+    return i;
+}
+
+/* Makes room for at least count items. The capacity grows geometrically
+ * (like dsa_t), so adding items one by one is amortized O(1). On failure,
+ * it falls back to the default size for everything. */
+static int
+grid_sizes_reserve(grid_sizes_t* s, DWORD count)
+{
+    WORD* sizes;
+    UINT64* tree;
+    DWORD max_capacity;
+    DWORD capacity;
+
+    if(count <= s->capacity)
+        return 0;
+
+    /* The tree needs one more slot, and its size must not wrap around. */
+    max_capacity = (DWORD) MC_MIN(((size_t)-1) / sizeof(UINT64) - 1, (size_t)0xfffffffe);
+    if(MC_ERR(count > max_capacity)) {
+        MC_TRACE("grid_sizes_reserve: Count %lu too large.", (ULONG)count);
+        grid_sizes_fini(s);
+        return -1;
+    }
+
+    capacity = s->capacity + MC_MAX(s->capacity / 2, GRID_SIZES_MIN_GROW);
+    if(capacity < s->capacity  ||  capacity > max_capacity)
+        capacity = max_capacity;
+    if(capacity < count)
+        capacity = count;
+
+    sizes = (WORD*) realloc(s->sizes, (size_t)capacity * sizeof(WORD));
+    if(sizes != NULL)
+        s->sizes = sizes;
+    tree = (UINT64*) realloc(s->tree, ((size_t)capacity + 1) * sizeof(UINT64));
+    if(tree != NULL)
+        s->tree = tree;
+    if(MC_ERR(sizes == NULL  ||  tree == NULL)) {
+        MC_TRACE("grid_sizes_reserve: realloc() failed.");
+        grid_sizes_fini(s);
+        return -1;
+    }
+
+    s->capacity = capacity;
+    return 0;
+}
+
+/* Sets count of items. Sizes of the preserved items are kept, the new ones
+ * have the default size. The tree is only extended or cut at the end. */
+static int
+grid_sizes_resize(grid_sizes_t* s, DWORD count)
+{
+    DWORD i;
+
+    if(s->sizes == NULL  ||  count == s->count) {
+        s->count = count;
+        return 0;
+    }
+
+    if(count > s->count) {
+        if(MC_ERR(grid_sizes_reserve(s, count) != 0)) {
+            s->count = count;
+            return -1;
+        }
+
+        for(i = s->count; i < count; i++)
+            s->sizes[i] = GRID_SIZE_DEFAULT;
+        i = s->count;
+        s->count = count;
+        for(; i < count; i++)
+            grid_sizes_build_node(s, i);
+    } else {
+        /* Nodes of the remaining items do not cover the removed ones. */
+        s->count = count;
+    }
+
+    grid_sizes_update_top_bit(s);
+    return 0;
+}
+
+/* Inserts n items with the default size before the i-th item. */
+static int
+grid_sizes_insert(grid_sizes_t* s, DWORD i, DWORD n)
+{
+    DWORD j;
+
+    MC_ASSERT(i <= s->count);
+
+    if(s->sizes == NULL  ||  i == s->count)
+        return grid_sizes_resize(s, s->count + n);
+
+    if(MC_ERR(grid_sizes_reserve(s, s->count + n) != 0)) {
+        s->count += n;
+        return -1;
+    }
+
+    memmove(s->sizes + i + n, s->sizes + i, (s->count - i) * sizeof(WORD));
+    for(j = i; j < i + n; j++)
+        s->sizes[j] = GRID_SIZE_DEFAULT;
+    s->count += n;
+    grid_sizes_build(s);
+    return 0;
+}
+
+/* Removes n items starting with the i-th one. */
+static int
+grid_sizes_remove(grid_sizes_t* s, DWORD i, DWORD n)
+{
+    MC_ASSERT(i <= s->count  &&  n <= s->count - i);
+
+    if(s->sizes == NULL  ||  i + n == s->count)
+        return grid_sizes_resize(s, i);
+
+    memmove(s->sizes + i, s->sizes + i + n, (s->count - n - i) * sizeof(WORD));
+    s->count -= n;
+    grid_sizes_build(s);
+    return 0;
+}
+
+/* Sets size of the i-th item (GRID_SIZE_DEFAULT to reset it) in O(log n).
+ * Only the first explicit size needs to allocate and build the tree. */
+static int
+grid_sizes_set(grid_sizes_t* s, DWORD i, WORD size)
+{
+    WORD old_size;
+    DWORD j;
+
+    MC_ASSERT(i < s->count);
+
+    if(s->sizes == NULL) {
+        if(size == GRID_SIZE_DEFAULT)
+            return 0;
+
+        if(MC_ERR(grid_sizes_reserve(s, s->count) != 0)) {
+            MC_TRACE("grid_sizes_set: grid_sizes_reserve() failed.");
+            return -1;
+        }
+        for(j = 0; j < s->count; j++)
+            s->sizes[j] = GRID_SIZE_DEFAULT;
+        grid_sizes_build(s);
+    }
+
+    old_size = grid_sizes_get(s, i);
+    s->sizes[i] = size;
+    size = grid_sizes_get(s, i);
+
+    /* Propagate the difference (modulo 2^64) into the tree. */
+    for(j = i + 1; j <= s->count; j += (j & (~j + 1)))
+        s->tree[j] += (UINT64)size - (UINT64)old_size;
+    return 0;
+}
+
+static void
+grid_sizes_set_default(grid_sizes_t* s, WORD default_size)
+{
+    if(default_size == s->default_size)
+        return;
+
+    s->default_size = default_size;
+    if(s->sizes != NULL)
+        grid_sizes_build(s);
+}
+
+
 typedef struct grid_tag grid_t;
 struct grid_tag {
     HWND win;
     HTHEME theme;
     HFONT font;
     table_t* table;
+    int table_view;       /* handle from table_install_view() */
+    table_interest_t interest;  /* cells currently visible */
     UINT style            : 30;
     UINT no_redraw        : 1;
     WORD header_width;
     WORD header_height;
-    WORD cell_width;
-    WORD cell_height;
+    grid_sizes_t col_sizes;   /* default is the width of regular cells */
+    grid_sizes_t row_sizes;   /* ditto for height */
     WORD cell_padding_horz;
     WORD cell_padding_vert;
     int scroll_x;
     int scroll_y;
+    DWORD frozen_cols;    /* count of leading columns which do not scroll */
+    DWORD frozen_rows;    /* ditto for rows */
+    DWORD sb_col_count;   /* table size the scrollbars are set up for */
+    DWORD sb_row_count;
     COLORREF gridline_color;
+    HPEN gridline_pen;
+    HDC buffer_dc;        /* back buffer (kept for subsequent paints) */
+    HBITMAP buffer_bmp;
+    HBITMAP buffer_old_bmp;
+    HRGN buffer_dirty;    /* part of the back buffer which is out of date */
+    int buffer_width;
+    int buffer_height;
+    view_sched_t refresh_sched;
+    BOOL refresh_all;     /* pending refresh (if rate limited) */
+    UINT refresh_count;
+    table_region_t refresh_regions[GRID_MAX_REFRESH_REGIONS];
+#ifdef GRID_DEBUG
+    DWORD fps_tick;
+    UINT fps_frames;
+#endif
 };
 
 static TCHAR*
-grid_num_to_alpha(TCHAR buffer[16], WORD num)
+grid_num_to_alpha(TCHAR buffer[16], DWORD num)
 {
     static const int digit_count = _T('Z') - _T('A');
     TCHAR* ptr;
-    WORD digit;
+    DWORD digit;
 
     num++;
     buffer[15] = _T('\0');
@@ -98,17 +426,23 @@ typedef struct grid_layout_tag grid_layout_t;
 struct grid_layout_tag {
     WORD display_header_height; /* real columns headers height */
     WORD display_header_width;  /* ditto for rows */
-    WORD display_col0;          /* index of first column for grid contents (not headers) */
-    WORD display_row0;          /* ditto for rows */
-    WORD display_col_count;     /* count of columns for grid contents (not headers) */
-    WORD display_row_count;     /* ditto for rows */
+    DWORD display_col0;         /* index of first column for grid contents (not headers) */
+    DWORD display_row0;         /* ditto for rows */
+    DWORD display_col_count;    /* count of columns for grid contents (not headers) */
+    DWORD display_row_count;    /* ditto for rows */
+    UINT64 col_base;            /* offset of display_col0 in grid->col_sizes */
+    UINT64 row_base;            /* ditto for rows */
+    DWORD frozen_col_count;     /* count of display columns which do not scroll */
+    DWORD frozen_row_count;     /* ditto for rows */
+    LONG frozen_width;          /* width of the frozen columns */
+    LONG frozen_height;         /* ditto for rows */
 };
 
 static void
 grid_calc_layout(grid_t* grid, grid_layout_t* layout)
 {
-    WORD col_count;
-    WORD row_count;
+    DWORD col_count;
+    DWORD row_count;
 
     if(grid->table) {
         col_count = table_col_count(grid->table);
@@ -118,264 +452,964 @@ grid_calc_layout(grid_t* grid, grid_layout_t* layout)
         row_count = 0;
     }
 
-    layout->display_header_height = (row_count > 0  &&  (grid->style & MC_GS_COLUMNHEADERMASK) != MC_GS_COLUMNHEADERNONE) ? grid->header_height : 0;
-    layout->display_header_width = (col_count > 0  &&  (grid->style & MC_GS_ROWHEADERMASK) != MC_GS_ROWHEADERNONE) ? grid->header_width : 0;
-    layout->display_col0 = (col_count > 0  &&  (grid->style & MC_GS_ROWHEADERMASK) == MC_GS_ROWHEADERCUSTOM) ? 1 : 0;
-    layout->display_row0 = (row_count > 0  &&  (grid->style & MC_GS_COLUMNHEADERMASK) == MC_GS_COLUMNHEADERCUSTOM) ? 1 : 0;
-    layout->display_col_count = col_count - layout->display_col0;
-    layout->display_row_count = row_count - layout->display_row0;
+    layout->display_header_height = (row_count > 0  &&  (grid->style & MC_GS_COLUMNHEADERMASK) != MC_GS_COLUMNHEADERNONE) ? grid->header_height : 0;
+    layout->display_header_width = (col_count > 0  &&  (grid->style & MC_GS_ROWHEADERMASK) != MC_GS_ROWHEADERNONE) ? grid->header_width : 0;
+    layout->display_col0 = (col_count > 0  &&  (grid->style & MC_GS_ROWHEADERMASK) == MC_GS_ROWHEADERCUSTOM) ? 1 : 0;
+    layout->display_row0 = (row_count > 0  &&  (grid->style & MC_GS_COLUMNHEADERMASK) == MC_GS_COLUMNHEADERCUSTOM) ? 1 : 0;
+    layout->display_col_count = col_count - layout->display_col0;
+    layout->display_row_count = row_count - layout->display_row0;
+    layout->col_base = grid_sizes_offset(&grid->col_sizes, layout->display_col0);
+    layout->row_base = grid_sizes_offset(&grid->row_sizes, layout->display_row0);
+    layout->frozen_col_count = MC_MIN(grid->frozen_cols, layout->display_col_count);
+    layout->frozen_row_count = MC_MIN(grid->frozen_rows, layout->display_row_count);
+    layout->frozen_width = (LONG) MC_MIN(grid_sizes_offset(&grid->col_sizes,
+                layout->display_col0 + layout->frozen_col_count) - layout->col_base,
+                (UINT64)(INT_MAX / 2));
+    layout->frozen_height = (LONG) MC_MIN(grid_sizes_offset(&grid->row_sizes,
+                layout->display_row0 + layout->frozen_row_count) - layout->row_base,
+                (UINT64)(INT_MAX / 2));
+}
+
+/* Offset of the display column from the left edge of the (unscrolled)
+ * contents. */
+static inline UINT64
+grid_col_x(grid_t* grid, const grid_layout_t* layout, DWORD col)
+{
+    return grid_sizes_offset(&grid->col_sizes, layout->display_col0 + col) - layout->col_base;
+}
+
+static inline UINT64
+grid_row_y(grid_t* grid, const grid_layout_t* layout, DWORD row)
+{
+    return grid_sizes_offset(&grid->row_sizes, layout->display_row0 + row) - layout->row_base;
+}
+
+/* Display column at the offset from the left edge of the (unscrolled)
+ * contents. It is >= display_col_count if there is no column. */
+static inline DWORD
+grid_col_at(grid_t* grid, const grid_layout_t* layout, UINT64 x)
+{
+    return grid_sizes_index(&grid->col_sizes, layout->col_base + x) - layout->display_col0;
+}
+
+static inline DWORD
+grid_row_at(grid_t* grid, const grid_layout_t* layout, UINT64 y)
+{
+    return grid_sizes_index(&grid->row_sizes, layout->row_base + y) - layout->display_row0;
+}
+
+/* Converts offset within the contents to a client coordinate. */
+static inline LONG
+grid_client_pos(WORD header_size, UINT64 offset, int scroll)
+{
+    INT64 pos = (INT64)header_size + (INT64)MC_MIN(offset, (UINT64)INT_MAX) - scroll;
+    return (LONG) MC_MIN(pos, (INT64)(INT_MAX / 2));
+}
+
+/* Along each axis, the contents are split into up to two panes: The frozen
+ * one (the leading columns or rows which never scroll) and the scrolling
+ * one. Both use the same offsets within the contents, so the scrolling pane
+ * just starts where the frozen one ends, and the cells scrolled under the
+ * frozen pane are hidden. The span describes one pane along one axis. */
+typedef struct grid_span_tag grid_span_t;
+struct grid_span_tag {
+    const grid_sizes_t* sizes;
+    UINT64 base;          /* offset of the first display column (or row) */
+    DWORD display0;       /* index of the first display column (or row) */
+    WORD header;          /* header size */
+    int scroll;
+    LONG pos0;            /* client coordinates of the pane [pos0, pos1) */
+    LONG pos1;
+    DWORD index0;         /* display columns (or rows) of the pane [index0, index1) */
+    DWORD index1;
+};
+
+/* Sets up the spans for columns (or rows). Returns count of them (1 or 2).
+ * The frozen span, if any, is the first. */
+static int
+grid_spans(grid_t* grid, const grid_layout_t* layout, const RECT* client,
+           BOOL is_col, grid_span_t spans[2])
+{
+    grid_span_t* span = &spans[0];
+    DWORD frozen_count;
+    LONG frozen_end;
+    LONG client_end;
+
+    if(is_col) {
+        span->sizes = &grid->col_sizes;
+        span->base = layout->col_base;
+        span->display0 = layout->display_col0;
+        span->header = layout->display_header_width;
+        span->scroll = grid->scroll_x;
+        span->index1 = layout->display_col_count;
+        frozen_count = layout->frozen_col_count;
+        frozen_end = layout->display_header_width + layout->frozen_width;
+        client_end = client->right;
+    } else {
+        span->sizes = &grid->row_sizes;
+        span->base = layout->row_base;
+        span->display0 = layout->display_row0;
+        span->header = layout->display_header_height;
+        span->scroll = grid->scroll_y;
+        span->index1 = layout->display_row_count;
+        frozen_count = layout->frozen_row_count;
+        frozen_end = layout->display_header_height + layout->frozen_height;
+        client_end = client->bottom;
+    }
+    span->pos0 = span->header;
+    span->pos1 = MC_MAX(client_end, span->pos0);
+    span->index0 = 0;
+
+    if(frozen_count == 0)
+        return 1;
+
+    frozen_end = MC_MIN(frozen_end, span->pos1);
+    memcpy(&spans[1], span, sizeof(grid_span_t));
+
+    span->scroll = 0;
+    span->pos1 = frozen_end;
+    span->index1 = frozen_count;
+
+    span = &spans[1];
+    span->pos0 = frozen_end;
+    span->index0 = frozen_count;
+    return 2;
+}
+
+/* Offset of the display column (or row) within the (unscrolled) contents. */
+static inline UINT64
+grid_span_offset(const grid_span_t* span, DWORD index)
+{
+    return grid_sizes_offset(span->sizes, span->display0 + index) - span->base;
+}
+
+/* Client coordinate of the display column (or row) in the pane. */
+static inline LONG
+grid_span_pos(const grid_span_t* span, DWORD index)
+{
+    return grid_client_pos(span->header, grid_span_offset(span, index), span->scroll);
+}
+
+/* Gets display columns (or rows) of the pane intersecting client interval
+ * [p0, p1) ([i0, i1) exclusive). Returns FALSE if there is none. */
+static BOOL
+grid_span_range(const grid_span_t* span, LONG p0, LONG p1, DWORD* i0, DWORD* i1)
+{
+    DWORD first, last;
+
+    p0 = MC_MAX(p0, span->pos0);
+    p1 = MC_MIN(p1, span->pos1);
+    if(p0 >= p1  ||  span->index0 >= span->index1)
+        return FALSE;
+
+    first = grid_sizes_index(span->sizes, span->base +
+                (UINT64)span->scroll + (UINT64)(p0 - span->header)) - span->display0;
+    last = grid_sizes_index(span->sizes, span->base +
+                (UINT64)span->scroll + (UINT64)(p1 - span->header)) - span->display0;
+
+    *i0 = MC_MAX(first, span->index0);
+    *i1 = (last < span->index1 ? last + 1 : span->index1);
+    return (*i0 < *i1);
+}
+
+/* Gets client interval [p0, p1) of display columns (or rows) [i0, i1) as
+ * far as they are in the pane. Returns FALSE if nothing of them is. */
+static BOOL
+grid_span_extent(const grid_span_t* span, DWORD i0, DWORD i1, LONG* p0, LONG* p1)
+{
+    i0 = MC_MAX(i0, span->index0);
+    i1 = MC_MIN(i1, span->index1);
+    if(i0 >= i1)
+        return FALSE;
+
+    *p0 = MC_MAX(grid_span_pos(span, i0), span->pos0);
+    *p1 = MC_MIN(grid_span_pos(span, i1), span->pos1);
+    return (*p0 < *p1);
+}
+
+/* Display columns (or rows) visible in any of the panes. */
+static void
+grid_visible_range(const grid_span_t* spans, int n, DWORD* i0, DWORD* i1)
+{
+    DWORD first, last;
+    int i;
+
+    *i0 = 0;
+    *i1 = 0;
+    for(i = 0; i < n; i++) {
+        if(!grid_span_range(&spans[i], spans[i].pos0, spans[i].pos1, &first, &last))
+            continue;
+        if(*i0 >= *i1) {
+            *i0 = first;
+            *i1 = last;
+        } else {
+            *i0 = MC_MIN(*i0, first);
+            *i1 = MC_MAX(*i1, last);
+        }
+    }
+}
+
+/* Tells the table which cells are visible, so it does not bother us with
+ * changes of the others: They are not in the back buffer, and they get
+ * painted from scratch when scrolled into the view. Called whenever the
+ * scroll position, the layout or the client size changes. */
+static void
+grid_update_interest(grid_t* grid)
+{
+    grid_layout_t layout;
+    RECT client;
+    grid_span_t spans[2];
+    int n;
+    table_region_t* region = &grid->interest.region;
+    DWORD i0, i1;
+
+    if(grid->table == NULL)
+        return;
+
+    GetClientRect(grid->win, &client);
+    grid_calc_layout(grid, &layout);
+
+    n = grid_spans(grid, &layout, &client, TRUE, spans);
+    grid_visible_range(spans, n, &i0, &i1);
+    region->col0 = layout.display_col0 + i0;
+    region->col1 = layout.display_col0 + i1;
+
+    n = grid_spans(grid, &layout, &client, FALSE, spans);
+    grid_visible_range(spans, n, &i0, &i1);
+    region->row0 = layout.display_row0 + i0;
+    region->row1 = layout.display_row0 + i1;
+
+    /* Custom headers show the column 0 and the row 0, so these are always
+     * visible. (The region has to be a rectangle, so it includes also the
+     * cells in between.) */
+    region->col0 = (layout.display_col0 > 0 ? 0 : region->col0);
+    region->row0 = (layout.display_row0 > 0 ? 0 : region->row0);
+}
+
+/* Paints column headers [col0, col1) of the span. Clip is inclusive. */
+static void
+grid_paint_col_headers(grid_t* grid, HDC dc, const grid_layout_t* layout,
+                       const grid_span_t* span, DWORD col0, DWORD col1,
+                       const RECT* clip)
+{
+    TCHAR buffer[16];
+    RECT rect;
+    DWORD col;
+
+    rect.left = grid_span_pos(span, col0);
+    rect.top = 0;
+    rect.bottom = layout->display_header_height;
+
+    mc_clip_set(dc, MC_MAX(span->pos0, clip->left), clip->top,
+                MC_MIN(span->pos1 - 1, clip->right),
+                MC_MIN(layout->display_header_height, clip->bottom));
+
+    for(col = col0; col < col1; col++) {
+        rect.right = rect.left + grid_sizes_get(&grid->col_sizes, col + layout->display_col0);
+
+        if(grid->theme) {
+            theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
+                                      HIS_NORMAL, &rect, NULL);
+        } else {
+            DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
+        }
+
+        switch(grid->style & MC_GS_COLUMNHEADERMASK) {
+            case MC_GS_COLUMNHEADERNUMBERED:
+                _stprintf(buffer, _T("%lu"), (ULONG)col + 1);
+                textcache_draw(dc, buffer, -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
+                break;
+            case MC_GS_COLUMNHEADERALPHABETIC:
+                textcache_draw(dc, grid_num_to_alpha(buffer, col),
+                               -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
+                break;
+            case MC_GS_COLUMNHEADERCUSTOM:
+            {
+                RECT r = { rect.left + grid->cell_padding_horz,
+                           rect.top + grid->cell_padding_vert,
+                           rect.right - 2 * grid->cell_padding_horz - 1,
+                           rect.bottom - 2 * grid->cell_padding_vert - 1 };
+                table_paint_cell(grid->table, col + layout->display_col0, 0, dc, &r);
+                break;
+            }
+        }
+
+        rect.left = rect.right;
+    }
+}
+
+/* Paints row headers [row0, row1) of the span. Clip is inclusive. */
+static void
+grid_paint_row_headers(grid_t* grid, HDC dc, const grid_layout_t* layout,
+                       const grid_span_t* span, DWORD row0, DWORD row1,
+                       const RECT* clip)
+{
+    TCHAR buffer[16];
+    RECT rect;
+    DWORD row;
+
+    rect.left = 0;
+    rect.top = grid_span_pos(span, row0);
+    rect.right = layout->display_header_width;
+
+    mc_clip_set(dc, clip->left, MC_MAX(span->pos0, clip->top),
+                MC_MIN(layout->display_header_width, clip->right),
+                MC_MIN(span->pos1 - 1, clip->bottom));
+
+    for(row = row0; row < row1; row++) {
+        rect.bottom = rect.top + grid_sizes_get(&grid->row_sizes, row + layout->display_row0);
+
+        if(grid->theme) {
+            rect.bottom++;  /* damn: Aero is ugly w/o this */
+            theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
+                                      HIS_NORMAL, &rect, NULL);
+            rect.bottom--;  /* damn: Aero is ugly w/o this */
+        } else {
+            DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
+        }
+
+        switch(grid->style & MC_GS_ROWHEADERMASK) {
+            case MC_GS_ROWHEADERNUMBERED:
+                _stprintf(buffer, _T("%lu"), (ULONG)row + 1);
+                textcache_draw(dc, buffer, -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
+                break;
+            case MC_GS_ROWHEADERALPHABETIC:
+                textcache_draw(dc, grid_num_to_alpha(buffer, row),
+                               -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
+                break;
+            case MC_GS_ROWHEADERCUSTOM:
+            {
+                RECT r = { rect.left + grid->cell_padding_horz,
+                           rect.top + grid->cell_padding_vert,
+                           rect.right - 2 * grid->cell_padding_horz - 1,
+                           rect.bottom - 2 * grid->cell_padding_vert - 1 };
+                table_paint_cell(grid->table, 0, row + layout->display_row0, dc, &r);
+                break;
+            }
+        }
+
+        rect.top = rect.bottom;
+    }
+}
+
+/* Paints grid lines and cells [col0, col1) x [row0, row1) of the pane given
+ * by the two spans. Clip is inclusive. */
+static void
+grid_paint_cells(grid_t* grid, HDC dc, const grid_layout_t* layout,
+                 const grid_span_t* col_span, DWORD col0, DWORD col1,
+                 const grid_span_t* row_span, DWORD row0, DWORD row1,
+                 const RECT* clip)
+{
+    DWORD col, row;
+    RECT rect;
+    LONG x0, x, y;
+    WORD w, h;
+
+    mc_clip_set(dc, MC_MAX(col_span->pos0, clip->left), MC_MAX(row_span->pos0, clip->top),
+                MC_MIN(col_span->pos1 - 1, clip->right), MC_MIN(row_span->pos1 - 1, clip->bottom));
+
+    /* Paint grid lines */
+    if(!(grid->style & MC_GS_NOGRIDLINES)) {
+        LONG x1, y1;
+
+        if(grid->gridline_pen != NULL)
+            SelectObject(dc, grid->gridline_pen);
+
+        x1 = grid_span_pos(col_span, col1) - 1;
+        y1 = grid_span_pos(row_span, row1) - 1;
+
+        x = grid_span_pos(col_span, col0) - 1;
+        for(col = col0; col < col1; col++) {
+            x += grid_sizes_get(&grid->col_sizes, col + layout->display_col0);
+            MoveToEx(dc, x, row_span->pos0, NULL);
+            LineTo(dc, x, y1);
+        }
+
+        y = grid_span_pos(row_span, row0) - 1;
+        for(row = row0; row < row1; row++) {
+            y += grid_sizes_get(&grid->row_sizes, row + layout->display_row0);
+            MoveToEx(dc, col_span->pos0, y, NULL);
+            LineTo(dc, x1, y);
+        }
+
+        SelectObject(dc, GetStockObject(BLACK_PEN));
+    }
+
+    /* Paint grid cells */
+    x0 = grid_span_pos(col_span, col0);
+    y = grid_span_pos(row_span, row0);
+    for(row = layout->display_row0 + row0; row < layout->display_row0 + row1; row++) {
+        h = grid_sizes_get(&grid->row_sizes, row);
+        rect.top = y + grid->cell_padding_vert;
+        rect.bottom = y + h - grid->cell_padding_vert - 1;
+        x = x0;
+        for(col = layout->display_col0 + col0; col < layout->display_col0 + col1; col++) {
+            w = grid_sizes_get(&grid->col_sizes, col);
+            rect.left = x + grid->cell_padding_horz;
+            rect.right = x + w - grid->cell_padding_horz - 1;
+            table_paint_cell(grid->table, col, row, dc, &rect);
+            x += w;
+        }
+        y += h;
+    }
+}
+
+static void
+grid_paint(grid_t* grid, HDC dc, RECT* dirty)
+{
+    grid_layout_t layout;
+    WORD headerw, headerh;
+    grid_span_t col_spans[2];
+    grid_span_t row_spans[2];
+    int col_span_count, row_span_count;
+    int i, j;
+    DWORD col0, row0;
+    DWORD col1, row1;
+    RECT rect;
+    RECT client;
+    RECT clip;
+    int old_dc_state;
+
+    GRID_TRACE("grid_paint(%d, %d, %d, %d)",
+               dirty->left, dirty->top, dirty->right, dirty->bottom);
+
+    GetClientRect(grid->win, &client);
+
+    grid_calc_layout(grid, &layout);
+    headerw = layout.display_header_width;
+    headerh = layout.display_header_height;
+
+    /* Each pane (frozen or scrolling) is painted separately: It has its own
+     * scroll position and range of cells. */
+    col_span_count = grid_spans(grid, &layout, &client, TRUE, col_spans);
+    row_span_count = grid_spans(grid, &layout, &client, FALSE, row_spans);
+
+    /* Nothing is painted out of the dirty rect: Parts of the back buffer
+     * out of it may be up to date already. (mc_clip_set() takes inclusive
+     * coordinates.) */
+    clip.left = MC_MAX(dirty->left, 0);
+    clip.top = MC_MAX(dirty->top, 0);
+    clip.right = MC_MIN(dirty->right, client.right) - 1;
+    clip.bottom = MC_MIN(dirty->bottom, client.bottom) - 1;
+
+    /* We handle WM_ERASEBKGND ourselves: Background is erased only here,
+     * into the back buffer (if used). */
+    FillRect(dc, dirty, GetSysColorBrush(COLOR_WINDOW));
+
+    /* The DC is set up just once for all the painting below. Cell painters
+     * leave it as they get it, and they do not paint out of their rect, so
+     * we need neither to save the DC nor to clip for each cell. */
+    old_dc_state = SaveDC(dc);
+
+    SelectObject(dc, grid->font ? grid->font : GetStockObject(SYSTEM_FONT));
+    SetBkMode(dc, TRANSPARENT);
+    SetTextColor(dc, RGB(0,0,0));
+    SelectObject(dc, GetStockObject(BLACK_PEN));
+
+    /* Paint "dead" top left cell */
+    if(headerw > 0 && headerh > 0 && dirty->left <= headerw && dirty->top <= headerh) {
+        mc_set_rect(&rect, 0, 0, headerw, headerh);
+        mc_clip_set(dc, clip.left, clip.top, MC_MIN(headerw, clip.right), MC_MIN(headerh, clip.bottom));
+
+        if(grid->theme) {
+            theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
+                                      HIS_NORMAL, &rect, NULL);
+        } else {
+            DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
+        }
+    }
+
+    /* Paint column headers */
+    if(headerh > 0 && dirty->top <= headerh) {
+        for(i = 0; i < col_span_count; i++) {
+            if(grid_span_range(&col_spans[i], dirty->left, dirty->right, &col0, &col1))
+                grid_paint_col_headers(grid, dc, &layout, &col_spans[i], col0, col1, &clip);
+        }
+    }
+
+    /* Paint row headers */
+    if(headerw > 0 && dirty->left <= headerw) {
+        for(j = 0; j < row_span_count; j++) {
+            if(grid_span_range(&row_spans[j], dirty->top, dirty->bottom, &row0, &row1))
+                grid_paint_row_headers(grid, dc, &layout, &row_spans[j], row0, row1, &clip);
+        }
+    }
+
+    /* Paint the contents, pane by pane */
+    for(j = 0; j < row_span_count; j++) {
+        if(!grid_span_range(&row_spans[j], dirty->top, dirty->bottom, &row0, &row1))
+            continue;
+
+        for(i = 0; i < col_span_count; i++) {
+            if(!grid_span_range(&col_spans[i], dirty->left, dirty->right, &col0, &col1))
+                continue;
+
+            GRID_TRACE("grid_paint: cell region [%lu, %lu] - [%lu, %lu]",
+                       (ULONG)col0, (ULONG)row0, (ULONG)col1, (ULONG)row1);
+            grid_paint_cells(grid, dc, &layout, &col_spans[i], col0, col1,
+                             &row_spans[j], row0, row1, &clip);
+        }
+    }
+
+    RestoreDC(dc, old_dc_state);
+}
+
+static void
+grid_buffer_free(grid_t* grid)
+{
+    if(grid->buffer_dc == NULL)
+        return;
+
+    SelectObject(grid->buffer_dc, grid->buffer_old_bmp);
+    DeleteObject(grid->buffer_bmp);
+    DeleteDC(grid->buffer_dc);
+    DeleteObject(grid->buffer_dirty);
+    grid->buffer_dc = NULL;
+    grid->buffer_bmp = NULL;
+    grid->buffer_dirty = NULL;
+    grid->buffer_width = 0;
+    grid->buffer_height = 0;
+}
+
+/* The back buffer keeps the rendered contents of the window between paints.
+ * Paints only render what is out of date in it (see grid_invalidate()),
+ * and the rest is just copied to the window. The buffer is kept as long as
+ * it is large enough for the client area. Returns NULL if it cannot be
+ * created. */
+static HDC
+grid_buffer_dc(grid_t* grid, HDC dc)
+{
+    RECT client;
+    HDC buffer_dc;
+    HBITMAP buffer_bmp;
+    HRGN buffer_dirty;
+
+    GetClientRect(grid->win, &client);
+
+    if(grid->buffer_dc != NULL  &&  grid->buffer_width >= client.right  &&
+       grid->buffer_height >= client.bottom)
+        return grid->buffer_dc;
+
+    grid_buffer_free(grid);
+
+    buffer_dc = CreateCompatibleDC(dc);
+    if(MC_ERR(buffer_dc == NULL)) {
+        MC_TRACE("grid_buffer_dc: CreateCompatibleDC() failed.");
+        return NULL;
+    }
+
+    buffer_bmp = CreateCompatibleBitmap(dc, client.right, client.bottom);
+    if(MC_ERR(buffer_bmp == NULL)) {
+        MC_TRACE("grid_buffer_dc: CreateCompatibleBitmap() failed.");
+        DeleteDC(buffer_dc);
+        return NULL;
+    }
+
+    /* Nothing is rendered in the new buffer yet. */
+    buffer_dirty = CreateRectRgn(0, 0, client.right, client.bottom);
+    if(MC_ERR(buffer_dirty == NULL)) {
+        MC_TRACE("grid_buffer_dc: CreateRectRgn() failed.");
+        DeleteObject(buffer_bmp);
+        DeleteDC(buffer_dc);
+        return NULL;
+    }
+
+    grid->buffer_dc = buffer_dc;
+    grid->buffer_bmp = buffer_bmp;
+    grid->buffer_old_bmp = SelectObject(buffer_dc, buffer_bmp);
+    grid->buffer_dirty = buffer_dirty;
+    grid->buffer_width = client.right;
+    grid->buffer_height = client.bottom;
+    return buffer_dc;
+}
+
+/* Marks the rect of the back buffer as out of date (NULL means all of it). */
+static void
+grid_buffer_invalidate(grid_t* grid, const RECT* rect)
+{
+    HRGN rgn;
+
+    if(grid->buffer_dc == NULL)
+        return;
+
+    if(rect == NULL) {
+        SetRectRgn(grid->buffer_dirty, 0, 0, grid->buffer_width, grid->buffer_height);
+        return;
+    }
+
+    rgn = CreateRectRgnIndirect(rect);
+    if(MC_ERR(rgn == NULL)) {
+        MC_TRACE("grid_buffer_invalidate: CreateRectRgnIndirect() failed.");
+        SetRectRgn(grid->buffer_dirty, 0, 0, grid->buffer_width, grid->buffer_height);
+        return;
+    }
+    CombineRgn(grid->buffer_dirty, grid->buffer_dirty, rgn, RGN_OR);
+    DeleteObject(rgn);
+}
+
+/* Shifts the rendered contents of the rect in the back buffer, so that only
+ * the newly exposed part has to be rendered when the grid is scrolled. */
+static void
+grid_buffer_scroll(grid_t* grid, int dx, int dy, const RECT* rect)
+{
+    HRGN scrolled;
+    HRGN moved;
+    RECT exposed;
+
+    if(grid->buffer_dc == NULL)
+        return;
+
+    scrolled = CreateRectRgnIndirect(rect);
+    moved = CreateRectRgn(0, 0, 0, 0);
+    if(MC_ERR(scrolled == NULL  ||  moved == NULL)) {
+        MC_TRACE("grid_buffer_scroll: CreateRectRgn() failed.");
+        grid_buffer_invalidate(grid, NULL);
+        goto out;
+    }
+
+    if(MC_ERR(!ScrollDC(grid->buffer_dc, dx, dy, rect, rect, NULL, &exposed))) {
+        MC_TRACE("grid_buffer_scroll: ScrollDC() failed.");
+        grid_buffer_invalidate(grid, rect);
+        goto out;
+    }
+
+    /* Out of date parts of the rect move together with the pixels. */
+    CombineRgn(moved, grid->buffer_dirty, scrolled, RGN_AND);
+    CombineRgn(grid->buffer_dirty, grid->buffer_dirty, scrolled, RGN_DIFF);
+    OffsetRgn(moved, dx, dy);
+    CombineRgn(grid->buffer_dirty, grid->buffer_dirty, moved, RGN_OR);
+    grid_buffer_invalidate(grid, &exposed);
+
+out:
+    if(scrolled)
+        DeleteObject(scrolled);
+    if(moved)
+        DeleteObject(moved);
+}
+
+/* All changes of what the grid displays have to be invalidated via this,
+ * so the back buffer knows what has to be rendered again. (Other
+ * invalidations, e.g. when the window is uncovered, are just served from
+ * the back buffer.) */
+static void
+grid_invalidate(grid_t* grid, const RECT* rect)
+{
+    grid_buffer_invalidate(grid, rect);
+    InvalidateRect(grid->win, rect, FALSE);
 }
 
+#ifdef GRID_DEBUG
 static void
-grid_paint(grid_t* grid, HDC dc, RECT* dirty)
+grid_count_frame(grid_t* grid)
 {
-    grid_layout_t layout;
-    WORD headerw, headerh;
-    WORD col0, row0;
-    WORD col1, row1;
-    WORD col, row;
-    RECT rect;
-    RECT client;
-    int old_dc_state, cell_dc_state;
+    DWORD now = GetTickCount();
+    DWORD elapsed = now - grid->fps_tick;
 
-    GRID_TRACE("grid_paint(%d, %d, %d, %d)",
-               dirty->left, dirty->top, dirty->right, dirty->bottom);
+    /* Do not mix the frames with a long idle time before them. */
+    if(elapsed > 2000) {
+        grid->fps_tick = now;
+        grid->fps_frames = 0;
+        return;
+    }
 
-    GetClientRect(grid->win, &client);
+    grid->fps_frames++;
+    if(elapsed >= 1000) {
+        GRID_TRACE("grid_count_frame: %u frames per second",
+                   (UINT)(grid->fps_frames * 1000 / elapsed));
+        grid->fps_tick = now;
+        grid->fps_frames = 0;
+    }
+}
+#endif
 
-    grid_calc_layout(grid, &layout);
-    headerw = layout.display_header_width;
-    headerh = layout.display_header_height;
+/* If a region has more rectangles than this, it is simpler to render its
+ * bounding box. */
+#define GRID_MAX_PAINT_RECTS      8
 
-    /* Calculate range of cells in dirty rect
-     * ([col0,row0] inclusive; [col1,row1] exclusive) */
-    col0 = (grid->scroll_x + MC_MAX(0, dirty->left - headerw)) / grid->cell_width;
-    row0 = (grid->scroll_y + MC_MAX(0, dirty->top - headerh)) / grid->cell_height;
-    col1 = MC_MIN(layout.display_col_count, (grid->scroll_x + dirty->right - headerw) / grid->cell_width + 1);
-    row1 = MC_MIN(layout.display_row_count, (grid->scroll_y + dirty->bottom - headerh) / grid->cell_height + 1);
+static void
+grid_paint_buffered(grid_t* grid, HDC dc, RECT* dirty)
+{
+    HDC buffer_dc;
+    HRGN rgn;
+    int rgn_type;
 
-    GRID_TRACE("grid_paint: cell region [%d, %d] - [%d, %d]", col0, row0, col1, row1);
+    if(mc_rect_is_empty(dirty))
+        return;
 
-    old_dc_state = SaveDC(dc);
+    /* If we cannot get the back buffer, paint directly. It flickers but it
+     * works. */
+    buffer_dc = grid_buffer_dc(grid, dc);
+    if(buffer_dc == NULL) {
+        grid_paint(grid, dc, dirty);
+        return;
+    }
 
-    SelectObject(dc, grid->font ? grid->font : GetStockObject(SYSTEM_FONT));
-    SetBkMode(dc, TRANSPARENT);
-    SetTextColor(dc, RGB(0,0,0));
-    SelectObject(dc, GetStockObject(BLACK_PEN));
+    /* Render only the part of the dirty rect which is out of date in the
+     * back buffer. */
+    rgn = CreateRectRgnIndirect(dirty);
+    if(MC_ERR(rgn == NULL)) {
+        MC_TRACE("grid_paint_buffered: CreateRectRgnIndirect() failed.");
+        grid_paint(grid, buffer_dc, dirty);
+        goto blit;
+    }
 
-    /* Paint "dead" top left cell */
-    if(headerw > 0 && headerh > 0 && dirty->left <= headerw && dirty->top <= headerh) {
-        mc_set_rect(&rect, 0, 0, headerw, headerh);
-        mc_clip_set(dc, 0, 0, MC_MIN(headerw, client.right), MC_MIN(headerh, client.bottom));
+    rgn_type = CombineRgn(rgn, rgn, grid->buffer_dirty, RGN_AND);
+    if(rgn_type == SIMPLEREGION  ||  rgn_type == COMPLEXREGION) {
+        RGNDATA* data = NULL;
+        DWORD size;
+        RECT box;
+
+        /* After scrolling in both directions, the region is typically
+         * L-shaped. Render its rectangles separately, rather than the whole
+         * bounding box. */
+        if(rgn_type == COMPLEXREGION) {
+            size = GetRegionData(rgn, 0, NULL);
+            data = (RGNDATA*) malloc(size);
+            if(data != NULL  &&  (GetRegionData(rgn, size, data) == 0  ||
+                                  data->rdh.nCount > GRID_MAX_PAINT_RECTS)) {
+                free(data);
+                data = NULL;
+            }
+        }
 
-        if(grid->theme) {
-            theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
-                                      HIS_NORMAL, &rect, NULL);
+        if(data != NULL) {
+            RECT* rects = (RECT*) data->Buffer;
+            DWORD i;
+
+            for(i = 0; i < data->rdh.nCount; i++)
+                grid_paint(grid, buffer_dc, &rects[i]);
+            free(data);
         } else {
-            DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
+            GetRgnBox(rgn, &box);
+            grid_paint(grid, buffer_dc, &box);
         }
+
+        CombineRgn(grid->buffer_dirty, grid->buffer_dirty, rgn, RGN_DIFF);
     }
+    DeleteObject(rgn);
 
-    /* Paint column headers */
-    if(headerh > 0 && dirty->top <= headerh) {
-        TCHAR buffer[16];
+blit:
+    BitBlt(dc, dirty->left, dirty->top, mc_width(dirty), mc_height(dirty),
+           buffer_dc, dirty->left, dirty->top, SRCCOPY);
 
-        rect.left = headerw + col0 * grid->cell_width - grid->scroll_x;
-        rect.top = 0;
-        rect.right = rect.left + grid->cell_width;
-        rect.bottom = headerh;
+#ifdef GRID_DEBUG
+    grid_count_frame(grid);
+#endif
+}
 
-        for(col = col0; col < col1; col++) {
-            mc_clip_set(dc, MC_MAX(headerw, rect.left), rect.top,
-                        MC_MIN(rect.right, client.right), MC_MIN(rect.bottom, client.bottom));
-
-            if(grid->theme) {
-                theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
-                                          HIS_NORMAL, &rect, NULL);
-            } else {
-                DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
-            }
+static void grid_setup_scrollbars(grid_t* grid);
 
-            switch(grid->style & MC_GS_COLUMNHEADERMASK) {
-                case MC_GS_COLUMNHEADERNUMBERED:
-                    _stprintf(buffer, _T("%d"), col + 1);
-                    DrawText(dc, buffer, -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
-                    break;
-                case MC_GS_COLUMNHEADERALPHABETIC:
-                    DrawText(dc, grid_num_to_alpha(buffer, col),
-                             -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
-                    break;
-                case MC_GS_COLUMNHEADERCUSTOM:
-                {
-                    RECT r = { rect.left + grid->cell_padding_horz,
-                               rect.top + grid->cell_padding_vert,
-                               rect.right - 2 * grid->cell_padding_horz - 1,
-                               rect.bottom - 2 * grid->cell_padding_vert - 1 };
-                    cell_dc_state = SaveDC(dc);
-                    table_paint_cell(grid->table, col + layout.display_col0, 0, dc, &r);
-                    RestoreDC(dc, cell_dc_state);
-                    break;
-                }
-            }
+static void
+grid_refresh_now(grid_t* grid, const table_region_t* detail)
+{
+    grid_layout_t layout;
+    grid_span_t col_spans[2];
+    grid_span_t row_spans[2];
+    int col_span_count, row_span_count;
+    int i, j;
+    DWORD col0, row0;
+    DWORD col1, row1;
+    RECT client;
+    RECT rect;
+    LONG x0, x1, y0, y1;
+
+    /* The application is expected to invalidate the window when it
+     * re-enables redrawing, but it does not know about the back buffer. */
+    if(grid->no_redraw) {
+        grid_buffer_invalidate(grid, NULL);
+        return;
+    }
 
-            rect.left += grid->cell_width;
-            rect.right += grid->cell_width;
+    /* Rows or columns may have been added or removed. If that clamps the
+     * scroll position, everything visible moves. */
+    if(grid->table != NULL  &&
+       (table_col_count(grid->table) != grid->sb_col_count  ||
+        table_row_count(grid->table) != grid->sb_row_count)) {
+        int old_scroll_x = grid->scroll_x;
+        int old_scroll_y = grid->scroll_y;
+
+        grid_setup_scrollbars(grid);
+        if(grid->scroll_x != old_scroll_x  ||  grid->scroll_y != old_scroll_y) {
+            grid_invalidate(grid, NULL);
+            return;
         }
     }
 
-    /* Paint row headers */
-    if(headerw > 0 && dirty->left <= headerw) {
-        TCHAR buffer[16];
+    if(detail == NULL) {
+        grid_invalidate(grid, NULL);
+        return;
+    }
 
-        rect.left = 0;
-        rect.top = headerh + row0 * grid->cell_height - grid->scroll_y;
-        rect.right = headerw;
-        rect.bottom = rect.top + grid->cell_height;
+    grid_calc_layout(grid, &layout);
+    GetClientRect(grid->win, &client);
+    col_span_count = grid_spans(grid, &layout, &client, TRUE, col_spans);
+    row_span_count = grid_spans(grid, &layout, &client, FALSE, row_spans);
 
-        for(row = row0; row < row1; row++) {
-            mc_clip_set(dc, rect.left, MC_MAX(headerh, rect.top),
-                        MC_MIN(rect.right, client.right), MC_MIN(rect.bottom, client.bottom));
-
-            if(grid->theme) {
-                rect.bottom++;  /* damn: Aero is ugly w/o this */
-                theme_DrawThemeBackground(grid->theme, dc, HP_HEADERITEM,
-                                          HIS_NORMAL, &rect, NULL);
-                rect.bottom--;  /* damn: Aero is ugly w/o this */
-            } else {
-                DrawEdge(dc, &rect, BDR_RAISEDINNER, BF_MIDDLE | BF_RECT);
-            }
+    /* Display columns and rows of the region (as if the contents start
+     * right after the headers). */
+    col0 = detail->col0 - MC_MIN(detail->col0, layout.display_col0);
+    col1 = detail->col1 - MC_MIN(detail->col1, layout.display_col0);
+    row0 = detail->row0 - MC_MIN(detail->row0, layout.display_row0);
+    row1 = detail->row1 - MC_MIN(detail->row1, layout.display_row0);
 
-            switch(grid->style & MC_GS_ROWHEADERMASK) {
-                case MC_GS_ROWHEADERNUMBERED:
-                    _stprintf(buffer, _T("%d"), row+1);
-                    DrawText(dc, buffer, -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
-                    break;
-                case MC_GS_ROWHEADERALPHABETIC:
-                    DrawText(dc, grid_num_to_alpha(buffer, row),
-                             -1, &rect, DT_SINGLELINE | DT_CENTER | DT_VCENTER);
-                    break;
-                case MC_GS_ROWHEADERCUSTOM:
-                {
-                    RECT r = { rect.left + grid->cell_padding_horz,
-                               rect.top + grid->cell_padding_vert,
-                               rect.right - 2 * grid->cell_padding_horz - 1,
-                               rect.bottom - 2 * grid->cell_padding_vert - 1 };
-                    cell_dc_state = SaveDC(dc);
-                    table_paint_cell(grid->table, 0, row + layout.display_row0, dc, &r);
-                    RestoreDC(dc, cell_dc_state);
-                    break;
-                }
+    /* Refresh affected row header */
+    if(detail->col0 < layout.display_col0) {
+        for(j = 0; j < row_span_count; j++) {
+            if(grid_span_extent(&row_spans[j], row0, row1, &y0, &y1)) {
+                mc_set_rect(&rect, 0, y0, layout.display_header_width, y1);
+                grid_invalidate(grid, &rect);
             }
+        }
+    }
 
-            rect.top += grid->cell_height;
-            rect.bottom += grid->cell_height;
+    /* Refresh affected column header */
+    if(detail->row0 < layout.display_row0) {
+        for(i = 0; i < col_span_count; i++) {
+            if(grid_span_extent(&col_spans[i], col0, col1, &x0, &x1)) {
+                mc_set_rect(&rect, x0, 0, x1, layout.display_header_height);
+                grid_invalidate(grid, &rect);
+            }
         }
     }
 
-    /* Paint grid lines */
-    if(!(grid->style & MC_GS_NOGRIDLINES)) {
-        int x;
-        int y;
-        HPEN pen, old_pen;
+    /* Refresh affected contents in each pane */
+    for(j = 0; j < row_span_count; j++) {
+        if(!grid_span_extent(&row_spans[j], row0, row1, &y0, &y1))
+            continue;
+        for(i = 0; i < col_span_count; i++) {
+            if(!grid_span_extent(&col_spans[i], col0, col1, &x0, &x1))
+                continue;
+            mc_set_rect(&rect, x0, y0, x1, y1);
+            grid_invalidate(grid, &rect);
+        }
+    }
+}
 
-        mc_clip_set(dc, client.left, client.top, client.right, client.bottom);
+static BOOL
+grid_regions_touch(const table_region_t* r1, const table_region_t* r2)
+{
+    return (r1->col0 <= r2->col1  &&  r2->col0 <= r1->col1  &&
+            r1->row0 <= r2->row1  &&  r2->row0 <= r1->row1);
+}
 
-        pen = CreatePen(PS_SOLID, 0, grid->gridline_color);
-        old_pen = SelectObject(dc, pen);
+static void
+grid_regions_merge(table_region_t* r, const table_region_t* r2)
+{
+    r->col0 = MC_MIN(r->col0, r2->col0);
+    r->row0 = MC_MIN(r->row0, r2->row0);
+    r->col1 = MC_MAX(r->col1, r2->col1);
+    r->row1 = MC_MAX(r->row1, r2->row1);
+}
 
-        x = headerw + (col0+1) * grid->cell_width - grid->scroll_x - 1;
-        y = headerh + row1 * grid->cell_height - grid->scroll_y - 1;
-        for(col = col0; col < col1; col++) {
-            MoveToEx(dc, x, headerh, NULL);
-            LineTo(dc, x, y);
-            x += grid->cell_width;
-        }
+/* Remembers the changed region until grid_refresh_flush(). Overlapping or
+ * adjacent regions are merged, so a burst of changes in the same area ends
+ * as single region. */
+static void
+grid_refresh_accumulate(grid_t* grid, const table_region_t* detail)
+{
+    table_region_t region;
+    UINT i;
 
-        x = headerw + col1 * grid->cell_width - grid->scroll_x - 1;
-        y = headerh + (row0+1) * grid->cell_height - grid->scroll_y - 1;
-        for(row = row0; row < row1; row++) {
-            MoveToEx(dc, headerw, y, NULL);
-            LineTo(dc, x, y);
-            y += grid->cell_height;
-        }
+    if(grid->refresh_all)
+        return;
 
-        SelectObject(dc, old_pen);
-        DeleteObject(pen);
+    if(detail == NULL) {
+        grid->refresh_all = TRUE;
+        grid->refresh_count = 0;
+        return;
     }
 
-    /* Paint grid cells */
-    rect.top = headerh + row0 * grid->cell_height - grid->scroll_y + grid->cell_padding_vert;
-    for(row = layout.display_row0 + row0; row < layout.display_row0 + row1; row++) {
-        rect.left = headerw + col0 * grid->cell_width - grid->scroll_x + grid->cell_padding_horz;
-        for(col = layout.display_col0 + col0; col < layout.display_col0 + col1; col++) {
-            rect.right = rect.left + grid->cell_width - 2*grid->cell_padding_horz - 1;
-            rect.bottom = rect.top + grid->cell_height - 2*grid->cell_padding_vert - 1;
-
-            mc_clip_set(dc, MC_MAX(headerw, rect.left), MC_MAX(headerh, rect.top),
-                        MC_MIN(rect.right, client.right), MC_MIN(rect.bottom, client.bottom));
-            cell_dc_state = SaveDC(dc);
-            table_paint_cell(grid->table, col, row, dc, &rect);
-            RestoreDC(dc, cell_dc_state);
+    memcpy(&region, detail, sizeof(table_region_t));
 
-            rect.left += grid->cell_width;
+    i = 0;
+    while(i < grid->refresh_count) {
+        if(grid_regions_touch(&grid->refresh_regions[i], &region)) {
+            /* The merged region may touch some of the previous ones now. */
+            grid_regions_merge(&region, &grid->refresh_regions[i]);
+            grid->refresh_regions[i] = grid->refresh_regions[--grid->refresh_count];
+            i = 0;
+        } else {
+            i++;
         }
-        rect.top += grid->cell_height;
     }
 
-    RestoreDC(dc, old_dc_state);
+    if(grid->refresh_count == GRID_MAX_REFRESH_REGIONS) {
+        for(i = 0; i < grid->refresh_count; i++)
+            grid_regions_merge(&region, &grid->refresh_regions[i]);
+        grid->refresh_count = 0;
+    }
+
+    grid->refresh_regions[grid->refresh_count++] = region;
 }
 
 static void
-grid_refresh(void* view, void* detail)
+grid_refresh_flush(grid_t* grid)
 {
-    table_region_t* region = (table_region_t*) detail;
-    grid_t* grid = (grid_t*) view;
-    grid_layout_t layout;
-    WORD headerw, headerh;
-    RECT rect;
+    UINT i;
 
-    if(grid->no_redraw)
-        return;
+    view_sched_flushed(&grid->refresh_sched, grid->win, GRID_REFRESH_TIMER_ID);
 
-    if(region == NULL) {
-        InvalidateRect(grid->win, NULL, TRUE);
-        return;
+    if(grid->refresh_all) {
+        grid_refresh_now(grid, NULL);
+    } else {
+        for(i = 0; i < grid->refresh_count; i++)
+            grid_refresh_now(grid, &grid->refresh_regions[i]);
     }
 
-    grid_calc_layout(grid, &layout);
-    headerw = layout.display_header_width;
-    headerh = layout.display_header_height;
-
-    /* Refresh affected row header */
-    if(region->col0 < layout.display_col0) {
-        rect.left = 0;
-        rect.top = headerh + MC_MAX(0, (region->row0 - layout.display_row0) * grid->cell_height - grid->scroll_y);
-        rect.right = headerw;
-        rect.bottom = rect.top + (region->row1 - region->row0) * grid->cell_height;
-        if(!grid->no_redraw)
-            InvalidateRect(grid->win, &rect, TRUE);
+    grid->refresh_all = FALSE;
+    grid->refresh_count = 0;
+}
 
-        region->col0 = layout.display_col0;
+/* Moves custom row heights along with their rows when rows are inserted or
+ * deleted in the middle of the table. This has to happen right away, even
+ * if the repainting is postponed, as the table reports only the last shift. */
+static void
+grid_shift_row_sizes(grid_t* grid)
+{
+    grid_sizes_t* sizes = &grid->row_sizes;
+    DWORD row = table_shift_row(grid->table);
+    DWORD row_count = table_row_count(grid->table);
+
+    if(row == TABLE_NO_SHIFT) {
+        /* Sizes are kept for the same indexes (e.g. on table_resize()). */
+        grid_sizes_resize(sizes, row_count);
+    } else if(row_count > sizes->count  &&  row <= sizes->count) {
+        grid_sizes_insert(sizes, row, row_count - sizes->count);
+    } else if(row_count < sizes->count  &&  row <= row_count) {
+        grid_sizes_remove(sizes, row, sizes->count - row_count);
+    } else {
+        /* Several batched insertions or deletions: We do not know where the
+         * rows went, so forget their custom heights. */
+        grid_sizes_fini(sizes);
+        sizes->count = row_count;
     }
+}
 
-    /* Refresh affected column header */
-    if(region->row0 < layout.display_row0) {
-        rect.left = headerw + MC_MAX(0, (region->col0 - layout.display_col0) * grid->cell_width - grid->scroll_x);
-        rect.top = 0;
-        rect.right = rect.left + (region->col1 - region->col0) * grid->cell_width;
-        rect.bottom = headerh;
-        InvalidateRect(grid->win, &rect, TRUE);
+static void
+grid_refresh(void* view, void* detail)
+{
+    grid_t* grid = (grid_t*) view;
+
+    grid_shift_row_sizes(grid);
 
-        region->row0 = layout.display_row0;
+    if(grid->refresh_sched.interval == 0  ||  grid->no_redraw) {
+        grid_refresh_now(grid, (table_region_t*) detail);
+        return;
     }
 
-    /* Refresh affected contents */
-    mc_set_rect(&rect,
-                headerw + MC_MAX(0, (region->col0 - layout.display_col0) * grid->cell_width - grid->scroll_x),
-                headerh + MC_MAX(0, (region->row0 - layout.display_row0) * grid->cell_height - grid->scroll_y),
-                rect.left + (region->col1 - region->col0) * grid->cell_width,
-                rect.top + (region->row1 - region->row0) * grid->cell_height);
-    InvalidateRect(grid->win, &rect, TRUE);
+    grid_refresh_accumulate(grid, (table_region_t*) detail);
+    if(view_sched_request(&grid->refresh_sched, grid->win, GRID_REFRESH_TIMER_ID))
+        grid_refresh_flush(grid);
+}
+
+static void
+grid_set_refresh_interval(grid_t* grid, DWORD interval)
+{
+    grid->refresh_sched.interval = interval;
+
+    /* Do not leave anything pending when the rate limiting gets disabled. */
+    if(interval == 0  &&  grid->refresh_sched.timer_pending)
+        grid_refresh_flush(grid);
 }
 
 static void
@@ -392,8 +1426,8 @@ grid_scroll(grid_t* grid, WORD opcode, int factor, BOOL is_vertical)
         GetScrollInfo(grid->win, SB_VERT, &si);
         switch(opcode) {
             case SB_BOTTOM:        grid->scroll_y = si.nMax; break;
-            case SB_LINEUP:        grid->scroll_y -= factor * MC_MIN(MC_MIN(grid->cell_height, 40), si.nPage); break;
-            case SB_LINEDOWN:      grid->scroll_y += factor * MC_MIN(MC_MIN(grid->cell_height, 40), si.nPage); break;
+            case SB_LINEUP:        grid->scroll_y -= factor * MC_MIN(MC_MIN(grid->row_sizes.default_size, 40), si.nPage); break;
+            case SB_LINEDOWN:      grid->scroll_y += factor * MC_MIN(MC_MIN(grid->row_sizes.default_size, 40), si.nPage); break;
             case SB_PAGEUP:        grid->scroll_y -= si.nPage; break;
             case SB_PAGEDOWN:      grid->scroll_y += si.nPage; break;
             case SB_THUMBPOSITION: grid->scroll_y = si.nPos; break;
@@ -413,8 +1447,8 @@ grid_scroll(grid_t* grid, WORD opcode, int factor, BOOL is_vertical)
         GetScrollInfo(grid->win, SB_HORZ, &si);
         switch(opcode) {
             case SB_BOTTOM:        grid->scroll_x = si.nMax; break;
-            case SB_LINELEFT:      grid->scroll_x -= factor * MC_MIN(MC_MIN(grid->cell_width, 40), si.nPage); break;
-            case SB_LINERIGHT:     grid->scroll_x += factor * MC_MIN(MC_MIN(grid->cell_width, 40), si.nPage); break;
+            case SB_LINELEFT:      grid->scroll_x -= factor * MC_MIN(MC_MIN(grid->col_sizes.default_size, 40), si.nPage); break;
+            case SB_LINERIGHT:     grid->scroll_x += factor * MC_MIN(MC_MIN(grid->col_sizes.default_size, 40), si.nPage); break;
             case SB_PAGELEFT:      grid->scroll_x -= si.nPage; break;
             case SB_PAGERIGHT:     grid->scroll_x += si.nPage; break;
             case SB_THUMBPOSITION: grid->scroll_x = si.nPos; break;
@@ -432,6 +1466,8 @@ grid_scroll(grid_t* grid, WORD opcode, int factor, BOOL is_vertical)
         SetScrollPos(grid->win, SB_HORZ, grid->scroll_x, TRUE);
     }
 
+    grid_update_interest(grid);
+
     if(!grid->no_redraw) {
         grid_layout_t layout;
         RECT rect;
@@ -439,13 +1475,18 @@ grid_scroll(grid_t* grid, WORD opcode, int factor, BOOL is_vertical)
         grid_calc_layout(grid, &layout);
         GetClientRect(grid->win, &rect);
         if(is_vertical)
-            rect.top = layout.display_header_height;
+            rect.top = MC_MIN(layout.display_header_height + layout.frozen_height, rect.bottom);
         else
-            rect.left = layout.display_header_width;
+            rect.left = MC_MIN(layout.display_header_width + layout.frozen_width, rect.right);
 
+        /* Only the newly exposed strip of the scrolling pane is rendered,
+         * the rest is reused. Headers and frozen panes out of the rect are
+         * not touched at all. */
+        grid_buffer_scroll(grid, old_scroll_x - grid->scroll_x,
+                           old_scroll_y - grid->scroll_y, &rect);
         ScrollWindowEx(grid->win, old_scroll_x - grid->scroll_x,
                        old_scroll_y - grid->scroll_y, &rect, &rect, NULL, NULL,
-                       SW_ERASE | SW_INVALIDATE);
+                       SW_INVALIDATE);
     }
 }
 
@@ -456,6 +1497,14 @@ grid_setup_scrollbars(grid_t* grid)
     RECT rect;
     SCROLLINFO si;
 
+    grid->sb_col_count = (grid->table ? table_col_count(grid->table) : 0);
+    grid->sb_row_count = (grid->table ? table_row_count(grid->table) : 0);
+
+    /* Sizes of columns and rows are kept for the same indexes: New ones get
+     * the default size, sizes of removed ones are forgotten. */
+    grid_sizes_resize(&grid->col_sizes, grid->sb_col_count);
+    grid_sizes_resize(&grid->row_sizes, grid->sb_row_count);
+
     grid_calc_layout(grid, &layout);
     GetClientRect(grid->win, &rect);
 
@@ -463,8 +1512,12 @@ grid_setup_scrollbars(grid_t* grid)
     si.fMask = SIF_RANGE | SIF_PAGE;
     si.nMin = 0;
 
+    /* Scrolling works in pixels and the scrollbar range is limited to the
+     * int range. Huge tables are therefore clamped (with default geometry
+     * it still allows about 100 millions of rows). */
+
     /* Setup horizontal scrollbar */
-    si.nMax = layout.display_col_count * grid->cell_width;
+    si.nMax = (int) MC_MIN(grid_col_x(grid, &layout, layout.display_col_count), INT_MAX);
     si.nPage = mc_width(&rect) - layout.display_header_width;
     grid->scroll_x = SetScrollInfo(grid->win, SB_HORZ, &si, TRUE);
 
@@ -474,14 +1527,18 @@ grid_setup_scrollbars(grid_t* grid)
     GetClientRect(grid->win, &rect);
 
     /* Setup vertical scrollbar */
-    si.nMax = layout.display_row_count * grid->cell_height;
+    si.nMax = (int) MC_MIN(grid_row_y(grid, &layout, layout.display_row_count), INT_MAX);
     si.nPage = mc_height(&rect) - layout.display_header_height;
     grid->scroll_y = SetScrollInfo(grid->win, SB_VERT, &si, TRUE);
+
+    grid_update_interest(grid);
 }
 
 static int
 grid_set_table(grid_t* grid, table_t* table)
 {
+    int view = -1;
+
     if(table != NULL  &&  table == grid->table)
         return 0;
 
@@ -496,22 +1553,47 @@ grid_set_table(grid_t* grid, table_t* table)
     }
 
     if(table != NULL) {
-        if(MC_ERR(table_install_view(table, grid, grid_refresh)) != 0) {
+        view = table_install_view(table, grid, grid_refresh);
+        if(MC_ERR(view < 0)) {
             MC_TRACE("grid_set_table: table_install_view() failed.");
             table_unref(table);
             return -1;
         }
+        if(MC_ERR(table_set_post_window(table, grid->win) != 0)) {
+            MC_TRACE("grid_set_table: table_set_post_window() failed.");
+            table_uninstall_view(table, view);
+            table_unref(table);
+            return -1;
+        }
     }
 
     if(grid->table != NULL) {
-        table_uninstall_view(grid->table, grid);
+        /* Resetting the post window may process the posted cells and
+         * refresh the views, so uninstall our view first. */
+        table_uninstall_view(grid->table, grid->table_view);
+        table_reset_post_window(grid->table, grid->win);
         table_unref(grid->table);
     }
 
     grid->table = table;
+    grid->table_view = view;
+    if(table != NULL) {
+        /* Until the layout is set up for the new table, we want to know
+         * about everything. */
+        grid->interest.region.col0 = 0;
+        grid->interest.region.row0 = 0;
+        grid->interest.region.col1 = (DWORD) -1;
+        grid->interest.region.row1 = (DWORD) -1;
+        grid->interest.skipped = 0;
+        table_set_view_interest(table, view, &grid->interest);
+    }
+
+    /* Changes of the old table pending for refresh are out of interest. */
+    grid->refresh_all = FALSE;
+    grid->refresh_count = 0;
 
     if(!grid->no_redraw) {
-        InvalidateRect(grid->win, NULL, TRUE);
+        grid_invalidate(grid, NULL);
         grid_setup_scrollbars(grid);
     }
     return 0;
@@ -539,9 +1621,9 @@ grid_set_geometry(grid_t* grid, MC_GGEOMETRY* geom, BOOL invalidate)
         if(geom->fMask & MC_GGF_ROWHEADERWIDTH)
             grid->header_width = geom->wRowHeaderWidth;
         if(geom->fMask & MC_GGF_COLUMNWIDTH)
-            grid->cell_width = geom->wColumnWidth;
+            grid_sizes_set_default(&grid->col_sizes, geom->wColumnWidth);
         if(geom->fMask & MC_GGF_ROWHEIGHT)
-            grid->cell_height = geom->wRowHeight;
+            grid_sizes_set_default(&grid->row_sizes, geom->wRowHeight);
         if(geom->fMask & MC_GGF_PADDINGHORZ)
             grid->cell_padding_horz = geom->wPaddingHorz;
         if(geom->fMask & MC_GGF_PADDINGVERT)
@@ -553,8 +1635,8 @@ grid_set_geometry(grid_t* grid, MC_GGEOMETRY* geom, BOOL invalidate)
 
         grid->header_width = 4 * size.cx + 2 * PADDING_H + 1;
         grid->header_height = size.cy + 2 * PADDING_V + 1;
-        grid->cell_width = 8 * size.cx + 2 * PADDING_H + 1;
-        grid->cell_height = size.cy + 2 * PADDING_V + 1;
+        grid_sizes_set_default(&grid->col_sizes, 8 * size.cx + 2 * PADDING_H + 1);
+        grid_sizes_set_default(&grid->row_sizes, size.cy + 2 * PADDING_V + 1);
         grid->cell_padding_horz = PADDING_H;
         grid->cell_padding_vert = PADDING_V;
     }
@@ -562,7 +1644,7 @@ grid_set_geometry(grid_t* grid, MC_GGEOMETRY* geom, BOOL invalidate)
     if(!grid->no_redraw) {
         grid_setup_scrollbars(grid);
         if(invalidate)
-            InvalidateRect(grid->win, NULL, TRUE);
+            grid_invalidate(grid, NULL);
     }
 
     return 0;
@@ -584,9 +1666,9 @@ grid_get_geometry(grid_t* grid, MC_GGEOMETRY* geom)
     if(geom->fMask & MC_GGF_ROWHEADERWIDTH)
         geom->wRowHeaderWidth = grid->header_width;
     if(geom->fMask & MC_GGF_COLUMNWIDTH)
-        geom->wColumnWidth = grid->cell_width;
+        geom->wColumnWidth = grid->col_sizes.default_size;
     if(geom->fMask & MC_GGF_ROWHEIGHT)
-        geom->wRowHeight = grid->cell_height;
+        geom->wRowHeight = grid->row_sizes.default_size;
     if(geom->fMask & MC_GGF_PADDINGHORZ)
         geom->wPaddingHorz = grid->cell_padding_horz;
     if(geom->fMask & MC_GGF_PADDINGVERT)
@@ -595,6 +1677,159 @@ grid_get_geometry(grid_t* grid, MC_GGEOMETRY* geom)
     return 0;
 }
 
+static int
+grid_set_size(grid_t* grid, BOOL is_col, DWORD index, WORD size)
+{
+    grid_sizes_t* sizes = (is_col ? &grid->col_sizes : &grid->row_sizes);
+    grid_layout_t layout;
+    grid_span_t spans[2];
+    grid_span_t* span;
+    int span_count;
+    DWORD count = 0;
+    int old_scroll_x = grid->scroll_x;
+    int old_scroll_y = grid->scroll_y;
+    RECT rect;
+    LONG pos;
+
+    GRID_TRACE("grid_set_size(%p, %d, %lu, %u)", grid, is_col, (ULONG)index, (UINT)size);
+
+    if(grid->table != NULL)
+        count = (is_col ? table_col_count(grid->table) : table_row_count(grid->table));
+    if(MC_ERR(index >= count)) {
+        MC_TRACE("grid_set_size: Index %lu out of range.", (ULONG)index);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    /* The table might have been resized while we were not redrawing. */
+    grid_sizes_resize(sizes, count);
+
+    if(MC_ERR(grid_sizes_set(sizes, index, size) != 0)) {
+        MC_TRACE("grid_set_size: grid_sizes_set() failed.");
+        return -1;
+    }
+
+    if(grid->no_redraw)
+        return 0;
+
+    grid_setup_scrollbars(grid);
+    if(grid->scroll_x != old_scroll_x  ||  grid->scroll_y != old_scroll_y) {
+        grid_invalidate(grid, NULL);
+        return 0;
+    }
+
+    /* Only the column (or row) and everything after it moves. (If it is
+     * frozen, the whole scrolling pane moves too.) */
+    grid_calc_layout(grid, &layout);
+    GetClientRect(grid->win, &rect);
+    span_count = grid_spans(grid, &layout, &rect, is_col, spans);
+    if(index < spans[0].display0)
+        return 0;   /* Custom header has the width of the header. */
+    index -= spans[0].display0;
+    span = &spans[span_count - 1];
+    if(index < span->index0)
+        span = &spans[0];
+    pos = MC_MAX(span->pos0, grid_span_pos(span, index));
+    if(is_col)
+        rect.left = pos;
+    else
+        rect.top = pos;
+    grid_invalidate(grid, &rect);
+    return 0;
+}
+
+static LRESULT
+grid_get_size(grid_t* grid, BOOL is_col, DWORD index)
+{
+    DWORD count = 0;
+
+    if(grid->table != NULL)
+        count = (is_col ? table_col_count(grid->table) : table_row_count(grid->table));
+    if(MC_ERR(index >= count)) {
+        MC_TRACE("grid_get_size: Index %lu out of range.", (ULONG)index);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    return grid_sizes_get(is_col ? &grid->col_sizes : &grid->row_sizes, index);
+}
+
+static void
+grid_set_frozen_count(grid_t* grid, DWORD cols, DWORD rows)
+{
+    GRID_TRACE("grid_set_frozen_count(%p, %lu, %lu)", grid, (ULONG)cols, (ULONG)rows);
+
+    if(cols == grid->frozen_cols  &&  rows == grid->frozen_rows)
+        return;
+
+    grid->frozen_cols = cols;
+    grid->frozen_rows = rows;
+
+    if(!grid->no_redraw) {
+        grid_setup_scrollbars(grid);
+        grid_invalidate(grid, NULL);
+    }
+}
+
+static BOOL
+grid_hit_test(grid_t* grid, MC_GHITTESTINFO* info)
+{
+    grid_layout_t layout;
+    RECT client;
+    int x = info->pt.x;
+    int y = info->pt.y;
+    DWORD col, row;
+
+    grid_calc_layout(grid, &layout);
+    GetClientRect(grid->win, &client);
+
+    info->flags = 0;
+    info->dwCol = (DWORD) -1;
+    info->dwRow = (DWORD) -1;
+
+    if(!mc_contains(&client, &info->pt))
+        goto nowhere;
+
+    if(x < layout.display_header_width) {
+        info->flags |= MC_GHT_ONROWHEADER;
+        if(layout.display_col0 > 0)
+            info->dwCol = 0;
+    } else {
+        /* Frozen columns do not scroll. */
+        if(x < layout.display_header_width + layout.frozen_width)
+            col = grid_col_at(grid, &layout, (UINT64)(x - layout.display_header_width));
+        else
+            col = grid_col_at(grid, &layout, (UINT64)grid->scroll_x + (x - layout.display_header_width));
+        if(col >= layout.display_col_count)
+            goto nowhere;
+        info->dwCol = layout.display_col0 + col;
+    }
+
+    if(y < layout.display_header_height) {
+        info->flags |= MC_GHT_ONCOLUMNHEADER;
+        if(layout.display_row0 > 0)
+            info->dwRow = 0;
+    } else {
+        if(y < layout.display_header_height + layout.frozen_height)
+            row = grid_row_at(grid, &layout, (UINT64)(y - layout.display_header_height));
+        else
+            row = grid_row_at(grid, &layout, (UINT64)grid->scroll_y + (y - layout.display_header_height));
+        if(row >= layout.display_row_count)
+            goto nowhere;
+        info->dwRow = layout.display_row0 + row;
+    }
+
+    if(info->flags == 0)
+        info->flags = MC_GHT_ONCELL;
+    return TRUE;
+
+nowhere:
+    info->flags = MC_GHT_NOWHERE;
+    info->dwCol = (DWORD) -1;
+    info->dwRow = (DWORD) -1;
+    return FALSE;
+}
+
 static void
 grid_style_changed(grid_t* grid, int style_type, STYLESTRUCT* ss)
 {
@@ -603,7 +1838,8 @@ grid_style_changed(grid_t* grid, int style_type, STYLESTRUCT* ss)
 
     if(!grid->no_redraw) {
         grid_setup_scrollbars(grid);
-        RedrawWindow(grid->win, NULL, NULL, RDW_INVALIDATE | RDW_FRAME | RDW_ERASE);
+        grid_buffer_invalidate(grid, NULL);
+        RedrawWindow(grid->win, NULL, NULL, RDW_INVALIDATE | RDW_FRAME);
     }
 }
 
@@ -624,9 +1860,15 @@ grid_theme_changed(grid_t* grid)
         theme_CloseThemeData(theme_lv);
     }
 
+    if(grid->gridline_pen)
+        DeleteObject(grid->gridline_pen);
+    grid->gridline_pen = CreatePen(PS_SOLID, 0, grid->gridline_color);
+    if(MC_ERR(grid->gridline_pen == NULL))
+        MC_TRACE("grid_theme_changed: CreatePen() failed.");
+
     if(!grid->no_redraw) {
         grid_setup_scrollbars(grid);
-        InvalidateRect(grid->win, NULL, TRUE);
+        grid_invalidate(grid, NULL);
     }
 }
 
@@ -645,11 +1887,30 @@ grid_nccreate(HWND win, CREATESTRUCT* cs)
     grid->theme = NULL;
     grid->font = NULL;
     grid->table = NULL;
+    grid->table_view = -1;
     grid->style = cs->style;
     grid->no_redraw = 0;
     grid->scroll_x = 0;
     grid->scroll_y = 0;
+    grid->frozen_cols = 0;
+    grid->frozen_rows = 0;
     grid->gridline_color = DEFAULT_GRIDLINE_COLOR;
+    grid->gridline_pen = NULL;
+    grid_sizes_init(&grid->col_sizes, 0);
+    grid_sizes_init(&grid->row_sizes, 0);
+    grid->buffer_dc = NULL;
+    grid->buffer_bmp = NULL;
+    grid->buffer_old_bmp = NULL;
+    grid->buffer_dirty = NULL;
+    grid->buffer_width = 0;
+    grid->buffer_height = 0;
+    view_sched_init(&grid->refresh_sched);
+    grid->refresh_all = FALSE;
+    grid->refresh_count = 0;
+#ifdef GRID_DEBUG
+    grid->fps_tick = 0;
+    grid->fps_frames = 0;
+#endif
 
     grid_set_geometry(grid, NULL, FALSE);
 
@@ -677,8 +1938,17 @@ grid_destroy(grid_t* grid)
         grid->theme = NULL;
     }
 
+    if(grid->gridline_pen) {
+        DeleteObject(grid->gridline_pen);
+        grid->gridline_pen = NULL;
+    }
+
+    grid_buffer_free(grid);
+
     if(grid->table) {
-        table_uninstall_view(grid->table, grid);
+        /* See grid_set_table(). */
+        table_uninstall_view(grid->table, grid->table_view);
+        table_reset_post_window(grid->table, grid->win);
         table_unref(grid->table);
         grid->table = NULL;
     }
@@ -687,6 +1957,8 @@ grid_destroy(grid_t* grid)
 static inline void
 grid_ncdestroy(grid_t* grid)
 {
+    grid_sizes_fini(&grid->col_sizes);
+    grid_sizes_fini(&grid->row_sizes);
     free(grid);
 }
 
@@ -708,20 +1980,26 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
 
                 if(wp == 0) {
                     BeginPaint(win, &ps);
+                    grid_paint_buffered(grid, ps.hdc, &ps.rcPaint);
+                    EndPaint(win, &ps);
                 } else {
-                    ps.hdc = (HDC) wp;
                     GetClientRect(win, &ps.rcPaint);
+                    grid_paint(grid, (HDC) wp, &ps.rcPaint);
                 }
-                grid_paint(grid, ps.hdc, &ps.rcPaint);
-                if(wp == 0)
-                    EndPaint(win, &ps);
             }
             return 0;
 
+        case WM_ERASEBKGND:
+            /* Background is erased in grid_paint(). */
+            return TRUE;
+
         case WM_SETREDRAW:
             grid->no_redraw = !wp;
-            if(!grid->no_redraw)
+            if(!grid->no_redraw) {
+                /* We have not tracked what changed in the meantime. */
+                grid_buffer_invalidate(grid, NULL);
                 grid_setup_scrollbars(grid);
+            }
             return 0;
 
         case MC_GM_GETTABLE:
@@ -731,14 +2009,17 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
             return (grid_set_table(grid, (table_t*) lp) == 0 ? TRUE : FALSE);
 
         case MC_GM_GETCOLUMNCOUNT:
-            return mcTable_ColumnCount(grid->table);
+            return mcTable_ColumnCountEx(grid->table);
 
         case MC_GM_GETROWCOUNT:
-            return mcTable_RowCount(grid->table);
+            return mcTable_RowCountEx(grid->table);
 
         case MC_GM_RESIZE:
             return mcTable_Resize(grid->table, LOWORD(wp), HIWORD(wp));
 
+        case MC_GM_RESIZEEX:
+            return mcTable_ResizeEx(grid->table, (DWORD)wp, (DWORD)lp);
+
         case MC_GM_CLEAR:
             mcTable_Clear(grid->table);
             return 0;
@@ -757,12 +2038,75 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
                                    &cell->hType, &cell->hValue);
         }
 
+        case MC_GM_SETCELLEX:
+        {
+            MC_GCELLEX* cell = (MC_GCELLEX*) lp;
+            MC_TABLECELL tc;
+
+            tc.fMask = MC_TCM_VALUE;
+            tc.hType = cell->hType;
+            tc.hValue = cell->hValue;
+            return mcTable_SetCellEx2(grid->table, cell->dwCol, cell->dwRow, &tc);
+        }
+
+        case MC_GM_GETCELLEX:
+        {
+            MC_GCELLEX* cell = (MC_GCELLEX*) lp;
+            MC_TABLECELL tc;
+
+            tc.fMask = MC_TCM_VALUE;
+            if(MC_ERR(!mcTable_GetCellEx2(grid->table, cell->dwCol, cell->dwRow, &tc)))
+                return FALSE;
+            cell->hType = tc.hType;
+            cell->hValue = tc.hValue;
+            return TRUE;
+        }
+
         case MC_GM_SETGEOMETRY:
             return (grid_set_geometry(grid, (MC_GGEOMETRY*)lp, TRUE) == 0 ? TRUE : FALSE);
 
         case MC_GM_GETGEOMETRY:
             return (grid_get_geometry(grid, (MC_GGEOMETRY*)lp) == 0 ? TRUE : FALSE);
 
+        case TABLE_WM_PROCESSPOSTED:
+            /* The table may have been replaced since the message was posted. */
+            if((table_t*) lp == grid->table)
+                table_process_posted(grid->table);
+            return 0;
+
+        case MC_GM_SETCOLUMNWIDTH:
+            return (grid_set_size(grid, TRUE, (DWORD)wp, LOWORD(lp)) == 0 ? TRUE : FALSE);
+
+        case MC_GM_GETCOLUMNWIDTH:
+            return grid_get_size(grid, TRUE, (DWORD)wp);
+
+        case MC_GM_SETROWHEIGHT:
+            return (grid_set_size(grid, FALSE, (DWORD)wp, LOWORD(lp)) == 0 ? TRUE : FALSE);
+
+        case MC_GM_GETROWHEIGHT:
+            return grid_get_size(grid, FALSE, (DWORD)wp);
+
+        case MC_GM_HITTEST:
+            return grid_hit_test(grid, (MC_GHITTESTINFO*) lp);
+
+        case MC_GM_SETREFRESHINTERVAL:
+            grid_set_refresh_interval(grid, (DWORD) wp);
+            return 0;
+
+        case MC_GM_GETREFRESHINTERVAL:
+            return grid->refresh_sched.interval;
+
+        case MC_GM_SETFROZENCOUNT:
+            grid_set_frozen_count(grid, (DWORD) wp, (DWORD) lp);
+            return 0;
+
+        case MC_GM_GETFROZENCOUNT:
+            if(wp != 0)
+                *((DWORD*) wp) = grid->frozen_cols;
+            if(lp != 0)
+                *((DWORD*) lp) = grid->frozen_rows;
+            return 0;
+
         case WM_VSCROLL:
         case WM_HSCROLL:
             grid_scroll(grid, LOWORD(wp), 1, (msg == WM_VSCROLL));
@@ -779,6 +2123,17 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
         }
 
         case WM_SIZE:
+            /* Parts of the back buffer out of the client area have not
+             * been kept up to date. */
+            if(grid->buffer_dc != NULL) {
+                RECT rect;
+
+                mc_set_rect(&rect, LOWORD(lp), 0, grid->buffer_width, grid->buffer_height);
+                grid_buffer_invalidate(grid, &rect);
+                mc_set_rect(&rect, 0, HIWORD(lp), grid->buffer_width, grid->buffer_height);
+                grid_buffer_invalidate(grid, &rect);
+            }
+
             if(!grid->no_redraw) {
                 int old_scroll_x = grid->scroll_x;
                 int old_scroll_y = grid->scroll_y;
@@ -786,7 +2141,7 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
                 grid_setup_scrollbars(grid);
 
                 if(grid->scroll_x != old_scroll_x  ||  grid->scroll_y != old_scroll_y)
-                    InvalidateRect(win, NULL, TRUE);
+                    grid_invalidate(grid, NULL);
             }
             return 0;
 
@@ -795,15 +2150,26 @@ grid_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
 
         case WM_SETFONT:
             grid->font = (HFONT) wp;
+            if(grid->font != NULL)
+                textcache_invalidate(grid->font);
+            grid_buffer_invalidate(grid, NULL);
             if((BOOL) lp  &&  !grid->no_redraw)
-                InvalidateRect(win, NULL, TRUE);
+                InvalidateRect(win, NULL, FALSE);
             return 0;
 
         case WM_STYLECHANGED:
             grid_style_changed(grid, wp, (STYLESTRUCT*) lp);
             return 0;
 
+        case WM_TIMER:
+            if(wp == GRID_REFRESH_TIMER_ID) {
+                grid_refresh_flush(grid);
+                return 0;
+            }
+            break;
+
         case WM_THEMECHANGED:
+            textcache_invalidate(NULL);
             grid_theme_changed(grid);
             return 0;
 
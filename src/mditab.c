@@ -19,6 +19,7 @@
 #include "mditab.h"
 #include "dsa.h"
 #include "theme.h"
+#include "textcache.h"
 
 /* TODO:
  *
@@ -89,6 +90,9 @@ static const TCHAR toolbar_wc[] = TOOLBARCLASSNAME;
 #define IDC_LIST_ITEMS              202
 #define IDC_CLOSE_ITEM              203
 
+/* Tabs are indexed with WORD, so there can be no more of them. */
+#define MDITAB_MAX_COUNT         0xffff
+
 
 /* Per-tab structure */
 typedef struct mditab_item_tag mditab_item_t;
@@ -134,7 +138,7 @@ mditab_item(mditab_t* mditab, WORD index)
 static inline WORD
 mditab_count(mditab_t* mditab)
 {
-    return dsa_size(&mditab->item_dsa);
+    return (WORD) dsa_size(&mditab->item_dsa);
 }
 
 static void
@@ -599,7 +603,7 @@ mditab_paint_item(mditab_t* mditab, HDC dc, UINT index)
     } else {
         if(index == mditab->item_selected)
             contents.bottom -= 2;
-        DrawText(dc, item->text, -1, &contents, flags | DT_SINGLELINE | DT_VCENTER);
+        textcache_draw(dc, item->text, -1, &contents, flags | DT_SINGLELINE | DT_VCENTER);
     }
 }
 
@@ -709,6 +713,11 @@ mditab_insert_item(mditab_t* mditab, int index, MC_MTITEM* id, BOOL unicode)
     }
     if(index > mditab_count(mditab))
         index = mditab_count(mditab);
+    if(MC_ERR(mditab_count(mditab) >= MDITAB_MAX_COUNT)) {
+        MC_TRACE("mditab_insert_item: Too many tabs.");
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
 
     /* Preallocate the string now, so we can stop early if there is not
      * enough memory. */
@@ -1442,6 +1451,8 @@ mditab_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
             return (LRESULT) mditab_get_item_width(win, (MC_MTITEMWIDTH*)lp);
 
         case MC_MTM_INITSTORAGE:
+            /* Reserving beyond the maximal count would be a waste. */
+            wp = MC_MIN((UINT)wp, MDITAB_MAX_COUNT - mditab_count(mditab));
             return (dsa_reserve(&mditab->item_dsa, (UINT)wp) == 0 ? TRUE : FALSE);
 
         case WM_LBUTTONDOWN:
@@ -1502,6 +1513,8 @@ mditab_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
 
         case WM_SETFONT:
             mditab->font = (HFONT) wp;
+            if(mditab->font != NULL)
+                textcache_invalidate(mditab->font);
             if((BOOL) lp  &&  !mditab->no_redraw)
                 InvalidateRect(win, NULL, TRUE);
             return 0;
@@ -1528,6 +1541,7 @@ mditab_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
             return 0;
 
         case WM_THEMECHANGED:
+            textcache_invalidate(NULL);
             mditab_theme_changed(mditab);
             return 0;
 
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <malloc.h>
 #include <tchar.h>
 #include <windows.h>
 #include <commctrl.h>
@@ -219,7 +220,7 @@ mc_unref(mc_ref_t* i)
 {
 #if defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40700
     /* See http://stackoverflow.com/questions/10268737/c11-atomics-and-intrusive-shared-pointer-reference-count */
-    mc_ref_t ref = __atomic_add_fetch(i, 1, __ATOMIC_RELEASE);
+    mc_ref_t ref = __atomic_sub_fetch(i, 1, __ATOMIC_RELEASE);
     if(ref == 0)
         __atomic_thread_fence(__ATOMIC_ACQUIRE);
     return ref;
@@ -233,6 +234,53 @@ mc_unref(mc_ref_t* i)
 }
 
 
+/*********************************
+ *** Atomic pointer operations ***
+ *********************************/
+
+/* All these act as full memory barriers. */
+
+static inline void*
+mc_atomic_load_ptr(void* volatile* ptr)
+{
+#if defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40700
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#elif defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40100
+    return __sync_val_compare_and_swap(ptr, NULL, NULL);
+#else
+    return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#endif
+}
+
+static inline void*
+mc_atomic_xchg_ptr(void* volatile* ptr, void* val)
+{
+#if defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40700
+    return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+#elif defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40100
+    /* __sync_lock_test_and_set() is only an acquire barrier. */
+    __sync_synchronize();
+    return __sync_lock_test_and_set(ptr, val);
+#else
+    return InterlockedExchangePointer(ptr, val);
+#endif
+}
+
+/* Sets *ptr to val if it is equal to expected. Returns TRUE if it was. */
+static inline BOOL
+mc_atomic_cas_ptr(void* volatile* ptr, void* expected, void* val)
+{
+#if defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40700
+    return __atomic_compare_exchange_n(ptr, &expected, val, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40100
+    return __sync_bool_compare_and_swap(ptr, expected, val);
+#else
+    return (InterlockedCompareExchangePointer(ptr, val, expected) == expected);
+#endif
+}
+
+
 /*************************
  *** Utility functions ***
  *************************/
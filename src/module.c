@@ -154,6 +154,9 @@ DEFINE_MODULE(mditab)
 #include "propview.h"
 DEFINE_MODULE(propview)
 
+#include "textcache.h"
+DEFINE_MODULE(textcache)
+
 #include "theme.h"
 DEFINE_MODULE(theme)
 
@@ -163,7 +166,7 @@ DEFINE_MODULE(theme)
 static module_t* mod_button_deps[] = { &mod_mc, &mod_theme, &mod_button };
 DEFINE_PUBLIC_IFACE(button, Button, mod_button_deps)
 
-static module_t* mod_grid_deps[] =   { &mod_mc, &mod_theme, &mod_grid };
+static module_t* mod_grid_deps[] =   { &mod_mc, &mod_theme, &mod_textcache, &mod_grid };
 DEFINE_PUBLIC_IFACE(grid, Grid, mod_grid_deps)
 
 static module_t* mod_html_deps[] =   { &mod_mc, &mod_theme, &mod_html };
@@ -172,8 +175,8 @@ DEFINE_PUBLIC_IFACE(html, Html, mod_html_deps)
 static module_t* mod_menubar_deps[] = { &mod_mc, &mod_menubar };
 DEFINE_PUBLIC_IFACE(menubar, Menubar, mod_menubar_deps)
 
-static module_t* mod_mditab_deps[] = { &mod_mc, &mod_theme, &mod_mditab };
+static module_t* mod_mditab_deps[] = { &mod_mc, &mod_theme, &mod_textcache, &mod_mditab };
 DEFINE_PUBLIC_IFACE(mditab, Mditab, mod_mditab_deps)
 
-static module_t* mod_propview_deps[] = { &mod_mc, &mod_theme, &mod_propview };
+static module_t* mod_propview_deps[] = { &mod_mc, &mod_theme, &mod_textcache, &mod_propview };
 DEFINE_PUBLIC_IFACE(propview, PropView, mod_propview_deps)
@@ -49,8 +49,239 @@ propset_item_cmp(dsa_t* dsa, const void* dsa_item1, const void* dsa_item2)
     const propset_item_t* item1 = (propset_item_t*) dsa_item1;
     const propset_item_t* item2 = (propset_item_t*) dsa_item2;
 
-    return _tcsicmp((item1->text != NULL ? item1->text : _T("")),
-                    (item2->text != NULL ? item2->text : _T("")));
+    /* Same order as _tcsicmp() on the texts, without folding them again on
+     * every comparison. */
+    return _tcscmp((item1->key != NULL ? item1->key : _T("")),
+                   (item2->key != NULL ? item2->key : _T("")));
+}
+
+/* Appends the sort key of the text (its case-folded copy) into the text
+ * buffer, right behind the text, so both are freed together. Returns the
+ * reallocated buffer, or NULL on failure (the text is then freed). */
+static TCHAR*
+propset_text_with_key(TCHAR* text, TCHAR** key)
+{
+    size_t len = _tcslen(text);
+    TCHAR* buffer;
+    size_t i;
+
+    buffer = (TCHAR*) realloc(text, (2 * len + 2) * sizeof(TCHAR));
+    if(MC_ERR(buffer == NULL)) {
+        MC_TRACE("propset_text_with_key: realloc() failed.");
+        free(text);
+        return NULL;
+    }
+
+    *key = buffer + len + 1;
+    for(i = 0; i <= len; i++)
+        (*key)[i] = (TCHAR) _totlower((_TUCHAR) buffer[i]);
+    return buffer;
+}
+
+/* Min. count of slots in the hash index (see propset_index_t). */
+#define PROPSET_INDEX_MINSIZE    16
+
+static UINT
+propset_index_hash(const TCHAR* key)
+{
+    /* FNV-1a */
+    UINT hash = 2166136261U;
+
+    if(key != NULL) {
+        while(*key != _T('\0')) {
+            hash ^= (UINT) *key++;
+            hash *= 16777619U;
+        }
+    }
+    return hash;
+}
+
+static inline propset_index_entry_t*
+propset_index_entry(propset_index_t* index, DWORD i)
+{
+    return (propset_index_entry_t*) dsa_item_(&index->entries, i, sizeof(propset_index_entry_t));
+}
+
+static inline BOOL
+propset_index_key_equal(propset_t* propset, DWORD i, const TCHAR* key)
+{
+    const TCHAR* item_key = propset_item(propset, i)->key;
+
+    return (_tcscmp((item_key != NULL ? item_key : _T("")),
+                    (key != NULL ? key : _T(""))) == 0);
+}
+
+/* Returns the slot holding the chain of items with the key, or the empty
+ * slot where such chain would start. */
+static DWORD
+propset_index_slot(propset_t* propset, const TCHAR* key, UINT hash)
+{
+    propset_index_t* index = &propset->index;
+    DWORD mask = index->capacity - 1;
+    DWORD slot = hash & mask;
+    DWORD i;
+
+    while(index->slots[slot] != 0) {
+        i = index->slots[slot] - 1;
+        if(propset_index_entry(index, i)->hash == hash  &&
+           propset_index_key_equal(propset, i, key))
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void
+propset_index_init(propset_index_t* index)
+{
+    index->slots = NULL;
+    index->capacity = 0;
+    dsa_init(&index->entries, sizeof(propset_index_entry_t));
+    index->dirty = TRUE;
+}
+
+static void
+propset_index_fini(propset_index_t* index)
+{
+    if(index->slots != NULL)
+        free(index->slots);
+    dsa_fini(&index->entries, NULL);
+}
+
+static inline void
+propset_index_invalidate(propset_t* propset)
+{
+    propset->index.dirty = TRUE;
+}
+
+static int
+propset_index_rebuild(propset_t* propset)
+{
+    propset_index_t* index = &propset->index;
+    DWORD n = propset_size(propset);
+    DWORD capacity;
+    DWORD slot;
+    DWORD i;
+    propset_index_entry_t* entry;
+    const TCHAR* key;
+
+    PROPSET_TRACE("propset_index_rebuild(%p)", propset);
+
+    /* Keep the load factor at most 1/2. */
+    capacity = PROPSET_INDEX_MINSIZE;
+    while(capacity < 2 * n) {
+        if(MC_ERR(capacity > ((DWORD)-1) / sizeof(DWORD) / 2)) {
+            MC_TRACE("propset_index_rebuild: Too many items.");
+            return -1;
+        }
+        capacity *= 2;
+    }
+
+    if(capacity != index->capacity) {
+        DWORD* slots;
+
+        slots = (DWORD*) malloc(capacity * sizeof(DWORD));
+        if(MC_ERR(slots == NULL)) {
+            MC_TRACE("propset_index_rebuild: malloc() failed.");
+            return -1;
+        }
+        if(index->slots != NULL)
+            free(index->slots);
+        index->slots = slots;
+        index->capacity = capacity;
+    }
+    memset(index->slots, 0, index->capacity * sizeof(DWORD));
+
+    dsa_clear(&index->entries, NULL);
+    if(MC_ERR(dsa_reserve(&index->entries, n) != 0)) {
+        MC_TRACE("propset_index_rebuild: dsa_reserve() failed.");
+        return -1;
+    }
+
+    /* Go from the end, so prepending to the chains keeps them ordered. */
+    for(i = 0; i < n; i++)
+        dsa_insert_raw(&index->entries, i);
+    for(i = n; i > 0; i--) {
+        key = propset_item(propset, i-1)->key;
+        entry = propset_index_entry(index, i-1);
+        entry->hash = propset_index_hash(key);
+        slot = propset_index_slot(propset, key, entry->hash);
+        entry->next = index->slots[slot];
+        index->slots[slot] = i;
+    }
+
+    index->dirty = FALSE;
+    return 0;
+}
+
+/* Called after an item has been inserted. */
+static void
+propset_index_inserted(propset_t* propset, DWORD i)
+{
+    propset_index_t* index = &propset->index;
+    propset_index_entry_t* entry;
+    const TCHAR* key;
+    DWORD slot;
+
+    if(index->dirty)
+        return;
+
+    /* Only appending (as when populating the set) does not shift indexes of
+     * other items. Also rebuild when the table gets too full. */
+    if(i != dsa_size(&index->entries)  ||  2 * (i+1) > index->capacity) {
+        propset_index_invalidate(propset);
+        return;
+    }
+
+    entry = (propset_index_entry_t*) dsa_insert_raw(&index->entries, i);
+    if(MC_ERR(entry == NULL)) {
+        MC_TRACE("propset_index_inserted: dsa_insert_raw() failed.");
+        propset_index_invalidate(propset);
+        return;
+    }
+
+    key = propset_item(propset, i)->key;
+    entry->hash = propset_index_hash(key);
+    entry->next = 0;
+    slot = propset_index_slot(propset, key, entry->hash);
+    if(index->slots[slot] == 0) {
+        index->slots[slot] = i + 1;
+    } else {
+        /* Append to the end of the chain. */
+        propset_index_entry_t* tail = propset_index_entry(index, index->slots[slot] - 1);
+        while(tail->next != 0)
+            tail = propset_index_entry(index, tail->next - 1);
+        tail->next = i + 1;
+    }
+}
+
+/* Returns index of the first item with the key (and the lParam if use_lp),
+ * or -1. The index must be up to date. */
+static int
+propset_index_find(propset_t* propset, const TCHAR* key, BOOL use_lp, LPARAM lp)
+{
+    propset_index_t* index = &propset->index;
+    DWORD i;
+
+    MC_ASSERT(!index->dirty);
+
+    i = index->slots[propset_index_slot(propset, key, propset_index_hash(key))];
+    while(i != 0) {
+        if(!use_lp  ||  propset_item(propset, i-1)->lp == lp)
+            return (int) (i-1);
+        i = propset_index_entry(index, i-1)->next;
+    }
+    return -1;
+}
+
+static void
+propset_refresh_item(propset_t* propset, int index, int size_delta)
+{
+    propset_refresh_data_t refresh_data;
+
+    refresh_data.index = index;
+    refresh_data.size_delta = size_delta;
+    propset_refresh_views(propset, &refresh_data);
 }
 
 propset_t*
@@ -70,6 +301,7 @@ propset_create(DWORD flags)
     dsa_init(&propset->items, sizeof(propset_item_t));
     propset->flags = flags;
     view_list_init(&propset->vlist);
+    propset_index_init(&propset->index);
     return propset;
 }
 
@@ -79,7 +311,8 @@ propset_destroy(propset_t* propset)
     PROPSET_TRACE("propset_destroy(%p)", propset);
 
     MC_ASSERT(propset->refs == 0);
-    MC_ASSERT(VIEW_LIST_IS_EMPTY(&propset->vlist));
+    view_list_fini(&propset->vlist);
+    propset_index_fini(&propset->index);
 
     dsa_fini(&propset->items, propset_item_dtor);
     free(propset);
@@ -108,6 +341,7 @@ propset_apply(propset_item_t* item, MC_PROPSETITEM* pi, BOOL unicode)
 
     if(pi->fMask & MC_PSIM_TEXT) {
         TCHAR* text;
+        TCHAR* key = NULL;
 
         text = mc_str(pi->pszText, (unicode ? MC_STRW : MC_STRA), MC_STRT);
         if(MC_ERR(pi->pszText != NULL && text == NULL)) {
@@ -115,9 +349,18 @@ propset_apply(propset_item_t* item, MC_PROPSETITEM* pi, BOOL unicode)
             return -1;
         }
 
+        if(text != NULL) {
+            text = propset_text_with_key(text, &key);
+            if(MC_ERR(text == NULL)) {
+                MC_TRACE("propset_apply: propset_text_with_key() failed.");
+                return -1;
+            }
+        }
+
         if(item->text != NULL)
             free(item->text);
         item->text = text;
+        item->key = key;
     }
 
     if(pi->fMask & MC_PSIM_VALUE) {
@@ -140,7 +383,7 @@ propset_apply(propset_item_t* item, MC_PROPSETITEM* pi, BOOL unicode)
 static int
 propset_insert(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
 {
-    WORD index;
+    int index;
     propset_item_t item = {0};
 
     PROPSET_TRACE("propset_insert(%p, %p, %d)", propset, pi, unicode);
@@ -156,9 +399,82 @@ propset_insert(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
         return -1;
     }
 
-    index = MC_MAX(0, MC_MIN(pi->iItem, propset_size(propset)));
-    return dsa_insert_smart(&propset->items, index, &item,
+    index = MC_MAX(0, MC_MIN(pi->iItem, (int) propset_size(propset)));
+    index = dsa_insert_smart(&propset->items, index, &item,
                 (propset->flags & MC_PSF_SORTITEMS) ? propset_item_cmp : NULL);
+    if(MC_ERR(index < 0)) {
+        MC_TRACE("propset_insert: dsa_insert_smart() failed.");
+        return -1;
+    }
+
+    propset_index_inserted(propset, index);
+
+    propset_refresh_item(propset, index, +1);
+    return index;
+}
+
+static int
+propset_insert_bulk(propset_t* propset, MC_PROPSETITEM* pi, UINT n, BOOL unicode)
+{
+    dsa_t batch;
+    propset_item_t* item;
+    int index;
+    int ret;
+    UINT i;
+
+    PROPSET_TRACE("propset_insert_bulk(%p, %p, %u, %d)", propset, pi, n, unicode);
+
+    if(MC_ERR(propset == NULL)) {
+        MC_TRACE("propset_insert_bulk: invalid handle.");
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+
+    if(MC_ERR(pi == NULL  &&  n > 0)) {
+        MC_TRACE("propset_insert_bulk: pItems == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    if(n == 0)
+        return 0;
+
+    /* Prepare all the items first, so we can fail without touching the
+     * property set. */
+    dsa_init(&batch, sizeof(propset_item_t));
+    if(MC_ERR(dsa_reserve(&batch, n) != 0)) {
+        MC_TRACE("propset_insert_bulk: dsa_reserve() failed.");
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
+    for(i = 0; i < n; i++) {
+        item = (propset_item_t*) dsa_insert_raw(&batch, i);
+        memset(item, 0, sizeof(propset_item_t));
+        if(MC_ERR(propset_apply(item, &pi[i], unicode) != 0)) {
+            MC_TRACE("propset_insert_bulk: propset_apply() failed.");
+            dsa_fini(&batch, propset_item_dtor);
+            return -1;
+        }
+    }
+
+    if(propset->flags & MC_PSF_SORTITEMS) {
+        ret = dsa_insert_sorted_bulk(&propset->items, batch.buffer, n,
+                                     propset_item_cmp);
+    } else {
+        index = MC_MAX(0, MC_MIN(pi[0].iItem, (int) propset_size(propset)));
+        ret = dsa_insert_bulk(&propset->items, index, batch.buffer, n);
+    }
+    if(MC_ERR(ret != 0)) {
+        MC_TRACE("propset_insert_bulk: dsa_insert_bulk() failed.");
+        dsa_fini(&batch, propset_item_dtor);
+        return -1;
+    }
+
+    /* The items now live in the property set. */
+    dsa_fini(&batch, NULL);
+    propset_index_invalidate(propset);
+    propset_refresh_views(propset, NULL);
+    return 0;
 }
 
 static int
@@ -175,12 +491,16 @@ propset_set(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
         return -1;
     }
 
-    if(MC_ERR(index < 0 || index >= propset_size(propset))) {
+    if(MC_ERR(index < 0 || index >= (int) propset_size(propset))) {
         MC_TRACE("propset_set: iItem out of range.");
         SetLastError(ERROR_INVALID_PARAMETER);
         return -1;
     }
 
+    /* The index chains items by their labels (but not lParam). */
+    if(pi->fMask & MC_PSIM_TEXT)
+        propset_index_invalidate(propset);
+
     item = propset_item(propset, index);
     if(MC_ERR(propset_apply(item, pi, unicode) != 0)) {
         MC_TRACE("propset_set: propset_apply() failed.");
@@ -189,9 +509,19 @@ propset_set(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
 
     /* When sorted, we may need to move the item to new location if its
      * name has changed */
-    if((propset->flags & MC_PSF_SORTITEMS)  &&  (pi->fMask & MC_PSIM_TEXT))
+    if((propset->flags & MC_PSF_SORTITEMS)  &&  (pi->fMask & MC_PSIM_TEXT)) {
+        int old_index = index;
+
         index = dsa_move_sorted(&propset->items, index, propset_item_cmp);
+        if(index != old_index) {
+            /* Views see the move as a removal followed by an insertion. */
+            propset_refresh_item(propset, old_index, -1);
+            propset_refresh_item(propset, index, +1);
+            return index;
+        }
+    }
 
+    propset_refresh_item(propset, index, 0);
     return index;
 }
 
@@ -214,7 +544,7 @@ propset_get(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
         return -1;
     }
 
-    if(MC_ERR(pi->iItem < 0 || pi->iItem >= propset_size(propset))) {
+    if(MC_ERR(pi->iItem < 0 || pi->iItem >= (int) propset_size(propset))) {
         MC_TRACE("propset_get: iItem out of range.");
         return -1;
     }
@@ -240,6 +570,67 @@ propset_get(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
     return 0;
 }
 
+static int
+propset_find(propset_t* propset, MC_PROPSETITEM* pi, BOOL unicode)
+{
+    propset_item_t needle = {0};
+    propset_item_t* item;
+    TCHAR* text;
+    BOOL use_lp;
+    DWORD i, n;
+    int index = -1;
+
+    PROPSET_TRACE("propset_find(%p, %p, %d)", propset, pi, unicode);
+
+    if(MC_ERR(propset == NULL)) {
+        MC_TRACE("propset_find: Invalid handle.");
+        SetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+
+    if(MC_ERR((pi->fMask & ~MC_PSIM_LPARAM) != MC_PSIM_TEXT)) {
+        MC_TRACE("propset_find: Unsupported MC_PROPSETITEM::fMask.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    text = mc_str(pi->pszText, (unicode ? MC_STRW : MC_STRA), MC_STRT);
+    if(MC_ERR(pi->pszText != NULL && text == NULL)) {
+        MC_TRACE("propset_find: mc_str() failed.");
+        return -1;
+    }
+    if(text != NULL) {
+        text = propset_text_with_key(text, &needle.key);
+        if(MC_ERR(text == NULL)) {
+            MC_TRACE("propset_find: propset_text_with_key() failed.");
+            return -1;
+        }
+    }
+
+    use_lp = ((pi->fMask & MC_PSIM_LPARAM) != 0);
+
+    if(!propset->index.dirty  ||  propset_index_rebuild(propset) == 0) {
+        index = propset_index_find(propset, needle.key, use_lp, pi->lParam);
+    } else if((propset->flags & MC_PSF_SORTITEMS)  &&  !use_lp) {
+        /* Fall back to slower lookups if we cannot build the index. */
+        index = dsa_find_sorted(&propset->items, &needle, propset_item_cmp);
+    } else {
+        n = propset_size(propset);
+        for(i = 0; i < n; i++) {
+            item = propset_item(propset, i);
+            if(propset_item_cmp(&propset->items, &needle, item) == 0  &&
+               (!use_lp  ||  item->lp == pi->lParam)) {
+                index = (int) i;
+                break;
+            }
+        }
+    }
+
+    if(text != NULL)
+        free(text);
+    return index;
+}
+
 
 /**************************
  *** Exported functions ***
@@ -302,7 +693,7 @@ mcPropSet_GetItemCount(MC_HPROPSET hPropSet)
         return -1;
     }
 
-    return propset_size((propset_t*) hPropSet);
+    return (int) propset_size((propset_t*) hPropSet);
 }
 
 int MCTRL_API
@@ -317,6 +708,30 @@ mcPropSet_InsertItemA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItem)
     return (propset_insert((propset_t*)hPropSet, (MC_PROPSETITEM*)pItem, FALSE) == 0);
 }
 
+BOOL MCTRL_API
+mcPropSet_InsertItemsW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItems, UINT uCount)
+{
+    return (propset_insert_bulk((propset_t*)hPropSet, (MC_PROPSETITEM*)pItems, uCount, TRUE) == 0);
+}
+
+BOOL MCTRL_API
+mcPropSet_InsertItemsA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItems, UINT uCount)
+{
+    return (propset_insert_bulk((propset_t*)hPropSet, (MC_PROPSETITEM*)pItems, uCount, FALSE) == 0);
+}
+
+int MCTRL_API
+mcPropSet_FindItemW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItem)
+{
+    return propset_find((propset_t*)hPropSet, (MC_PROPSETITEM*)pItem, TRUE);
+}
+
+int MCTRL_API
+mcPropSet_FindItemA(MC_HPROPSET hPropSet, MC_PROPSETITEMA* pItem)
+{
+    return propset_find((propset_t*)hPropSet, (MC_PROPSETITEM*)pItem, FALSE);
+}
+
 BOOL MCTRL_API
 mcPropSet_GetItemW(MC_HPROPSET hPropSet, MC_PROPSETITEMW* pItem)
 {
@@ -345,7 +760,6 @@ BOOL MCTRL_API
 mcPropSet_DeleteItem(MC_HPROPSET hPropSet, int iItem)
 {
     propset_t* propset = (propset_t*) hPropSet;
-    propset_refresh_data_t refresh_data;
 
     PROPSET_TRACE("mcPropSet_DeleteItem(%p, %d)", propset, iItem);
 
@@ -355,17 +769,15 @@ mcPropSet_DeleteItem(MC_HPROPSET hPropSet, int iItem)
         return FALSE;
     }
 
-    if(MC_ERR(iItem < 0  ||  iItem >= propset_size(propset))) {
+    if(MC_ERR(iItem < 0  ||  iItem >= (int) propset_size(propset))) {
         MC_TRACE("mcPropSet_DeleteItem: index out of range.");
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
     dsa_remove(&propset->items, iItem, propset_item_dtor);
-
-    refresh_data.index = iItem;
-    refresh_data.size_delta = -1;
-    propset_refresh_views(propset, &refresh_data);
+    propset_index_invalidate(propset);
+    propset_refresh_item(propset, iItem, -1);
 
     return TRUE;
 }
@@ -384,6 +796,7 @@ mcPropSet_DeleteAllItems(MC_HPROPSET hPropSet)
     }
 
     dsa_clear(&propset->items, propset_item_dtor);
+    propset_index_invalidate(propset);
     propset_refresh_views(propset, NULL);
     return TRUE;
 }
@@ -27,18 +27,38 @@
 #include "viewlist.h"
 
 
+/* Hash index of items by their label (the case-folded sort key). Items
+ * with the same label are chained in the order of their indexes. Any change
+ * shifting the indexes just marks the index dirty, and it is rebuilt on the
+ * next lookup; only appending at the end updates it in place. */
+typedef struct propset_index_entry_tag propset_index_entry_t;
+struct propset_index_entry_tag {
+    UINT hash;
+    DWORD next;                /* next item with the same label + 1, or 0 */
+};
+
+typedef struct propset_index_tag propset_index_t;
+struct propset_index_tag {
+    DWORD* slots;              /* item index + 1, or 0 for unused slots */
+    DWORD capacity;            /* Zero or power of 2 */
+    dsa_t entries;             /* propset_index_entry_t for each item */
+    BOOL dirty;
+};
+
 typedef struct propset_tag propset_t;
 struct propset_tag {
     mc_ref_t refs;
     dsa_t items;
     DWORD flags;
     view_list_t vlist;
+    propset_index_t index;
 };
 
 
 typedef struct propset_item_tag propset_item_t;
 struct propset_item_tag {
     TCHAR* text;
+    TCHAR* key;            /* case-folded text (lives in the text buffer) */
     value_type_t* type;
     value_t value;
     LPARAM lp;
@@ -65,14 +85,14 @@ propset_unref(propset_t* propset)
 }
 
 
-static inline WORD
+static inline DWORD
 propset_size(propset_t* propset)
 {
     return dsa_size(&propset->items);
 }
 
 static inline propset_item_t*
-propset_item(propset_t* propset, WORD index)
+propset_item(propset_t* propset, DWORD index)
 {
     return (propset_item_t*) dsa_item_(&propset->items, index, sizeof(propset_item_t));
 }
@@ -82,7 +102,7 @@ propset_item(propset_t* propset, WORD index)
 /* Passed optionally to the refresh callback. */
 typedef struct propset_refresh_data_tag propset_refresh_data_t;
 struct propset_refresh_data_tag {
-    WORD index;
+    DWORD index;
     SHORT size_delta;  /* +1 on insert, 0 on set, -1 on remove */
 };
 
@@ -93,9 +113,9 @@ propset_install_view(propset_t* propset, void* view, view_refresh_t refresh)
 }
 
 static inline void
-propset_uninstall_view(propset_t* propset, void* view)
+propset_uninstall_view(propset_t* propset, int handle)
 {
-    view_list_uninstall_view(&propset->vlist, view);
+    view_list_uninstall_view(&propset->vlist, handle);
 }
 
 static inline void
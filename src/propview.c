@@ -18,6 +18,7 @@
 
 #include "propview.h"
 #include "propset.h"
+#include "textcache.h"
 
 
 /* Uncomment this to have more verbose traces from this module. */
@@ -42,37 +43,283 @@ struct propview_tag {
     HWND win;
     HFONT font;
     propset_t* propset;
+    int propset_view;     /* handle from propset_install_view() */
     UINT style            : 30;
     UINT no_redraw        : 1;
     UINT dirty_scrollbars : 1;
     WORD row_height;
     WORD label_width;
-    WORD scroll_y;
+    DWORD scroll_y;
+    dsa_t labels;
+    view_sched_t refresh_sched;
+    DWORD refresh_row0;   /* items pending for refresh (if rate limited) */
+    DWORD refresh_row1;
 };
 
 
+/*********************
+ *** Label caching ***
+ *********************/
+
+/* Painting a label with DT_END_ELLIPSIS measures the whole text every time,
+ * so we remember the labels already shortened to fit into the label column.
+ * The cache is kept parallel to the items of the property set (i.e. it has
+ * the same size and indexes); a slot is NULL until its item is painted. When
+ * the font or the label width changes, the cache is reset. */
+
+static void
+propview_label_dtor(dsa_t* dsa, void* dsa_item)
+{
+    TCHAR* label = *(TCHAR**) dsa_item;
+    if(label != NULL)
+        free(label);
+}
+
+static inline void
+propview_labels_reset(propview_t* pv)
+{
+    dsa_clear(&pv->labels, propview_label_dtor);
+}
+
+static void
+propview_labels_refresh(propview_t* pv, propset_refresh_data_t* data)
+{
+    TCHAR** slot;
+
+    if(data == NULL) {
+        propview_labels_reset(pv);
+        return;
+    }
+
+    /* If the cache has got out of sync (on error), propview_paint() rebuilds
+     * it as soon as it notices the size mismatch. */
+    if(data->size_delta > 0) {
+        if(data->index <= dsa_size(&pv->labels)) {
+            slot = (TCHAR**) dsa_insert_raw(&pv->labels, data->index);
+            if(MC_ERR(slot == NULL)) {
+                MC_TRACE("propview_labels_refresh: dsa_insert_raw() failed.");
+                propview_labels_reset(pv);
+                return;
+            }
+            *slot = NULL;
+        }
+    } else if(data->index < dsa_size(&pv->labels)) {
+        if(data->size_delta < 0) {
+            dsa_remove(&pv->labels, data->index, propview_label_dtor);
+        } else {
+            slot = (TCHAR**) dsa_item(&pv->labels, data->index);
+            propview_label_dtor(&pv->labels, slot);
+            *slot = NULL;
+        }
+    }
+}
+
+static int
+propview_labels_sync(propview_t* pv, DWORD n)
+{
+    DWORD i;
+
+    if(dsa_size(&pv->labels) == n)
+        return 0;
+
+    propview_labels_reset(pv);
+    if(MC_ERR(dsa_reserve(&pv->labels, n) != 0)) {
+        MC_TRACE("propview_labels_sync: dsa_reserve() failed.");
+        return -1;
+    }
+    for(i = 0; i < n; i++)
+        *((TCHAR**) dsa_insert_raw(&pv->labels, i)) = NULL;
+    return 0;
+}
+
+static TCHAR*
+propview_ellipsize(HDC dc, const TCHAR* text, int width)
+{
+    static const TCHAR ellipsis[] = _T("...");
+    int len = _tcslen(text);
+    int fit;
+    SIZE size;
+    TCHAR* label;
+
+    GetTextExtentExPoint(dc, text, len, width, &fit, NULL, &size);
+    if(fit < len) {
+        GetTextExtentPoint32(dc, ellipsis, MC_ARRAY_SIZE(ellipsis) - 1, &size);
+        GetTextExtentExPoint(dc, text, len, MC_MAX(0, width - size.cx),
+                             &fit, NULL, &size);
+    }
+
+    label = (TCHAR*) malloc((fit + MC_ARRAY_SIZE(ellipsis)) * sizeof(TCHAR));
+    if(MC_ERR(label == NULL)) {
+        MC_TRACE("propview_ellipsize: malloc() failed.");
+        return NULL;
+    }
+
+    memcpy(label, text, fit * sizeof(TCHAR));
+    if(fit < len)
+        memcpy(label + fit, ellipsis, sizeof(ellipsis));
+    else
+        label[fit] = _T('\0');
+    return label;
+}
+
+
+
+/* Posted to itself to update the scrollbars after (a batch of) changes. */
+#define PROPVIEW_WM_SETUPSCROLLBARS    (WM_USER + 0x7f01)
+
+static void
+propview_defer_scrollbars(propview_t* pv)
+{
+    /* Many changes may come in a row (e.g. when the application fills the
+     * property set), so only mark the scrollbars dirty and update them once
+     * when the message loop gets to the posted message. */
+    if(pv->dirty_scrollbars)
+        return;
+
+    pv->dirty_scrollbars = 1;
+    if(!pv->no_redraw)
+        PostMessage(pv->win, PROPVIEW_WM_SETUPSCROLLBARS, 0, 0);
+}
+
+#define PROPVIEW_REFRESH_TIMER_ID    1
+
+/* Converts count of rows (below the top visible row) to pixels, clamped to
+ * the limit so far away rows cannot overflow the LONG coordinates. */
+static LONG
+propview_row_offset(propview_t* pv, DWORD rows, LONG limit)
+{
+    if(rows > (DWORD)(limit / pv->row_height))
+        return limit;
+    return (LONG) rows * pv->row_height;
+}
+
+/* Marks refresh_row1 extending to the end of the list. */
+#define PROPVIEW_REFRESH_END         ((DWORD) -1)
+
+/* With rate limited refresh, the changes are collected as a range of items
+ * to repaint. As an insertion or a removal moves all the items below, it
+ * extends the range to the end of the list. */
+static void
+propview_refresh_accumulate(propview_t* pv, propset_refresh_data_t* data)
+{
+    DWORD row0, row1;
+
+    if(data == NULL) {
+        row0 = 0;
+        row1 = PROPVIEW_REFRESH_END;
+    } else if(data->size_delta == 0) {
+        row0 = data->index;
+        row1 = data->index + 1;
+    } else {
+        row0 = data->index;
+        row1 = PROPVIEW_REFRESH_END;
+    }
+
+    if(pv->refresh_row0 >= pv->refresh_row1) {
+        pv->refresh_row0 = row0;
+        pv->refresh_row1 = row1;
+    } else {
+        pv->refresh_row0 = MC_MIN(pv->refresh_row0, row0);
+        pv->refresh_row1 = MC_MAX(pv->refresh_row1, row1);
+    }
+}
+
+static void
+propview_refresh_flush(propview_t* pv)
+{
+    RECT rect;
+
+    view_sched_flushed(&pv->refresh_sched, pv->win, PROPVIEW_REFRESH_TIMER_ID);
+
+    if(pv->refresh_row0 >= pv->refresh_row1)
+        return;
+
+    GetClientRect(pv->win, &rect);
+    if(pv->refresh_row0 > pv->scroll_y)
+        rect.top = propview_row_offset(pv, pv->refresh_row0 - pv->scroll_y, rect.bottom);
+    if(pv->refresh_row1 != PROPVIEW_REFRESH_END) {
+        rect.bottom = propview_row_offset(pv,
+                MC_MAX(pv->refresh_row1, pv->scroll_y) - pv->scroll_y, rect.bottom);
+    }
+    if(rect.top < rect.bottom)
+        InvalidateRect(pv->win, &rect, TRUE);
+
+    pv->refresh_row0 = 0;
+    pv->refresh_row1 = 0;
+}
+
 static void
 propview_refresh(void* view, void* refresh_data)
 {
     propview_t* pv = (propview_t*) view;
     propset_refresh_data_t* data = (propset_refresh_data_t*) refresh_data;
+    RECT rect;
+
+    if(data == NULL  ||  data->size_delta != 0)
+        propview_defer_scrollbars(pv);
+    propview_labels_refresh(pv, data);
 
     if(pv->no_redraw)
         return;
 
+    if(data != NULL  &&  data->index < pv->scroll_y) {
+        /* Items above the visible area have been inserted or removed. Keep
+         * the same items visible so nothing has to be repainted. */
+        pv->scroll_y += data->size_delta;
+        if(data->size_delta != 0  &&  pv->refresh_row0 < pv->refresh_row1) {
+            /* The pending items have moved too. */
+            if(pv->refresh_row0 > data->index)
+                pv->refresh_row0 = MC_MAX(data->index, (DWORD)((int)pv->refresh_row0 + data->size_delta));
+            if(pv->refresh_row1 != PROPVIEW_REFRESH_END  &&  pv->refresh_row1 > data->index)
+                pv->refresh_row1 = MC_MAX(data->index, (DWORD)((int)pv->refresh_row1 + data->size_delta));
+        }
+        return;
+    }
+
+    if(pv->refresh_sched.interval > 0) {
+        propview_refresh_accumulate(pv, data);
+        if(view_sched_request(&pv->refresh_sched, pv->win, PROPVIEW_REFRESH_TIMER_ID))
+            propview_refresh_flush(pv);
+        return;
+    }
+
     if(data == NULL) {
         InvalidateRect(pv->win, NULL, TRUE);
         return;
     }
 
-    // TODO -- invalidate rect(s) for affected items
+    GetClientRect(pv->win, &rect);
+    rect.top = propview_row_offset(pv, data->index - pv->scroll_y, rect.bottom);
+    if(rect.top >= rect.bottom)
+        return;
+
+    if(data->size_delta == 0) {
+        /* Only the item has changed. */
+        rect.bottom = rect.top + pv->row_height;
+        InvalidateRect(pv->win, &rect, TRUE);
+    } else {
+        /* Move the items below, and repaint only the gap: the new item on
+         * insert, or the item scrolled into the view on remove. */
+        ScrollWindowEx(pv->win, 0, data->size_delta * pv->row_height,
+                       &rect, &rect, NULL, NULL, SW_ERASE | SW_INVALIDATE);
+    }
+}
+
+static void
+propview_set_refresh_interval(propview_t* pv, DWORD interval)
+{
+    pv->refresh_sched.interval = interval;
+
+    /* Do not leave anything pending when the rate limiting gets disabled. */
+    if(interval == 0  &&  pv->refresh_sched.timer_pending)
+        propview_refresh_flush(pv);
 }
 
 static void
 propview_vscroll_rel(propview_t* pv, int row_delta)
 {
     SCROLLINFO si;
-    int scroll_y = pv->scroll_y + row_delta;
+    int scroll_y = (int) pv->scroll_y + row_delta;
 
     PROPVIEW_TRACE("propview_vscroll_rel(%p, %d)", pv, (int)row_delta);
 
@@ -88,21 +335,21 @@ propview_vscroll_rel(propview_t* pv, int row_delta)
     if(scroll_y < si.nMin)
         scroll_y = si.nMin;
 
-    if(scroll_y == pv->scroll_y)
+    if(scroll_y == (int) pv->scroll_y)
         return;
 
     SetScrollPos(pv->win, SB_VERT, scroll_y, TRUE);
     if(!pv->no_redraw)
-        ScrollWindowEx(pv->win, 0, (pv->scroll_y - scroll_y) * pv->row_height,
+        ScrollWindowEx(pv->win, 0, ((int) pv->scroll_y - scroll_y) * pv->row_height,
                        NULL, NULL, NULL, NULL, SW_ERASE | SW_INVALIDATE);
-    pv->scroll_y = scroll_y;
+    pv->scroll_y = (DWORD) scroll_y;
 }
 
 static void
 propview_vscroll(propview_t* pv, WORD opcode)
 {
     SCROLLINFO si;
-    int scroll_y = pv->scroll_y;
+    int scroll_y = (int) pv->scroll_y;
 
     PROPVIEW_TRACE("propview_scroll(%p, %d)", pv, (int)opcode);
 
@@ -125,14 +372,14 @@ propview_vscroll(propview_t* pv, WORD opcode)
     if(scroll_y < si.nMin)
         scroll_y = si.nMin;
 
-    if(scroll_y == pv->scroll_y)
+    if(scroll_y == (int) pv->scroll_y)
         return;
 
     SetScrollPos(pv->win, SB_VERT, scroll_y, TRUE);
     if(!pv->no_redraw)
-        ScrollWindowEx(pv->win, 0, (pv->scroll_y - scroll_y) * pv->row_height,
+        ScrollWindowEx(pv->win, 0, ((int) pv->scroll_y - scroll_y) * pv->row_height,
                        NULL, NULL, NULL, NULL, SW_ERASE | SW_INVALIDATE);
-    pv->scroll_y = scroll_y;
+    pv->scroll_y = (DWORD) scroll_y;
 }
 
 static void
@@ -140,6 +387,7 @@ propview_setup_scrollbars(propview_t* pv)
 {
     RECT rect;
     SCROLLINFO si;
+    int scroll_y;
 
     PROPVIEW_TRACE("propview_setup_scrollbars(%p)", pv);
 
@@ -148,58 +396,123 @@ propview_setup_scrollbars(propview_t* pv)
         return;
     }
 
+    pv->dirty_scrollbars = 0;
     GetClientRect(pv->win, &rect);
 
     si.cbSize = sizeof(SCROLLINFO);
-    si.fMask = SIF_RANGE | SIF_PAGE;
+    si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
     si.nMin = 0;
-    si.nMax = dsa_size(&pv->propset->items) - 1;
-    si.nPage = MC_MAX(1, mc_width(&rect) / pv->row_height);
+    si.nMax = (int) propset_size(pv->propset) - 1;
+    si.nPage = MC_MAX(1, mc_height(&rect) / pv->row_height);
+    si.nPos = (int) pv->scroll_y;
 
     SetScrollInfo(pv->win, SB_VERT, &si, TRUE);
+
+    /* The scroll position may have been clamped into the new range. */
+    scroll_y = GetScrollPos(pv->win, SB_VERT);
+    if(scroll_y != (int) pv->scroll_y) {
+        ScrollWindowEx(pv->win, 0, ((int) pv->scroll_y - scroll_y) * pv->row_height,
+                       NULL, NULL, NULL, NULL, SW_ERASE | SW_INVALIDATE);
+        pv->scroll_y = (DWORD) scroll_y;
+    }
 }
 
+/* Max. count of gridlines painted by single PolyPolyline() call. */
+#define PROPVIEW_GRIDLINE_BATCH    32
+
 static void
-propview_paint(propview_t* pv, HDC dc)
+propview_paint(propview_t* pv, HDC dc, RECT* dirty)
 {
     RECT rect;
     RECT label_rect;
     RECT value_rect;
-    WORD i, n;
+    DWORD i, n;
+    DWORD row0, row1;
     propset_item_t* item;
     int old_dc_state;
     HPEN pen;
+    POINT points[2 * PROPVIEW_GRIDLINE_BATCH];
+    DWORD counts[PROPVIEW_GRIDLINE_BATCH];
+    UINT lines = 0;
+    BOOL paint_labels, paint_values;
+    int label_ellipsis_width;
+    TCHAR* label;
 
     n = propset_size(pv->propset);
     GetClientRect(pv->win, &rect);
 
+    /* Paint only the rows intersecting the dirty rect. */
+    row0 = MC_MIN(n, pv->scroll_y + MC_MAX(0, dirty->top) / pv->row_height);
+    row1 = MC_MIN(n, pv->scroll_y +
+                     (MC_MAX(0, dirty->bottom) + pv->row_height - 1) / pv->row_height);
+    if(row0 >= row1)
+        return;
+
+    paint_labels = (dirty->left < pv->label_width);
+    paint_values = (dirty->right > pv->label_width);
+    label_ellipsis_width = pv->label_width - 1 - 2 * PADDING_H;
+    if(paint_labels  &&  MC_ERR(propview_labels_sync(pv, n) != 0))
+        MC_TRACE("propview_paint: propview_labels_sync() failed.");
+
     old_dc_state = SaveDC(dc);
     pen = CreatePen(PS_SOLID, 0, RGB(223,223,223));
     SelectObject(dc, pen);
     SelectObject(dc, pv->font ? pv->font : GetStockObject(SYSTEM_FONT));
     SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
 
-    /* Paint the vertical grid line */
-    MoveToEx(dc, pv->label_width, 0, NULL);
-    LineTo(dc, pv->label_width, (n - pv->scroll_y) * pv->row_height);
+    /* Vertical grid line */
+    if(dirty->left <= pv->label_width  &&  pv->label_width < dirty->right) {
+        points[0].x = pv->label_width;
+        points[0].y = (LONG)(row0 - pv->scroll_y) * pv->row_height;
+        points[1].x = pv->label_width;
+        points[1].y = (LONG)(row1 - pv->scroll_y) * pv->row_height;
+        counts[0] = 2;
+        lines++;
+    }
 
-    for(i = pv->scroll_y; i < n; i++) {
+    for(i = row0; i < row1; i++) {
         item = propset_item(pv->propset, i);
 
-        /* Paint horizontal grid line */
-        MoveToEx(dc, 0, (i - pv->scroll_y + 1) * pv->row_height - 1, NULL);
-        LineTo(dc, rect.right, (i - pv->scroll_y + 1) * pv->row_height - 1);
-
-        /* Paint label */
         label_rect.left = PADDING_H;
-        label_rect.top = (i - pv->scroll_y) * pv->row_height;
+        label_rect.top = (LONG)(i - pv->scroll_y) * pv->row_height;
         label_rect.right = pv->label_width - 1 - label_rect.left,
         label_rect.bottom = label_rect.top + pv->row_height - 1;
-        DrawText(dc, item->text, -1, &label_rect,
-                 DT_SINGLELINE | DT_END_ELLIPSIS | DT_LEFT | DT_VCENTER);
+
+        /* Horizontal grid line */
+        points[2*lines].x = dirty->left;
+        points[2*lines].y = label_rect.bottom;
+        points[2*lines+1].x = dirty->right;
+        points[2*lines+1].y = label_rect.bottom;
+        counts[lines] = 2;
+        lines++;
+        if(lines == PROPVIEW_GRIDLINE_BATCH) {
+            PolyPolyline(dc, points, counts, lines);
+            lines = 0;
+        }
+
+        /* Paint label */
+        if(paint_labels  &&  item->text != NULL) {
+            if(dsa_size(&pv->labels) == n) {
+                TCHAR** slot = (TCHAR**) dsa_item(&pv->labels, i);
+                if(*slot == NULL)
+                    *slot = propview_ellipsize(dc, item->text, label_ellipsis_width);
+                label = *slot;
+            } else {
+                label = NULL;
+            }
+
+            if(label != NULL) {
+                textcache_draw(dc, label, -1, &label_rect,
+                               DT_SINGLELINE | DT_NOPREFIX | DT_LEFT | DT_VCENTER);
+            } else {
+                /* Fallback if the cache is not available. */
+                textcache_draw(dc, item->text, -1, &label_rect, DT_SINGLELINE |
+                               DT_NOPREFIX | DT_END_ELLIPSIS | DT_LEFT | DT_VCENTER);
+            }
+        }
 
         /* Paint value */
-        if(item->type != NULL) {
+        if(paint_values  &&  item->type != NULL) {
             int dc_state;
 
             mc_set_rect(&value_rect,
@@ -210,12 +523,11 @@ propview_paint(propview_t* pv, HDC dc)
             item->type->paint(item->value, dc, &value_rect, 0);
             RestoreDC(dc, dc_state);
         }
-
-        /* Check if out of visible area */
-        if(label_rect.bottom > rect.bottom)
-            break;
     }
 
+    if(lines > 0)
+        PolyPolyline(dc, points, counts, lines);
+
     DeleteObject(pen);
     RestoreDC(dc, old_dc_state);
 }
@@ -223,6 +535,8 @@ propview_paint(propview_t* pv, HDC dc)
 static int
 propview_set_propset(propview_t* pv, propset_t* propset)
 {
+    int view = -1;
+
     PROPVIEW_TRACE("propview_set_propset(%p, %p)", pv, propset);
 
     if(propset != NULL  &&  propset == pv->propset)
@@ -241,7 +555,8 @@ propview_set_propset(propview_t* pv, propset_t* propset)
     }
 
     if(propset != NULL) {
-        if(MC_ERR(propset_install_view(propset, pv, propview_refresh) != 0)) {
+        view = propset_install_view(propset, pv, propview_refresh);
+        if(MC_ERR(view < 0)) {
             MC_TRACE("propview_set_propset: propset_install_view() failed.");
             propset_unref(propset);
             mc_send_notify(GetParent(pv->win), pv->win, NM_OUTOFMEMORY);
@@ -250,11 +565,13 @@ propview_set_propset(propview_t* pv, propset_t* propset)
     }
 
     if(pv->propset != NULL) {
-        propset_uninstall_view(pv->propset, propset);
-        propset_unref(propset);
+        propset_uninstall_view(pv->propset, pv->propset_view);
+        propset_unref(pv->propset);
     }
 
     pv->propset = propset;
+    pv->propset_view = view;
+    propview_labels_reset(pv);
 
     if(!pv->no_redraw) {
         propview_setup_scrollbars(pv);
@@ -307,6 +624,8 @@ propview_nccreate(HWND win, CREATESTRUCT* cs)
     pv->dirty_scrollbars = 0;
     pv->row_height = size.cy + 2 * PADDING_V + 1;  /* +1 for grid line */
     pv->label_width = 10 * size.cx;
+    dsa_init(&pv->labels, sizeof(TCHAR*));
+    view_sched_init(&pv->refresh_sched);
 
     return pv;
 }
@@ -331,7 +650,7 @@ propview_destroy(propview_t* pv)
     PROPVIEW_TRACE("propview_destroy(%p)", pv);
 
     if(pv->propset != NULL) {
-        propset_uninstall_view(pv->propset, pv);
+        propset_uninstall_view(pv->propset, pv->propset_view);
         propset_unref(pv->propset);
         pv->propset = NULL;
     }
@@ -340,6 +659,7 @@ propview_destroy(propview_t* pv)
 static inline void
 propview_ncdestroy(propview_t* pv)
 {
+    propview_labels_reset(pv);
     free(pv);
 }
 
@@ -364,11 +684,13 @@ propview_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
             {
                 PAINTSTRUCT ps;
 
-                if(wp == 0)
+                if(wp == 0) {
                     BeginPaint(win, &ps);
-                else
+                } else {
                     ps.hdc = (HDC) wp;
-                propview_paint(pv, ps.hdc);
+                    GetClientRect(win, &ps.rcPaint);
+                }
+                propview_paint(pv, ps.hdc, &ps.rcPaint);
                 if(wp == 0)
                     EndPaint(win, &ps);
             }
@@ -407,6 +729,13 @@ propview_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
         case MC_PVM_GETITEMCOUNT:
             return mcPropSet_GetItemCount(pv->propset);
 
+        case MC_PVM_SETREFRESHINTERVAL:
+            propview_set_refresh_interval(pv, (DWORD) wp);
+            return 0;
+
+        case MC_PVM_GETREFRESHINTERVAL:
+            return pv->refresh_sched.interval;
+
         case WM_GETFONT:
             return (LRESULT) pv->font;
 
@@ -430,8 +759,12 @@ propview_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
         {
             SIZE size;
             pv->font = (HFONT) wp;
+            if(pv->font != NULL)
+                textcache_invalidate(pv->font);
             mc_font_size(pv->font, &size);
             pv->row_height = size.cy + 2 * PADDING_V + 1;
+            propview_labels_reset(pv);
+            propview_setup_scrollbars(pv);
             if((BOOL) lp  &&  !pv->no_redraw)
                 InvalidateRect(win, NULL, TRUE);
             return 0;
@@ -439,13 +772,35 @@ propview_proc(HWND win, UINT msg, WPARAM wp, LPARAM lp)
 
         case WM_SETREDRAW:
             pv->no_redraw = !wp;
-            if(!pv->no_redraw)
+            if(!pv->no_redraw) {
+                /* Changes made meanwhile have not been tracked. */
+                propview_setup_scrollbars(pv);
+                InvalidateRect(win, NULL, TRUE);
+            }
+            return 0;
+
+        case PROPVIEW_WM_SETUPSCROLLBARS:
+            if(pv->dirty_scrollbars)
                 propview_setup_scrollbars(pv);
             return 0;
 
         case WM_GETDLGCODE:
             return DLGC_WANTARROWS | DLGC_WANTCHARS;
 
+        case WM_TIMER:
+            if(wp == PROPVIEW_REFRESH_TIMER_ID) {
+                propview_refresh_flush(pv);
+                return 0;
+            }
+            break;
+
+        case WM_THEMECHANGED:
+            textcache_invalidate(NULL);
+            propview_labels_reset(pv);
+            if(!pv->no_redraw)
+                InvalidateRect(win, NULL, TRUE);
+            return 0;
+
         case WM_STYLECHANGED:
             propview_style_changed(pv, wp, (STYLESTRUCT*)lp);
             return 0;
@@ -31,254 +31,1615 @@
 
 
 #define MC_TCM_ALL    (MC_TCM_VALUE | MC_TCM_FOREGROUND | MC_TCM_BACKGROUND | MC_TCM_FLAGS)
+#define MC_TCM_ATTRS  (MC_TCM_FOREGROUND | MC_TCM_BACKGROUND | MC_TCM_FLAGS)
 
 
 
+/******************************
+ *** Sparse cell attributes ***
+ ******************************/
+
+/* Usually only very few cells have any non-default attributes (colors or
+ * flags). Until that changes, the attributes are kept in a small hash table
+ * (open addressing with linear probing), keyed by the cell index. */
+
+#define TABLE_SPARSE_EMPTY      ((size_t) -1)
+#define TABLE_SPARSE_MINSIZE    16
+
+typedef struct table_attr_tag table_attr_t;
+struct table_attr_tag {
+    size_t index;              /* TABLE_SPARSE_EMPTY for unused slots */
+    COLORREF foreground;
+    COLORREF background;
+    DWORD flags;
+};
+
+typedef struct table_sparse_tag table_sparse_t;
+struct table_sparse_tag {
+    size_t count;
+    size_t capacity;           /* Zero or power of 2 */
+    table_attr_t* slots;
+};
+
+#define TABLE_ATTR_IS_DEFAULT(attr)                                        \
+     ((attr)->foreground == MC_CLR_DEFAULT  &&                             \
+      (attr)->background == MC_CLR_NONE  &&  (attr)->flags == 0)
+
+static inline size_t
+table_sparse_slot(const table_sparse_t* sparse, size_t index)
+{
+    size_t h = index;
+
+    h ^= (h >> 16);
+    h *= 0x45d9f3b;
+    h ^= (h >> 16);
+    return (h & (sparse->capacity - 1));
+}
+
+static inline void
+table_sparse_init(table_sparse_t* sparse)
+{
+    sparse->count = 0;
+    sparse->capacity = 0;
+    sparse->slots = NULL;
+}
+
+static inline void
+table_sparse_fini(table_sparse_t* sparse)
+{
+    if(sparse->slots)
+        free(sparse->slots);
+}
+
+static void
+table_sparse_reset(table_sparse_t* sparse)
+{
+    size_t i;
+
+    for(i = 0; i < sparse->capacity; i++)
+        sparse->slots[i].index = TABLE_SPARSE_EMPTY;
+    sparse->count = 0;
+}
+
+static table_attr_t*
+table_sparse_find(const table_sparse_t* sparse, size_t index)
+{
+    size_t i;
+
+    if(sparse->count == 0)
+        return NULL;
+
+    i = table_sparse_slot(sparse, index);
+    while(sparse->slots[i].index != TABLE_SPARSE_EMPTY) {
+        if(sparse->slots[i].index == index)
+            return &sparse->slots[i];
+        i = (i+1) & (sparse->capacity - 1);
+    }
+    return NULL;
+}
+
+/* Make sure there is room for (at least) the given count of entries,
+ * so following table_sparse_insert() calls cannot fail. */
+static int
+table_sparse_reserve(table_sparse_t* sparse, size_t count)
+{
+    table_attr_t* old_slots = sparse->slots;
+    size_t old_capacity = sparse->capacity;
+    size_t capacity;
+    size_t i, j;
+
+    /* Keep the load factor at most 1/2. */
+    capacity = (old_capacity > 0 ? old_capacity : TABLE_SPARSE_MINSIZE);
+    while(capacity < 2 * count)
+        capacity *= 2;
+    if(capacity == old_capacity)
+        return 0;
+
+    if(MC_ERR(capacity > ((size_t)-1) / sizeof(table_attr_t))) {
+        MC_TRACE("table_sparse_reserve: Too many cell attributes.");
+        return -1;
+    }
+
+    sparse->slots = (table_attr_t*) malloc(capacity * sizeof(table_attr_t));
+    if(MC_ERR(sparse->slots == NULL)) {
+        MC_TRACE("table_sparse_reserve: malloc() failed.");
+        sparse->slots = old_slots;
+        return -1;
+    }
+    sparse->capacity = capacity;
+    table_sparse_reset(sparse);
+
+    /* Rehash */
+    for(i = 0; i < old_capacity; i++) {
+        if(old_slots[i].index == TABLE_SPARSE_EMPTY)
+            continue;
+        j = table_sparse_slot(sparse, old_slots[i].index);
+        while(sparse->slots[j].index != TABLE_SPARSE_EMPTY)
+            j = (j+1) & (capacity - 1);
+        memcpy(&sparse->slots[j], &old_slots[i], sizeof(table_attr_t));
+        sparse->count++;
+    }
+
+    if(old_slots)
+        free(old_slots);
+    return 0;
+}
+
+/* Returns attributes of the given cell, adding default ones if the cell
+ * has none yet. Returns NULL if out of memory. */
+static table_attr_t*
+table_sparse_insert(table_sparse_t* sparse, size_t index)
+{
+    table_attr_t* attr;
+    size_t i;
+
+    attr = table_sparse_find(sparse, index);
+    if(attr != NULL)
+        return attr;
+
+    if(MC_ERR(table_sparse_reserve(sparse, sparse->count + 1) != 0))
+        return NULL;
+
+    i = table_sparse_slot(sparse, index);
+    while(sparse->slots[i].index != TABLE_SPARSE_EMPTY)
+        i = (i+1) & (sparse->capacity - 1);
+
+    attr = &sparse->slots[i];
+    attr->index = index;
+    attr->foreground = MC_CLR_DEFAULT;
+    attr->background = MC_CLR_NONE;
+    attr->flags = 0;
+    sparse->count++;
+    return attr;
+}
+
+static void
+table_sparse_remove(table_sparse_t* sparse, table_attr_t* attr)
+{
+    size_t mask = sparse->capacity - 1;
+    size_t i = attr - sparse->slots;
+    size_t j, k;
+
+    /* Backward-shift deletion: Move following entries of the cluster into
+     * the hole, unless they would get before their home slot. */
+    j = i;
+    while(1) {
+        j = (j+1) & mask;
+        if(sparse->slots[j].index == TABLE_SPARSE_EMPTY)
+            break;
+        k = table_sparse_slot(sparse, sparse->slots[j].index);
+        if((j > i && (k <= i || k > j))  ||  (j < i && (k <= i && k > j))) {
+            memcpy(&sparse->slots[i], &sparse->slots[j], sizeof(table_attr_t));
+            i = j;
+        }
+    }
+
+    sparse->slots[i].index = TABLE_SPARSE_EMPTY;
+    sparse->count--;
+}
+
+/* Makes a copy of the sparse attributes. */
+static int
+table_sparse_copy(const table_sparse_t* from, table_sparse_t* to)
+{
+    table_sparse_init(to);
+    if(from->capacity == 0)
+        return 0;
+
+    to->slots = (table_attr_t*) malloc(from->capacity * sizeof(table_attr_t));
+    if(MC_ERR(to->slots == NULL)) {
+        MC_TRACE("table_sparse_copy: malloc() failed.");
+        return -1;
+    }
+    memcpy(to->slots, from->slots, from->capacity * sizeof(table_attr_t));
+    to->capacity = from->capacity;
+    to->count = from->count;
+    return 0;
+}
+
+
+/******************
+ *** Row blocks ***
+ ******************/
+
+/* Cells are not stored in one huge array. Rows are grouped into blocks of
+ * (1 << shift) rows and each block is allocated separately, on the first
+ * write into it (NULL block means all its rows are empty).
+ *
+ * Blocks are reference-counted, so a table snapshot may share them with the
+ * live table. Before the live table modifies a shared block, it makes its
+ * own copy of it (copy-on-write), so the snapshot never sees any change.
+ *
+ * Rows behind the row count are always kept in the initial (empty) state,
+ * so a whole block can be destroyed without looking at the row count. */
+
+#define TABLE_BLOCK_SIZE         16384    /* Preferred size of block data */
+#define TABLE_BLOCK_MAXSHIFT     12
+
+typedef struct table_block_tag table_block_t;
+struct table_block_tag {
+    mc_ref_t refs;
+};
+
+/* Rows are stored behind the header, 8-byte aligned. */
+#define TABLE_BLOCK_HDRSIZE      ((sizeof(table_block_t) + 7) & ~7)
+#define TABLE_BLOCK_DATA(block)  (((BYTE*)(block)) + TABLE_BLOCK_HDRSIZE)
+
+/* Owner of the blocks provides these to manage values stored in the rows. */
+typedef struct table_block_ops_tag table_block_ops_t;
+struct table_block_ops_tag {
+    /* Initializes rows as empty. */
+    void (*init)(void* ctx, BYTE* data, DWORD row_count);
+    /* Makes copies of the values in the rows just copied from a shared
+     * block. On failure, it must leave no copies behind. */
+    int  (*dup)(void* ctx, BYTE* data, DWORD row_count);
+    /* Destroys values in the rows. */
+    void (*destroy)(void* ctx, BYTE* data, DWORD row_count);
+};
+
+typedef struct table_blocks_tag table_blocks_t;
+struct table_blocks_tag {
+    table_block_t** blocks;
+    DWORD block_count;         /* Count of block slots (allocated or not) */
+    DWORD shift;               /* log2 of rows per block */
+    size_t row_size;
+};
+
+#define TABLE_BLOCK_ROWS(blocks)     ((DWORD)1 << (blocks)->shift)
+#define TABLE_BLOCK_ROWMASK(blocks)  (TABLE_BLOCK_ROWS(blocks) - 1)
+
+static inline BOOL
+table_block_is_shared(table_block_t* block)
+{
+    /* Only the owner of a reference can make the count to grow, and the
+     * caller owns one, so seeing 1 means nobody else has the block. */
+#if defined MC_COMPILER_GCC  &&  MC_COMPILER_GCC >= 40700
+    return (__atomic_load_n(&block->refs, __ATOMIC_ACQUIRE) > 1);
+#else
+    return (*((volatile mc_ref_t*) &block->refs) > 1);
+#endif
+}
+
+static void
+table_block_release(table_blocks_t* blocks, table_block_t* block,
+                    const table_block_ops_t* ops, void* ctx)
+{
+    if(mc_unref(&block->refs) == 0) {
+        if(ops != NULL)
+            ops->destroy(ctx, TABLE_BLOCK_DATA(block), TABLE_BLOCK_ROWS(blocks));
+        free(block);
+    }
+}
+
+static int
+table_blocks_init(table_blocks_t* blocks, size_t row_size)
+{
+    if(MC_ERR(row_size > ((size_t)-1) - TABLE_BLOCK_HDRSIZE)) {
+        MC_TRACE("table_blocks_init: Rows too large.");
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
+
+    blocks->blocks = NULL;
+    blocks->block_count = 0;
+    blocks->row_size = row_size;
+    blocks->shift = 0;
+    while(blocks->shift < TABLE_BLOCK_MAXSHIFT  &&
+          row_size <= (TABLE_BLOCK_SIZE >> (blocks->shift + 1)))
+        blocks->shift++;
+    return 0;
+}
+
+/* Releases all the blocks. If ops is NULL, the values are not destroyed
+ * (caller guarantees all blocks are exclusive and own nothing). */
+static void
+table_blocks_fini(table_blocks_t* blocks, const table_block_ops_t* ops, void* ctx)
+{
+    DWORD i;
+
+    for(i = 0; i < blocks->block_count; i++) {
+        if(blocks->blocks[i] != NULL)
+            table_block_release(blocks, blocks->blocks[i], ops, ctx);
+    }
+    if(blocks->blocks != NULL)
+        free(blocks->blocks);
+}
+
+/* Releases all the blocks, so all the rows become empty. */
+static void
+table_blocks_clear(table_blocks_t* blocks, const table_block_ops_t* ops, void* ctx)
+{
+    DWORD i;
+
+    for(i = 0; i < blocks->block_count; i++) {
+        if(blocks->blocks[i] != NULL) {
+            table_block_release(blocks, blocks->blocks[i], ops, ctx);
+            blocks->blocks[i] = NULL;
+        }
+    }
+}
+
+/* Makes sure there are block slots for row_count rows. The count of the slots
+ * grows geometrically, but the blocks themselves are allocated lazily. */
+static int
+table_blocks_reserve(table_blocks_t* blocks, DWORD row_count)
+{
+    DWORD count;
+    DWORD i;
+    table_block_t** tmp;
+
+    count = (row_count >> blocks->shift) +
+            ((row_count & TABLE_BLOCK_ROWMASK(blocks)) ? 1 : 0);
+    if(count <= blocks->block_count)
+        return 0;
+
+    count = MC_MAX(count, MC_MAX(blocks->block_count * 2, 4));
+    if(MC_ERR(count > ((size_t)-1) / sizeof(table_block_t*))) {
+        MC_TRACE("table_blocks_reserve: Table too large.");
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
+
+    tmp = (table_block_t**) realloc(blocks->blocks, count * sizeof(table_block_t*));
+    if(MC_ERR(tmp == NULL)) {
+        MC_TRACE("table_blocks_reserve: realloc() failed.");
+        return -1;
+    }
+
+    for(i = blocks->block_count; i < count; i++)
+        tmp[i] = NULL;
+    blocks->blocks = tmp;
+    blocks->block_count = count;
+    return 0;
+}
+
+/* Returns pointer to the row data, or NULL if the row is empty. The data may
+ * be read but not modified, unless table_blocks_ensure() has been called for
+ * the row. */
+static inline BYTE*
+table_blocks_row(const table_blocks_t* blocks, DWORD row)
+{
+    table_block_t* block = blocks->blocks[row >> blocks->shift];
+
+    if(block == NULL)
+        return NULL;
+    return TABLE_BLOCK_DATA(block) + (row & TABLE_BLOCK_ROWMASK(blocks)) * blocks->row_size;
+}
+
+/* Makes the blocks holding rows [row0, row1) allocated and exclusively owned,
+ * so the rows may be modified. This has no visible side effects, so callers
+ * do it before modifying anything to fail cleanly. */
+static int
+table_blocks_ensure(table_blocks_t* blocks, DWORD row0, DWORD row1,
+                    const table_block_ops_t* ops, void* ctx)
+{
+    size_t data_size = blocks->row_size << blocks->shift;
+    DWORD i;
+
+    if(row0 >= row1  ||  blocks->row_size == 0)
+        return 0;
+
+    for(i = row0 >> blocks->shift; i <= ((row1 - 1) >> blocks->shift); i++) {
+        table_block_t* block = blocks->blocks[i];
+        table_block_t* copy;
+
+        if(block != NULL  &&  !table_block_is_shared(block))
+            continue;
+
+        copy = (table_block_t*) malloc(TABLE_BLOCK_HDRSIZE + data_size);
+        if(MC_ERR(copy == NULL)) {
+            MC_TRACE("table_blocks_ensure: malloc() failed.");
+            return -1;
+        }
+        copy->refs = 1;
+
+        if(block == NULL) {
+            ops->init(ctx, TABLE_BLOCK_DATA(copy), TABLE_BLOCK_ROWS(blocks));
+        } else {
+            memcpy(TABLE_BLOCK_DATA(copy), TABLE_BLOCK_DATA(block), data_size);
+            if(MC_ERR(ops->dup(ctx, TABLE_BLOCK_DATA(copy), TABLE_BLOCK_ROWS(blocks)) != 0)) {
+                MC_TRACE("table_blocks_ensure: Cannot copy values.");
+                free(copy);
+                return -1;
+            }
+            table_block_release(blocks, block, ops, ctx);
+        }
+
+        blocks->blocks[i] = copy;
+    }
+
+    return 0;
+}
+
+/* Resets rows [row0, row1) to the initial state, without destroying their
+ * values. Non-empty blocks of the rows must be exclusive. */
+static void
+table_blocks_init_rows(table_blocks_t* blocks, DWORD row0, DWORD row1,
+                       const table_block_ops_t* ops, void* ctx)
+{
+    DWORD n;
+
+    while(row0 < row1) {
+        n = MC_MIN(row1 - row0, TABLE_BLOCK_ROWS(blocks) - (row0 & TABLE_BLOCK_ROWMASK(blocks)));
+        if(blocks->blocks[row0 >> blocks->shift] != NULL)
+            ops->init(ctx, table_blocks_row(blocks, row0), n);
+        row0 += n;
+    }
+}
+
+/* Moves rows [row_from, row_from + count) to row_to. The ranges may overlap.
+ * All the blocks involved must have been made exclusive. */
+static void
+table_blocks_move_rows(table_blocks_t* blocks, DWORD row_from, DWORD row_to,
+                       DWORD count)
+{
+    DWORD mask = TABLE_BLOCK_ROWMASK(blocks);
+    DWORD n;
+
+    if(count == 0  ||  row_from == row_to  ||  blocks->row_size == 0)
+        return;
+
+    /* Move the longest runs which do not cross any block boundary. Go in
+     * the direction which does not overwrite rows not yet moved. */
+    if(row_to < row_from) {
+        while(count > 0) {
+            n = MC_MIN(count, TABLE_BLOCK_ROWS(blocks) - (row_from & mask));
+            n = MC_MIN(n, TABLE_BLOCK_ROWS(blocks) - (row_to & mask));
+            memmove(table_blocks_row(blocks, row_to),
+                    table_blocks_row(blocks, row_from), n * blocks->row_size);
+            row_from += n;
+            row_to += n;
+            count -= n;
+        }
+    } else {
+        while(count > 0) {
+            n = MC_MIN(count, ((row_from + count - 1) & mask) + 1);
+            n = MC_MIN(n, ((row_to + count - 1) & mask) + 1);
+            count -= n;
+            memmove(table_blocks_row(blocks, row_to + count),
+                    table_blocks_row(blocks, row_from + count), n * blocks->row_size);
+        }
+    }
+}
+
+/* Makes blocks_to to share all the blocks with blocks_from. */
+static int
+table_blocks_share(const table_blocks_t* blocks_from, table_blocks_t* blocks_to)
+{
+    DWORD i;
+
+    memcpy(blocks_to, blocks_from, sizeof(table_blocks_t));
+    if(blocks_from->block_count == 0)
+        return 0;
+
+    blocks_to->blocks = (table_block_t**) malloc(blocks_from->block_count *
+                                                 sizeof(table_block_t*));
+    if(MC_ERR(blocks_to->blocks == NULL)) {
+        MC_TRACE("table_blocks_share: malloc() failed.");
+        return -1;
+    }
+
+    for(i = 0; i < blocks_from->block_count; i++) {
+        blocks_to->blocks[i] = blocks_from->blocks[i];
+        if(blocks_to->blocks[i] != NULL)
+            mc_ref(&blocks_to->blocks[i]->refs);
+    }
+    return 0;
+}
+
+
 /**********************
  *** Table contents ***
  **********************/
 
-#define TABLE_CONTENTS_VALUES              0x01
-#define TABLE_CONTENTS_TYPES               0x02
-#define TABLE_CONTENTS_FOREGROUNDS         0x04
-#define TABLE_CONTENTS_BACKGROUNDS         0x08
-#define TABLE_CONTENTS_FLAGS               0x10
+#define TABLE_CONTENTS_VALUES              0x01
+#define TABLE_CONTENTS_TYPES               0x02
+#define TABLE_CONTENTS_FOREGROUNDS         0x04
+#define TABLE_CONTENTS_BACKGROUNDS         0x08
+#define TABLE_CONTENTS_FLAGS               0x10
+#define TABLE_CONTENTS_SPARSE              0x20
+#define TABLE_CONTENTS_INLINE64            0x40
+
+#define TABLE_CONTENTS_ATTRS                                               \
+     (TABLE_CONTENTS_FOREGROUNDS | TABLE_CONTENTS_BACKGROUNDS |            \
+      TABLE_CONTENTS_FLAGS)
+
+/* When count of cells with some attributes exceeds 1/TABLE_SPARSE_DENSITY
+ * of all cells, the sparse storage is no longer cheaper then the dense one. */
+#define TABLE_SPARSE_DENSITY               4
+
+typedef struct table_contents_tag table_contents_t;
+struct table_contents_tag {
+    DWORD mask;
+    DWORD attr_mask;           /* Attributes supported (dense or sparse) */
+    DWORD col_count;
+    DWORD row_count;
+    value_type_t* type;        /* if homogenous */
+
+    /* Each row holds an array of values, followed by arrays of types,
+     * foregrounds, backgrounds and flags (those enabled by the mask).
+     * These are offsets of the arrays in the row. */
+    size_t types_offset;
+    size_t foregrounds_offset;
+    size_t backgrounds_offset;
+    size_t flags_offset;       /* Now all public cell bits fit into single byte. In future we may need to extend this to WORD or DWORD. */
+
+    table_blocks_t blocks;
+    table_sparse_t sparse;     /* if (mask & TABLE_CONTENTS_SPARSE) */
+};
+
+#define IS_HOMOGENOUS(contents)      \
+     (!((contents)->mask & TABLE_CONTENTS_TYPES))
+
+#define IS_SPARSE(contents)          \
+     ((contents)->mask & TABLE_CONTENTS_SPARSE)
+
+/* 64-bit integers do not fit into value_t on 32-bit Windows, so value_t is
+ * then a pointer to a heap-allocated int64_t. To avoid allocation per cell,
+ * homogenous tables of such types store the integers directly in the rows
+ * and a pointer to the integer then serves as the value_t for the value type
+ * methods. */
+#define IS_INLINE64(contents)        \
+     ((contents)->mask & TABLE_CONTENTS_INLINE64)
+
+#define TABLE_TYPE_NEEDS_INLINE64(type)                                    \
+     (sizeof(value_t) < sizeof(int64_t)  &&                                \
+      ((type) == VALUE_TYPE_INT64  ||  (type) == VALUE_TYPE_UINT64))
+
+#define TABLE_ROW_VALUES(row)                  ((value_t*) (row))
+#define TABLE_ROW_VALUES64(row)                ((int64_t*) (row))
+#define TABLE_ROW_TYPES(contents, row)                                     \
+     ((value_type_t**) ((row) + (contents)->types_offset))
+#define TABLE_ROW_FOREGROUNDS(contents, row)                               \
+     ((COLORREF*) ((row) + (contents)->foregrounds_offset))
+#define TABLE_ROW_BACKGROUNDS(contents, row)                               \
+     ((COLORREF*) ((row) + (contents)->backgrounds_offset))
+#define TABLE_ROW_FLAGS(contents, row)                                     \
+     ((BYTE*) ((row) + (contents)->flags_offset))
+
+/* Inlined 64-bit integer of empty cells (which have no row data). */
+static int64_t table_zero64 = 0;
+
+static inline size_t
+table_contents_value_size(DWORD mask)
+{
+    return ((mask & TABLE_CONTENTS_INLINE64) ? sizeof(int64_t) : sizeof(value_t));
+}
+
+/* (row is data of the row as returned by table_blocks_row(); may be NULL.) */
+static inline value_t
+table_contents_value(const table_contents_t* contents, BYTE* row, DWORD col)
+{
+    if(IS_INLINE64(contents))
+        return (value_t) (row != NULL ? &TABLE_ROW_VALUES64(row)[col] : &table_zero64);
+    else
+        return (row != NULL ? TABLE_ROW_VALUES(row)[col] : NULL);
+}
+
+static void
+table_contents_init_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_contents_t* contents = (table_contents_t*) ctx;
+    DWORD i;
+
+    /* __stosd() intrinsic is intended for 32-bit */
+    MC_ASSERT(sizeof(COLORREF) == sizeof(DWORD));
+
+    memset(data, 0, row_count * contents->blocks.row_size);
+    if(!(contents->mask & (TABLE_CONTENTS_FOREGROUNDS | TABLE_CONTENTS_BACKGROUNDS)))
+        return;
+
+    for(i = 0; i < row_count; i++) {
+        BYTE* row = data + i * contents->blocks.row_size;
+
+        if(contents->mask & TABLE_CONTENTS_FOREGROUNDS)
+            __stosd(TABLE_ROW_FOREGROUNDS(contents, row), MC_CLR_DEFAULT, contents->col_count);
+        if(contents->mask & TABLE_CONTENTS_BACKGROUNDS)
+            __stosd(TABLE_ROW_BACKGROUNDS(contents, row), MC_CLR_NONE, contents->col_count);
+    }
+}
+
+static void
+table_contents_destroy_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_contents_t* contents = (table_contents_t*) ctx;
+    DWORD i, col;
+
+    /* Inlined integers own nothing. */
+    if(IS_INLINE64(contents))
+        return;
+
+    if(IS_HOMOGENOUS(contents)) {
+        void (*destroy)(value_t);
+
+        /* Values of scalar types own nothing, so there is nothing to do.
+         * Otherwise resolve the destructor just once for all the cells. */
+        MC_ASSERT(contents->type != NULL);
+        if(value_type_is_trivial(contents->type))
+            return;
+        destroy = contents->type->destroy;
+
+        for(i = 0; i < row_count; i++) {
+            value_t* values = TABLE_ROW_VALUES(data + i * contents->blocks.row_size);
+
+            for(col = 0; col < contents->col_count; col++) {
+                if(values[col] != NULL)
+                    destroy(values[col]);
+            }
+        }
+        return;
+    }
+
+    for(i = 0; i < row_count; i++) {
+        BYTE* row = data + i * contents->blocks.row_size;
+        value_t* values = TABLE_ROW_VALUES(row);
+        value_type_t** types = TABLE_ROW_TYPES(contents, row);
+
+        for(col = 0; col < contents->col_count; col++) {
+            if(values[col] == NULL)
+                continue;
+            MC_ASSERT(types[col] != NULL);
+            types[col]->destroy(values[col]);
+        }
+    }
+}
+
+static int
+table_contents_dup_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_contents_t* contents = (table_contents_t*) ctx;
+    DWORD i, col;
+
+    if(IS_INLINE64(contents))
+        return 0;
+    if(IS_HOMOGENOUS(contents)  &&  value_type_is_trivial(contents->type))
+        return 0;
+
+    for(i = 0; i < row_count; i++) {
+        BYTE* row = data + i * contents->blocks.row_size;
+        value_t* values = TABLE_ROW_VALUES(row);
+
+        for(col = 0; col < contents->col_count; col++) {
+            value_type_t* type;
+            value_t copy;
+
+            if(values[col] == NULL)
+                continue;
+
+            type = (IS_HOMOGENOUS(contents) ? contents->type
+                                            : TABLE_ROW_TYPES(contents, row)[col]);
+            if(MC_ERR(type->copy(&copy, values[col]) != 0)) {
+                MC_TRACE("table_contents_dup_rows: Value copy failed.");
+
+                /* Forget the values not copied yet, and destroy the copies
+                 * made so far. */
+                for(; i < row_count; i++, col = 0) {
+                    values = TABLE_ROW_VALUES(data + i * contents->blocks.row_size);
+                    memset(&values[col], 0, (contents->col_count - col) * sizeof(value_t));
+                }
+                table_contents_destroy_rows(contents, data, row_count);
+                return -1;
+            }
+            values[col] = copy;
+        }
+    }
+    return 0;
+}
+
+static const table_block_ops_t table_contents_block_ops = {
+    table_contents_init_rows,
+    table_contents_dup_rows,
+    table_contents_destroy_rows
+};
+
+static int
+table_contents_alloc(table_contents_t* contents, value_type_t* homotype,
+                     DWORD col_count, DWORD row_count, DWORD mask)
+{
+    size_t cell_size;
+    size_t offset;
+
+    MC_ASSERT(mask & TABLE_CONTENTS_VALUES);
+    MC_ASSERT( ((mask & TABLE_CONTENTS_TYPES)  &&  homotype == NULL) ||
+              !((mask & TABLE_CONTENTS_TYPES)  &&  homotype != NULL));
+
+    /* In the sparse mode, the attributes do not occupy the dense arrays. */
+    contents->attr_mask = mask & TABLE_CONTENTS_ATTRS;
+    if(mask & TABLE_CONTENTS_SPARSE)
+        mask &= ~TABLE_CONTENTS_ATTRS;
+    table_sparse_init(&contents->sparse);
+
+    contents->mask = mask;
+    contents->col_count = col_count;
+    contents->row_count = row_count;
+    contents->type = homotype;
+
+    /* With 32-bit dimensions the row size can overflow size_t (in 32-bit
+     * build), so check it before we multiply. */
+    cell_size = table_contents_value_size(mask);
+    if(mask & TABLE_CONTENTS_TYPES)
+        cell_size += sizeof(value_type_t*);
+    if(mask & TABLE_CONTENTS_FOREGROUNDS)
+        cell_size += sizeof(COLORREF);
+    if(mask & TABLE_CONTENTS_BACKGROUNDS)
+        cell_size += sizeof(COLORREF);
+    if(mask & TABLE_CONTENTS_FLAGS)
+        cell_size += sizeof(BYTE);
+    if(MC_ERR(col_count > (((size_t)-1) - 7) / cell_size)) {
+        MC_TRACE("table_contents_alloc: Too many columns (%lu).", (ULONG)col_count);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
+    }
+
+    /* Layout of the row. (The arrays are ordered so that each is aligned
+     * naturally.) */
+    offset = col_count * table_contents_value_size(mask);
+    contents->types_offset = offset;
+    if(mask & TABLE_CONTENTS_TYPES)
+        offset += col_count * sizeof(value_type_t*);
+    contents->foregrounds_offset = offset;
+    if(mask & TABLE_CONTENTS_FOREGROUNDS)
+        offset += col_count * sizeof(COLORREF);
+    contents->backgrounds_offset = offset;
+    if(mask & TABLE_CONTENTS_BACKGROUNDS)
+        offset += col_count * sizeof(COLORREF);
+    contents->flags_offset = offset;
+    if(mask & TABLE_CONTENTS_FLAGS)
+        offset += col_count * sizeof(BYTE);
+
+    /* The blocks are allocated on the first write, so all cells are empty
+     * now. */
+    if(MC_ERR(table_blocks_init(&contents->blocks, (offset + 7) & ~7) != 0)) {
+        MC_TRACE("table_contents_alloc: table_blocks_init() failed.");
+        return -1;
+    }
+    if(MC_ERR(table_blocks_reserve(&contents->blocks, row_count) != 0)) {
+        MC_TRACE("table_contents_alloc: table_blocks_reserve() failed.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Destroys all values and frees the contents. */
+static void
+table_contents_free(table_contents_t* contents)
+{
+    table_blocks_fini(&contents->blocks, &table_contents_block_ops, contents);
+    table_sparse_fini(&contents->sparse);
+}
+
+/* Makes rows [row0, row1) modifiable (see table_blocks_ensure()). */
+static inline int
+table_contents_ensure(table_contents_t* contents, DWORD row0, DWORD row1)
+{
+    return table_blocks_ensure(&contents->blocks, row0, row1,
+                               &table_contents_block_ops, contents);
+}
+
+/* Destroys values of cells in the region. The rows must have been made
+ * modifiable. */
+static void
+table_contents_free_region(table_contents_t* contents, table_region_t* region)
+{
+    DWORD row, col;
+
+    /* Inlined integers own nothing. */
+    if(IS_INLINE64(contents))
+        return;
+
+    if(IS_HOMOGENOUS(contents)) {
+        void (*destroy)(value_t);
+
+        MC_ASSERT(contents->type != NULL);
+        if(value_type_is_trivial(contents->type))
+            return;
+        destroy = contents->type->destroy;
+
+        for(row = region->row0; row < region->row1; row++) {
+            BYTE* r = table_blocks_row(&contents->blocks, row);
+
+            if(r == NULL)
+                continue;
+            for(col = region->col0; col < region->col1; col++) {
+                if(TABLE_ROW_VALUES(r)[col] != NULL)
+                    destroy(TABLE_ROW_VALUES(r)[col]);
+            }
+        }
+        return;
+    }
+
+    for(row = region->row0; row < region->row1; row++) {
+        BYTE* r = table_blocks_row(&contents->blocks, row);
+
+        if(r == NULL)
+            continue;
+        for(col = region->col0; col < region->col1; col++) {
+            value_type_t* t;
+
+            if(TABLE_ROW_VALUES(r)[col] == NULL)
+                continue;
+
+            t = TABLE_ROW_TYPES(contents, r)[col];
+            MC_ASSERT(t != NULL);
+            t->destroy(TABLE_ROW_VALUES(r)[col]);
+        }
+    }
+}
+
+/* Copies sparse attributes of cells which exist in both the contents into
+ * the (new) contents contents_to. */
+static int
+table_contents_copy_sparse(const table_contents_t* contents_from,
+                           table_contents_t* contents_to)
+{
+    const table_sparse_t* from = &contents_from->sparse;
+    size_t i;
+
+    MC_ASSERT(IS_SPARSE(contents_from)  &&  IS_SPARSE(contents_to));
+
+    if(from->count == 0)
+        return 0;
+
+    if(MC_ERR(table_sparse_reserve(&contents_to->sparse, from->count) != 0)) {
+        MC_TRACE("table_contents_copy_sparse: table_sparse_reserve() failed.");
+        return -1;
+    }
+
+    for(i = 0; i < from->capacity; i++) {
+        const table_attr_t* attr = &from->slots[i];
+        table_attr_t* attr_to;
+        DWORD col, row;
+
+        if(attr->index == TABLE_SPARSE_EMPTY)
+            continue;
+
+        col = (DWORD) (attr->index % contents_from->col_count);
+        row = (DWORD) (attr->index / contents_from->col_count);
+        if(col >= contents_to->col_count  ||  row >= contents_to->row_count)
+            continue;
+
+        attr_to = table_sparse_insert(&contents_to->sparse,
+                                      row * (size_t)contents_to->col_count + col);
+        MC_ASSERT(attr_to != NULL);  /* We have reserved enough space. */
+        attr_to->foreground = attr->foreground;
+        attr_to->background = attr->background;
+        attr_to->flags = attr->flags;
+    }
+
+    return 0;
+}
+
+/* Moves all cells into a new storage with the given dimensions and the given
+ * set of arrays in the rows. Values of cells which do not fit are destroyed. */
+static int
+table_contents_relayout(table_contents_t* contents, DWORD col_count,
+                        DWORD row_count, DWORD mask)
+{
+    table_contents_t tmp;
+    table_region_t region;
+    DWORD col, row;
+    DWORD n_cols = MC_MIN(col_count, contents->col_count);
+    DWORD n_rows = MC_MIN(row_count, contents->row_count);
+    size_t i;
+
+    if(MC_ERR(table_contents_alloc(&tmp,
+                    (IS_HOMOGENOUS(contents) ? contents->type : NULL),
+                    col_count, row_count, mask) != 0)) {
+        MC_TRACE("table_contents_relayout: table_contents_alloc() failed.");
+        return -1;
+    }
+
+    /* Values are moved (not copied) into the new storage, so the old one
+     * must not share any rows with a snapshot. */
+    if(MC_ERR(table_contents_ensure(contents, 0, contents->row_count) != 0  ||
+              table_contents_ensure(&tmp, 0, n_rows) != 0)) {
+        MC_TRACE("table_contents_relayout: table_contents_ensure() failed.");
+        table_contents_free(&tmp);
+        return -1;
+    }
+
+    if(IS_SPARSE(contents)  &&  IS_SPARSE(&tmp)) {
+        if(MC_ERR(table_contents_copy_sparse(contents, &tmp) != 0)) {
+            MC_TRACE("table_contents_relayout: table_contents_copy_sparse() failed.");
+            table_contents_free(&tmp);
+            return -1;
+        }
+    }
+
+    /* Nothing may fail from now on. Move intersected cells. */
+    for(row = 0; row < n_rows  &&  n_cols > 0; row++) {
+        BYTE* from = table_blocks_row(&contents->blocks, row);
+        BYTE* to = table_blocks_row(&tmp.blocks, row);
+
+        memcpy(to, from, n_cols * table_contents_value_size(contents->mask));
+        if(tmp.mask & TABLE_CONTENTS_TYPES)
+            memcpy(TABLE_ROW_TYPES(&tmp, to), TABLE_ROW_TYPES(contents, from), n_cols * sizeof(value_type_t*));
+        if(tmp.mask & contents->mask & TABLE_CONTENTS_FOREGROUNDS)
+            memcpy(TABLE_ROW_FOREGROUNDS(&tmp, to), TABLE_ROW_FOREGROUNDS(contents, from), n_cols * sizeof(COLORREF));
+        if(tmp.mask & contents->mask & TABLE_CONTENTS_BACKGROUNDS)
+            memcpy(TABLE_ROW_BACKGROUNDS(&tmp, to), TABLE_ROW_BACKGROUNDS(contents, from), n_cols * sizeof(COLORREF));
+        if(tmp.mask & contents->mask & TABLE_CONTENTS_FLAGS)
+            memcpy(TABLE_ROW_FLAGS(&tmp, to), TABLE_ROW_FLAGS(contents, from), n_cols * sizeof(BYTE));
+    }
+
+    /* Attributes moving from the sparse storage to the dense one. */
+    if(IS_SPARSE(contents)  &&  !IS_SPARSE(&tmp)) {
+        for(i = 0; i < contents->sparse.capacity; i++) {
+            table_attr_t* attr = &contents->sparse.slots[i];
+            BYTE* to;
+
+            if(attr->index == TABLE_SPARSE_EMPTY)
+                continue;
+
+            col = (DWORD) (attr->index % contents->col_count);
+            row = (DWORD) (attr->index / contents->col_count);
+            if(col >= n_cols  ||  row >= n_rows)
+                continue;
+
+            to = table_blocks_row(&tmp.blocks, row);
+            if(tmp.mask & TABLE_CONTENTS_FOREGROUNDS)
+                TABLE_ROW_FOREGROUNDS(&tmp, to)[col] = attr->foreground;
+            if(tmp.mask & TABLE_CONTENTS_BACKGROUNDS)
+                TABLE_ROW_BACKGROUNDS(&tmp, to)[col] = attr->background;
+            if(tmp.mask & TABLE_CONTENTS_FLAGS)
+                TABLE_ROW_FLAGS(&tmp, to)[col] = (BYTE) attr->flags;
+        }
+    }
+
+    /* Free values of cells which do not survive */
+    if(col_count < contents->col_count) {
+        region.col0 = col_count;
+        region.row0 = 0;
+        region.col1 = contents->col_count;
+        region.row1 = n_rows;
+        table_contents_free_region(contents, &region);
+    }
+    if(row_count < contents->row_count) {
+        region.col0 = 0;
+        region.row0 = row_count;
+        region.col1 = contents->col_count;
+        region.row1 = contents->row_count;
+        table_contents_free_region(contents, &region);
+    }
+
+    /* All the other values have been moved, so just free the old blocks.
+     * (Blocks still shared with a snapshot have no rows in use by us.) */
+    table_blocks_fini(&contents->blocks, NULL, NULL);
+    table_sparse_fini(&contents->sparse);
+    memcpy(contents, &tmp, sizeof(table_contents_t));
+    return 0;
+}
+
+/* Switches contents from the sparse attribute storage to the dense one. */
+static int
+table_contents_densify(table_contents_t* contents)
+{
+    MC_ASSERT(IS_SPARSE(contents));
+
+    TABLE_TRACE("table_contents_densify: %lu attributes in %lu x %lu table",
+                (ULONG)contents->sparse.count, (ULONG)contents->col_count,
+                (ULONG)contents->row_count);
+
+    return table_contents_relayout(contents, contents->col_count,
+                contents->row_count,
+                (contents->mask & ~TABLE_CONTENTS_SPARSE) | contents->attr_mask);
+}
+
+/* Updates keys of sparse attributes after inserting (or before deleting)
+ * count rows at the position row. Attributes of deleted rows are dropped. */
+static int
+table_contents_shift_sparse(table_contents_t* contents, DWORD row,
+                            DWORD count, BOOL insert)
+{
+    table_sparse_t* sparse = &contents->sparse;
+    table_sparse_t tmp;
+    size_t i;
+
+    if(!IS_SPARSE(contents)  ||  sparse->count == 0)
+        return 0;
+
+    table_sparse_init(&tmp);
+    if(MC_ERR(table_sparse_reserve(&tmp, sparse->count) != 0)) {
+        MC_TRACE("table_contents_shift_sparse: table_sparse_reserve() failed.");
+        return -1;
+    }
+
+    for(i = 0; i < sparse->capacity; i++) {
+        table_attr_t* attr = &sparse->slots[i];
+        table_attr_t* attr_to;
+        DWORD r, c;
+
+        if(attr->index == TABLE_SPARSE_EMPTY)
+            continue;
+
+        r = (DWORD) (attr->index / contents->col_count);
+        c = (DWORD) (attr->index % contents->col_count);
+        if(insert) {
+            if(r >= row)
+                r += count;
+        } else {
+            if(r >= row + count)
+                r -= count;
+            else if(r >= row)
+                continue;
+        }
+
+        attr_to = table_sparse_insert(&tmp, r * (size_t)contents->col_count + c);
+        MC_ASSERT(attr_to != NULL);  /* We have reserved enough space. */
+        attr_to->foreground = attr->foreground;
+        attr_to->background = attr->background;
+        attr_to->flags = attr->flags;
+    }
+
+    table_sparse_fini(sparse);
+    memcpy(sparse, &tmp, sizeof(table_sparse_t));
+    return 0;
+}
+
+
+/***************************
+ *** Virtual table cache ***
+ ***************************/
+
+/* Virtual tables do not store any cells. Instead they ask application for
+ * the cells when needed. To limit the count of such requests, the fetched
+ * cells are remembered in a small LRU cache.
+ *
+ * The entries live in a fixed array. They are reachable through a hash table
+ * (chained via hash_next) and they are also kept in a doubly-linked LRU list
+ * so the least recently used entry can be recycled in O(1) time. */
+
+#define TABLE_VCACHE_NIL      ((DWORD) -1)
+
+typedef struct table_vcache_entry_tag table_vcache_entry_t;
+struct table_vcache_entry_tag {
+    DWORD col;
+    DWORD row;
+    value_type_t* type;
+    value_t value;
+    COLORREF foreground;
+    COLORREF background;
+    DWORD flags;
+    DWORD hash_next;
+    DWORD lru_prev;         /* more recently used neighbor */
+    DWORD lru_next;         /* less recently used neighbor */
+};
+
+typedef struct table_vcache_tag table_vcache_t;
+struct table_vcache_tag {
+    DWORD capacity;
+    DWORD count;
+    DWORD bucket_mask;
+    DWORD lru_head;         /* most recently used entry */
+    DWORD lru_tail;         /* least recently used entry */
+    DWORD* buckets;
+    table_vcache_entry_t* entries;
+};
+
+static inline DWORD
+table_vcache_bucket(table_vcache_t* cache, DWORD col, DWORD row)
+{
+    return (row * 2654435761U + col) & cache->bucket_mask;
+}
+
+static void
+table_vcache_flush(table_vcache_t* cache)
+{
+    DWORD i;
+
+    for(i = 0; i < cache->count; i++) {
+        table_vcache_entry_t* e = &cache->entries[i];
+        if(e->type != NULL  &&  e->value != NULL)
+            e->type->destroy(e->value);
+    }
+
+    memset(cache->buckets, 0xff, (cache->bucket_mask + 1) * sizeof(DWORD));
+    cache->count = 0;
+    cache->lru_head = TABLE_VCACHE_NIL;
+    cache->lru_tail = TABLE_VCACHE_NIL;
+}
+
+static int
+table_vcache_init(table_vcache_t* cache, DWORD capacity)
+{
+    DWORD bucket_count;
+    BYTE* mem;
+
+    /* We need at least one entry so the value returned by table_get_cell()
+     * stays alive until the next fetch. */
+    if(capacity == 0)
+        capacity = 1;
+
+    if(MC_ERR(capacity > 0x10000000)) {
+        MC_TRACE("table_vcache_init: Cache size %lu too large.", (ULONG)capacity);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return -1;
+    }
+
+    /* Keep the load factor of the hash table at most 1/2. */
+    bucket_count = 1;
+    while(bucket_count < 2 * capacity)
+        bucket_count <<= 1;
+
+    mem = (BYTE*) malloc(capacity * sizeof(table_vcache_entry_t) +
+                         bucket_count * sizeof(DWORD));
+    if(MC_ERR(mem == NULL)) {
+        MC_TRACE("table_vcache_init: malloc() failed.");
+        return -1;
+    }
+
+    cache->capacity = capacity;
+    cache->bucket_mask = bucket_count - 1;
+    cache->entries = (table_vcache_entry_t*) mem;
+    cache->buckets = (DWORD*) (mem + capacity * sizeof(table_vcache_entry_t));
+    cache->count = 0;
+    table_vcache_flush(cache);
+    return 0;
+}
+
+static void
+table_vcache_fini(table_vcache_t* cache)
+{
+    table_vcache_flush(cache);
+    /* ->buckets share the allocated chunk with ->entries. */
+    free(cache->entries);
+}
+
+static void
+table_vcache_lru_unlink(table_vcache_t* cache, DWORD i)
+{
+    table_vcache_entry_t* e = &cache->entries[i];
+
+    if(e->lru_prev != TABLE_VCACHE_NIL)
+        cache->entries[e->lru_prev].lru_next = e->lru_next;
+    else
+        cache->lru_head = e->lru_next;
+
+    if(e->lru_next != TABLE_VCACHE_NIL)
+        cache->entries[e->lru_next].lru_prev = e->lru_prev;
+    else
+        cache->lru_tail = e->lru_prev;
+}
+
+static void
+table_vcache_lru_push(table_vcache_t* cache, DWORD i)
+{
+    table_vcache_entry_t* e = &cache->entries[i];
+
+    e->lru_prev = TABLE_VCACHE_NIL;
+    e->lru_next = cache->lru_head;
+    if(cache->lru_head != TABLE_VCACHE_NIL)
+        cache->entries[cache->lru_head].lru_prev = i;
+    else
+        cache->lru_tail = i;
+    cache->lru_head = i;
+}
+
+static table_vcache_entry_t*
+table_vcache_lookup(table_vcache_t* cache, DWORD col, DWORD row)
+{
+    DWORD i;
+
+    i = cache->buckets[table_vcache_bucket(cache, col, row)];
+    while(i != TABLE_VCACHE_NIL) {
+        table_vcache_entry_t* e = &cache->entries[i];
+
+        if(e->col == col  &&  e->row == row) {
+            if(cache->lru_head != i) {
+                table_vcache_lru_unlink(cache, i);
+                table_vcache_lru_push(cache, i);
+            }
+            return e;
+        }
+        i = e->hash_next;
+    }
+
+    return NULL;
+}
+
+/* Gets an entry for the cell [col, row], which must not be in the cache yet.
+ * If the cache is full, the least recently used entry is recycled. */
+static table_vcache_entry_t*
+table_vcache_insert(table_vcache_t* cache, DWORD col, DWORD row)
+{
+    table_vcache_entry_t* e;
+    DWORD* link;
+    DWORD i;
+
+    if(cache->count < cache->capacity) {
+        i = cache->count++;
+        e = &cache->entries[i];
+    } else {
+        i = cache->lru_tail;
+        e = &cache->entries[i];
+
+        /* Remove the victim from its hash chain. */
+        link = &cache->buckets[table_vcache_bucket(cache, e->col, e->row)];
+        while(*link != i)
+            link = &cache->entries[*link].hash_next;
+        *link = e->hash_next;
+
+        table_vcache_lru_unlink(cache, i);
+        if(e->type != NULL  &&  e->value != NULL)
+            e->type->destroy(e->value);
+    }
+
+    e->col = col;
+    e->row = row;
+    link = &cache->buckets[table_vcache_bucket(cache, col, row)];
+    e->hash_next = *link;
+    *link = i;
+    table_vcache_lru_push(cache, i);
+    return e;
+}
 
-typedef struct table_contents_tag table_contents_t;
-struct table_contents_tag {
-    DWORD mask;
-    WORD col_count;
-    WORD row_count;
-    value_t* values;
-    union {
-        value_type_t* type;    /* if homogenous */
-        value_type_t** types;  /* if heterogenous */
-    };
-    COLORREF* foregrounds;
-    COLORREF* backgrounds;
-    BYTE* flags;               /* Now all public cell bits fit into single byte. In future we may need to extend this to WORD or DWORD. */
+
+/******************************
+ *** Column-oriented values ***
+ ******************************/
+
+/* Column-oriented tables keep values of each column separately (in blocks of
+ * rows, see above), with a fixed value type per column. Adding rows is then
+ * cheap and it does not move the existing values at all. (Cell attributes of
+ * such tables are always stored sparsely; their keys do not depend on the
+ * row count.) */
+
+typedef struct table_column_tag table_column_t;
+struct table_column_tag {
+    value_type_t* type;
+    table_blocks_t blocks;     /* Row holds value_t, or int64_t if inline64 */
+    BOOL inline64;             /* (see IS_INLINE64()) */
 };
 
-#define IS_HOMOGENOUS(contents)      \
-     (!((contents)->mask & TABLE_CONTENTS_TYPES))
+typedef struct table_columns_tag table_columns_t;
+struct table_columns_tag {
+    table_column_t* cols;
+};
 
+static void
+table_column_init_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_column_t* column = (table_column_t*) ctx;
 
-static int
-table_contents_alloc(table_contents_t* contents, value_type_t* homotype,
-                     WORD col_count, WORD row_count, DWORD mask)
-{
-    static const struct {
-        DWORD mask_bit;
-        size_t size;
-    } SIZE_MAP[] = {
-        { TABLE_CONTENTS_VALUES,      sizeof(value_t*) },
-        { TABLE_CONTENTS_TYPES,       sizeof(value_type_t*) },
-        { TABLE_CONTENTS_FOREGROUNDS, sizeof(COLORREF) },
-        { TABLE_CONTENTS_BACKGROUNDS, sizeof(COLORREF) },
-        { TABLE_CONTENTS_FLAGS,       sizeof(BYTE) }
-    };
-    size_t partsize[MC_ARRAY_SIZE(SIZE_MAP)];
-    void** partptr[MC_ARRAY_SIZE(SIZE_MAP)];
-    int i;
-    size_t size = 0;
-    BYTE* mem;
+    memset(data, 0, row_count * column->blocks.row_size);
+}
 
-    MC_ASSERT(mask & TABLE_CONTENTS_VALUES);
-    MC_ASSERT( ((mask & TABLE_CONTENTS_TYPES)  &&  homotype == NULL) ||
-              !((mask & TABLE_CONTENTS_TYPES)  &&  homotype != NULL));
+static void
+table_column_destroy_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_column_t* column = (table_column_t*) ctx;
+    value_t* values = (value_t*) data;
+    void (*destroy)(value_t) = column->type->destroy;
+    DWORD i;
 
-    contents->mask = mask;
-    contents->col_count = col_count;
-    contents->row_count = row_count;
+    if(column->inline64  ||  value_type_is_trivial(column->type))
+        return;
+
+    for(i = 0; i < row_count; i++) {
+        if(values[i] != NULL)
+            destroy(values[i]);
+    }
+}
 
-    partptr[0] = (void**) &contents->values;
-    partptr[1] = (void**) &contents->types;
-    partptr[2] = (void**) &contents->foregrounds;
-    partptr[3] = (void**) &contents->backgrounds;
-    partptr[4] = (void**) &contents->flags;
-
-    /* Zero-sized table is simple */
-    if(col_count == 0  ||  row_count == 0) {
-        for(i = 0; i < MC_ARRAY_SIZE(SIZE_MAP); i++)
-            *partptr[i] = NULL;
-        contents->type = homotype;
+static int
+table_column_dup_rows(void* ctx, BYTE* data, DWORD row_count)
+{
+    table_column_t* column = (table_column_t*) ctx;
+    value_t* values = (value_t*) data;
+    value_t copy;
+    DWORD i;
+
+    if(column->inline64  ||  value_type_is_trivial(column->type))
         return 0;
+
+    for(i = 0; i < row_count; i++) {
+        if(values[i] == NULL)
+            continue;
+        if(MC_ERR(column->type->copy(&copy, values[i]) != 0)) {
+            MC_TRACE("table_column_dup_rows: Value copy failed.");
+            memset(&values[i], 0, (row_count - i) * sizeof(value_t));
+            table_column_destroy_rows(column, data, row_count);
+            return -1;
+        }
+        values[i] = copy;
     }
+    return 0;
+}
+
+static const table_block_ops_t table_column_block_ops = {
+    table_column_init_rows,
+    table_column_dup_rows,
+    table_column_destroy_rows
+};
+
+static inline value_t
+table_column_value(const table_column_t* column, DWORD row)
+{
+    BYTE* data = table_blocks_row(&column->blocks, row);
+
+    if(column->inline64)
+        return (value_t) (data != NULL ? (int64_t*) data : &table_zero64);
+    else
+        return (data != NULL ? *((value_t*) data) : NULL);
+}
+
+/* The column takes ownership of the value. The row must have been made
+ * modifiable. */
+static void
+table_column_set_value(table_column_t* column, DWORD row, value_t value)
+{
+    BYTE* data = table_blocks_row(&column->blocks, row);
 
-    /* Calculate byte sizes for each needed property and their sume. */
-    for(i = 0; i < MC_ARRAY_SIZE(SIZE_MAP); i++) {
-        if(mask & SIZE_MAP[i].mask_bit) {
-            partsize[i] = SIZE_MAP[i].size * col_count * row_count;
-            size += partsize[i];
+    if(column->inline64) {
+        if(value != NULL) {
+            *((int64_t*) data) = *((int64_t*) value);
+            column->type->destroy(value);
         } else {
-            partsize[i] = 0;
+            *((int64_t*) data) = 0;
         }
+    } else {
+        if(*((value_t*) data) != NULL)
+            column->type->destroy(*((value_t*) data));
+        *((value_t*) data) = value;
     }
+}
 
-    /* Allocation */
-    mem = (BYTE*) malloc(size);
-    if(MC_ERR(mem == NULL)) {
-        MC_TRACE("table_contents_alloc: malloc() failed.");
-        return -1;
+static int
+table_columns_init(table_columns_t* columns, DWORD col_count,
+                   value_type_t** types)
+{
+    DWORD col;
+
+    if(col_count == 0) {
+        columns->cols = NULL;
+        return 0;
     }
 
-    /* Setup all pointers to the inside of the allocated chunk */
-    for(i = 0; i < MC_ARRAY_SIZE(SIZE_MAP); i++) {
-        if(partsize[i] > 0) {
-            *partptr[i] = mem;
-            mem += partsize[i];
-        } else {
-            *partptr[i] = NULL;
-        }
+    if(MC_ERR(col_count > ((size_t)-1) / sizeof(table_column_t))) {
+        MC_TRACE("table_columns_init: Too many columns.");
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return -1;
     }
 
-    /* If needed, setup homogenous table type */
-    if(IS_HOMOGENOUS(contents)) {
-        MC_ASSERT(contents->types == NULL);
-        contents->type = homotype;
+    columns->cols = (table_column_t*) malloc(col_count * sizeof(table_column_t));
+    if(MC_ERR(columns->cols == NULL)) {
+        MC_TRACE("table_columns_init: malloc() failed.");
+        return -1;
     }
 
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
+
+        column->type = types[col];
+        column->inline64 = TABLE_TYPE_NEEDS_INLINE64(types[col]);
+        table_blocks_init(&column->blocks,
+                    (column->inline64 ? sizeof(int64_t) : sizeof(value_t)));
+    }
     return 0;
 }
 
+/* Destroys all the values and frees the columns. */
 static void
-table_contents_free(table_contents_t* contents)
+table_columns_fini(table_columns_t* columns, DWORD col_count)
 {
-    /* Buffers for all table attributes share one allocated chunk
-     * and ->values is the first of them. */
-    if(contents->values)
-        free(contents->values);
+    DWORD col;
+
+    if(columns->cols == NULL)
+        return;
+
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
+        table_blocks_fini(&column->blocks, &table_column_block_ops, column);
+    }
+    free(columns->cols);
 }
 
-static void
-table_contents_init_region(table_contents_t* contents, table_region_t* region)
+/* Makes sure each column has room for row_count rows. */
+static int
+table_columns_reserve(table_columns_t* columns, DWORD col_count, DWORD row_count)
 {
-    WORD row;
-
-    /* __stosd() intrinsic is intended for 32-bit */
-    MC_ASSERT(sizeof(COLORREF) == sizeof(DWORD));
+    DWORD col;
 
-    /* Case 0: empty region */
-    if(region->col1 - region->col0 == 0 || region->row1 - region->row0 == 0)
-        return;
+    /* On failure, columns already grown just have some more spare room. */
+    for(col = 0; col < col_count; col++) {
+        if(MC_ERR(table_blocks_reserve(&columns->cols[col].blocks, row_count) != 0)) {
+            MC_TRACE("table_columns_reserve: table_blocks_reserve() failed.");
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    /* Case 1: region contains complete lines */
-    if(region->col0 == 0 && region->col1 == contents->col_count) {
-        DWORD cell0 = region->row0 * (DWORD)contents->col_count;
-        DWORD cell_count = (region->row1 - region->row0) * (DWORD)contents->col_count;
+/* Makes rows [row0, row1) of all columns modifiable. */
+static int
+table_columns_ensure(table_columns_t* columns, DWORD col_count,
+                     DWORD row0, DWORD row1)
+{
+    DWORD col;
 
-        if(contents->mask & TABLE_CONTENTS_VALUES)
-            memset(&contents->values[cell0], 0, cell_count * sizeof(value_t));
-        if(contents->mask & TABLE_CONTENTS_TYPES)
-            memset(&contents->types[cell0], 0, cell_count * sizeof(value_type_t*));
-        if(contents->mask & TABLE_CONTENTS_FOREGROUNDS)
-            memset(&contents->foregrounds[cell0], 0, cell_count * sizeof(COLORREF));
-        if(contents->mask & TABLE_CONTENTS_BACKGROUNDS)
-            __stosd(&contents->backgrounds[cell0], MC_CLR_NONE, cell_count);
-        if(contents->mask & TABLE_CONTENTS_FLAGS)
-            __stosd(&contents->backgrounds[cell0], MC_CLR_DEFAULT, cell_count);
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
 
-        return;
+        if(MC_ERR(table_blocks_ensure(&column->blocks, row0, row1,
+                                      &table_column_block_ops, column) != 0)) {
+            MC_TRACE("table_columns_ensure: table_blocks_ensure() failed.");
+            return -1;
+        }
     }
+    return 0;
+}
 
-    /* Case 2: general case */
-    for(row = region->row0; row < region->row1; row++) {
-        DWORD cell0 = row * (DWORD)contents->col_count + region->col0;
-        DWORD cell_count = region->col1 - region->col0;
+/* Resets rows [row0, row1) without destroying their values. */
+static void
+table_columns_init_rows(table_columns_t* columns, DWORD col_count,
+                        DWORD row0, DWORD row1)
+{
+    DWORD col;
 
-        if(contents->mask & TABLE_CONTENTS_VALUES)
-            memset(&contents->values[cell0], 0, cell_count * sizeof(value_t));
-        if(contents->mask & TABLE_CONTENTS_TYPES)
-            memset(&contents->types[cell0], 0, cell_count * sizeof(value_type_t*));
-        if(contents->mask & TABLE_CONTENTS_FOREGROUNDS)
-            memset(&contents->foregrounds[cell0], 0, cell_count * sizeof(COLORREF));
-        if(contents->mask & TABLE_CONTENTS_BACKGROUNDS)
-            __stosd(&contents->backgrounds[cell0], MC_CLR_NONE, cell_count);
-        if(contents->mask & TABLE_CONTENTS_FLAGS)
-            __stosd(&contents->backgrounds[cell0], MC_CLR_DEFAULT, cell_count);
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
+        table_blocks_init_rows(&column->blocks, row0, row1,
+                               &table_column_block_ops, column);
     }
 }
 
+/* Moves rows [row_from, row_from + count) to row_to. The regions may overlap. */
 static void
-table_contents_free_region(table_contents_t* contents, table_region_t* region)
+table_columns_move_rows(table_columns_t* columns, DWORD col_count,
+                        DWORD row_from, DWORD row_to, DWORD count)
 {
-    WORD row, col;
+    DWORD col;
 
-    for(row = region->row0; row < region->row1; row++) {
-        for(col = region->col0; col < region->col1; col++) {
-            DWORD index = row * (DWORD)contents->col_count + col;
-            value_type_t* t;
+    for(col = 0; col < col_count; col++)
+        table_blocks_move_rows(&columns->cols[col].blocks, row_from, row_to, count);
+}
 
-            if(contents->values[index] == NULL)
-                continue;
+/* Destroys values in rows [row0, row1). The rows must have been made
+ * modifiable. */
+static void
+table_columns_free_rows(table_columns_t* columns, DWORD col_count,
+                        DWORD row0, DWORD row1)
+{
+    DWORD col, row;
 
-            if(IS_HOMOGENOUS(contents))
-                t = contents->type;
-            else
-                t = contents->types[index];
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
+        void (*destroy)(value_t) = column->type->destroy;
 
-            MC_ASSERT(t != NULL);
-            t->destroy(contents->values[index]);
+        if(column->inline64  ||  value_type_is_trivial(column->type))
+            continue;
+
+        for(row = row0; row < row1; row++) {
+            value_t* value = (value_t*) table_blocks_row(&column->blocks, row);
+
+            if(value != NULL  &&  *value != NULL)
+                destroy(*value);
         }
     }
 }
 
+/* Empties all the columns. */
 static void
-table_contents_move_region(table_contents_t* contents_from, table_region_t* region_from,
-                           table_contents_t* contents_to, table_region_t* region_to)
+table_columns_clear(table_columns_t* columns, DWORD col_count)
 {
-    WORD i;
+    DWORD col;
 
-    MC_ASSERT(contents_from->mask == contents_to->mask);
+    for(col = 0; col < col_count; col++) {
+        table_column_t* column = &columns->cols[col];
+        table_blocks_clear(&column->blocks, &table_column_block_ops, column);
+    }
+}
 
-    /* Size of both regions must be the same */
-    MC_ASSERT(region_from->col1 - region_from->col0 == region_to->col1 - region_to->col0);
-    MC_ASSERT(region_from->row1 - region_from->row0 == region_to->row1 - region_to->row0);
+/* Makes columns_to to share all the values with columns_from. */
+static int
+table_columns_share(const table_columns_t* columns_from, DWORD col_count,
+                    table_columns_t* columns_to)
+{
+    DWORD col;
 
-    /* Case 0: zero-sized regions */
-    if(region_from->col1 - region_from->col0 == 0  ||
-       region_from->row1 - region_from->row0 == 0)
-        return;
+    columns_to->cols = NULL;
+    if(col_count == 0)
+        return 0;
 
-    /* Case 1: both regions contain complete lines */
-    if(region_from->col0 == 0  &&  region_to->col0 == 0  &&
-       region_from->col1 == contents_from->col_count  &&
-       region_to->col1 == contents_from->col_count) {
-        DWORD cellfrom0 = region_from->row0 * (DWORD)contents_from->col_count;
-        DWORD cellto0 = region_to->row0 * (DWORD)contents_to->col_count;
-        DWORD cell_count = (region_from->row1 - region_from->row0) * (DWORD)contents_from->col_count;
-
-        if(contents_from->mask & TABLE_CONTENTS_VALUES)
-            memcpy(&contents_to->values[cellto0], &contents_from->values[cellfrom0], cell_count * sizeof(value_t));
-        if(contents_from->mask & TABLE_CONTENTS_TYPES)
-            memcpy(&contents_to->types[cellto0], &contents_from->types[cellfrom0], cell_count * sizeof(value_type_t*));
-        if(contents_from->mask & TABLE_CONTENTS_FOREGROUNDS)
-            memcpy(&contents_to->foregrounds[cellto0], &contents_from->foregrounds[cellfrom0], cell_count * sizeof(COLORREF));
-        if(contents_from->mask & TABLE_CONTENTS_BACKGROUNDS)
-            memcpy(&contents_to->backgrounds[cellto0], &contents_from->backgrounds[cellfrom0], cell_count * sizeof(COLORREF));
-        if(contents_from->mask & TABLE_CONTENTS_FLAGS)
-            memcpy(&contents_to->flags[cellto0], &contents_from->flags[cellfrom0], cell_count * sizeof(BYTE));
+    columns_to->cols = (table_column_t*) malloc(col_count * sizeof(table_column_t));
+    if(MC_ERR(columns_to->cols == NULL)) {
+        MC_TRACE("table_columns_share: malloc() failed.");
+        return -1;
+    }
 
-        return;
+    for(col = 0; col < col_count; col++) {
+        table_column_t* from = &columns_from->cols[col];
+        table_column_t* to = &columns_to->cols[col];
+
+        to->type = from->type;
+        to->inline64 = from->inline64;
+        if(MC_ERR(table_blocks_share(&from->blocks, &to->blocks) != 0)) {
+            MC_TRACE("table_columns_share: table_blocks_share() failed.");
+            table_columns_fini(columns_to, col);
+            return -1;
+        }
     }
+    return 0;
+}
+
+
+/**************************
+ *** Posted cell writes ***
+ **************************/
+
+/* Cells may be posted from any thread. The writes are queued in a lock-free
+ * list, and applied later by the thread owning the table.
+ *
+ * Producers only push at the head of the list. The consumer always takes
+ * the whole list at once (so there is no ABA problem) and reverses it to
+ * get the writes in the order they have been posted. */
+
+typedef struct table_post_tag table_post_t;
+struct table_post_tag {
+    table_post_t* next;
+    DWORD col;
+    DWORD row;
+    MC_TABLECELL cell;
+};
 
-    /* Case 2: general case */
-    for(i = 0; i < region_from->row1 - region_from->row0; i++) {
-        DWORD cellfrom0 = (region_from->row0 + i) * (DWORD)contents_from->col_count + region_from->col0;
-        DWORD cellto0 = (region_to->row0 + i) * (DWORD)contents_to->col_count + region_to->col0;
-        DWORD cell_count = region_from->col1 - region_from->col0;
+typedef struct table_postq_tag table_postq_t;
+struct table_postq_tag {
+    table_post_t* volatile head;
+};
+
+static inline void
+table_postq_init(table_postq_t* q)
+{
+    q->head = NULL;
+}
+
+static inline BOOL
+table_postq_is_empty(table_postq_t* q)
+{
+    return (mc_atomic_load_ptr((void* volatile*) &q->head) == NULL);
+}
 
-        if(contents_from->mask & TABLE_CONTENTS_VALUES)
-            memcpy(&contents_to->values[cellto0], &contents_from->values[cellfrom0], cell_count * sizeof(value_t));
-        if(contents_from->mask & TABLE_CONTENTS_TYPES)
-            memcpy(&contents_to->types[cellto0], &contents_from->types[cellfrom0], cell_count * sizeof(value_type_t*));
-        if(contents_from->mask & TABLE_CONTENTS_FOREGROUNDS)
-            memcpy(&contents_to->foregrounds[cellto0], &contents_from->foregrounds[cellfrom0], cell_count * sizeof(COLORREF));
-        if(contents_from->mask & TABLE_CONTENTS_BACKGROUNDS)
-            memcpy(&contents_to->backgrounds[cellto0], &contents_from->backgrounds[cellfrom0], cell_count * sizeof(COLORREF));
-        if(contents_from->mask & TABLE_CONTENTS_FLAGS)
-            memcpy(&contents_to->flags[cellto0], &contents_from->flags[cellfrom0], cell_count * sizeof(BYTE));
+/* Returns TRUE if the queue has been empty. */
+static BOOL
+table_postq_push(table_postq_t* q, table_post_t* post)
+{
+    table_post_t* head;
+
+    do {
+        head = (table_post_t*) mc_atomic_load_ptr((void* volatile*) &q->head);
+        post->next = head;
+    } while(!mc_atomic_cas_ptr((void* volatile*) &q->head, head, post));
+
+    return (head == NULL);
+}
+
+/* Takes all the queued writes, the oldest one first. */
+static table_post_t*
+table_postq_take(table_postq_t* q)
+{
+    table_post_t* post;
+    table_post_t* next;
+    table_post_t* list = NULL;
+
+    post = (table_post_t*) mc_atomic_xchg_ptr((void* volatile*) &q->head, NULL);
+    while(post != NULL) {
+        next = post->next;
+        post->next = list;
+        list = post;
+        post = next;
     }
+    return list;
+}
+
+/* Frees the write which is not going to be applied. The value type is
+ * always resolved when the write is posted, so we know how to destroy it. */
+static void
+table_post_discard(table_post_t* post)
+{
+    if((post->cell.fMask & MC_TCM_VALUE)  &&  post->cell.hValue != NULL)
+        ((value_type_t*) post->cell.hType)->destroy((value_t) post->cell.hValue);
+    free(post);
 }
 
 
@@ -290,22 +1651,145 @@ struct table_tag {
     mc_ref_t refs;
     table_contents_t contents;
     view_list_t vlist;
+    MC_TABLECALLBACK callback;  /* non-NULL for virtual tables */
+    void* callback_data;
+    table_vcache_t vcache;      /* used only by virtual tables */
+    BOOL is_columnar;
+    table_columns_t columns;    /* used only by column-oriented tables */
+    BOOL is_snapshot;           /* snapshots are read-only */
+    UINT update_level;          /* nesting of table_begin_update() */
+    BOOL dirty;                 /* some change delayed by the update bracket */
+    BOOL dirty_all;             /* ... and it was not limited to a region */
+    DWORD dirty_shift_row;      /* ... and rows have been inserted or deleted there */
+    DWORD shift_row;            /* see table_shift_row() */
+    table_region_t dirty_region;
+    table_postq_t posted;       /* cells posted by table_post_cell() */
+    HWND volatile post_win;     /* window notified about posted cells */
+    HWND* post_wins;            /* all windows registered for that */
+    UINT post_win_count;
 };
 
+#define IS_VIRTUAL(table)      ((table)->callback != NULL)
+#define IS_COLUMNAR(table)     ((table)->is_columnar)
+#define IS_SNAPSHOT(table)     ((table)->is_snapshot)
+
+
+/* Views ignore changes outside of the region they are interested in. */
+static BOOL
+table_view_filter(void* interest, const void* detail)
+{
+    table_interest_t* ti = (table_interest_t*) interest;
+    const table_region_t* r1 = &ti->region;
+    const table_region_t* r2 = (const table_region_t*) detail;
+
+    if(r1->col0 < r2->col1  &&  r2->col0 < r1->col1  &&
+       r1->row0 < r2->row1  &&  r2->row0 < r1->row1)
+        return TRUE;
+
+    ti->skipped++;
+    return FALSE;
+}
+
+/* If shift_row is not TABLE_NO_SHIFT, rows have been inserted or deleted
+ * there. All views have to know about that (e.g. to update their scrollbars),
+ * so no filtering is done. */
+static void
+table_refresh_views_ex(table_t* table, table_region_t* region, DWORD shift_row)
+{
+    /* Inside table_begin_update() ... table_end_update() only remember
+     * bounding box of all the changes. */
+    if(table->update_level > 0) {
+        if(region == NULL) {
+            table->dirty_all = TRUE;
+        } else if(!table->dirty) {
+            memcpy(&table->dirty_region, region, sizeof(table_region_t));
+        } else {
+            table->dirty_region.col0 = MC_MIN(table->dirty_region.col0, region->col0);
+            table->dirty_region.row0 = MC_MIN(table->dirty_region.row0, region->row0);
+            table->dirty_region.col1 = MC_MAX(table->dirty_region.col1, region->col1);
+            table->dirty_region.row1 = MC_MAX(table->dirty_region.row1, region->row1);
+        }
+        if(shift_row != TABLE_NO_SHIFT) {
+            /* Several shifts cannot be described by a single row. */
+            if(table->dirty_shift_row == TABLE_NO_SHIFT)
+                table->dirty_shift_row = shift_row;
+            else
+                table->dirty_shift_row = TABLE_SHIFT_UNKNOWN;
+        }
+        table->dirty = TRUE;
+        return;
+    }
+
+    table->shift_row = shift_row;
+    if(shift_row != TABLE_NO_SHIFT)
+        view_list_refresh(&table->vlist, region);
+    else
+        view_list_refresh_filtered(&table->vlist, region, table_view_filter);
+    table->shift_row = TABLE_NO_SHIFT;
+}
 
 static inline void
 table_refresh_views(table_t* table, table_region_t* region)
 {
-    view_list_refresh(&table->vlist, region);
+    table_refresh_views_ex(table, region, TABLE_NO_SHIFT);
+}
+
+/* Checks whether all the cells of a range can be in the cache at once. As
+ * the cache is LRU, fetching them then evicts none of them. */
+static BOOL
+table_range_fits_cache(const table_t* table, DWORD col_count, DWORD row_count)
+{
+    if(!IS_VIRTUAL(table))
+        return TRUE;
+    return ((UINT64)col_count * row_count <= table->vcache.capacity);
+}
+
+/* Returns cached cell of virtual table, asking the application for it if
+ * it is not in the cache. Returns NULL if the application fails. */
+static table_vcache_entry_t*
+table_virtual_fetch(table_t* table, DWORD col, DWORD row)
+{
+    table_vcache_entry_t* e;
+    MC_TABLECELL cell;
+
+    MC_ASSERT(IS_VIRTUAL(table));
+
+    e = table_vcache_lookup(&table->vcache, col, row);
+    if(e != NULL)
+        return e;
+
+    cell.fMask = MC_TCM_ALL;
+    cell.hType = NULL;
+    cell.hValue = NULL;
+    cell.crForeground = MC_CLR_DEFAULT;
+    cell.crBackground = MC_CLR_NONE;
+    cell.dwFlags = 0;
+    if(!table->callback((MC_HTABLE) table, col, row, &cell, table->callback_data)) {
+        TABLE_TRACE("table_virtual_fetch: Callback failed for [%lu, %lu]",
+                    (ULONG)col, (ULONG)row);
+        return NULL;
+    }
+
+    e = table_vcache_insert(&table->vcache, col, row);
+    e->type = (value_type_t*) cell.hType;
+    e->value = (e->type != NULL ? (value_t) cell.hValue : NULL);
+    e->foreground = cell.crForeground;
+    e->background = cell.crBackground;
+    e->flags = cell.dwFlags;
+    return e;
 }
 
 table_t*
-table_create(WORD col_count, WORD row_count, value_type_t* cell_type, DWORD flags)
+table_create(DWORD col_count, DWORD row_count, value_type_t* cell_type, DWORD flags)
 {
     table_t* table;
-    table_region_t region;
-    DWORD mask = TABLE_CONTENTS_VALUES | TABLE_CONTENTS_TYPES;
+    DWORD mask = TABLE_CONTENTS_VALUES | TABLE_CONTENTS_SPARSE;
 
+    /* Per-cell types are needed only for heterogenous tables. */
+    if(cell_type == NULL)
+        mask |= TABLE_CONTENTS_TYPES;
+    else if(TABLE_TYPE_NEEDS_INLINE64(cell_type))
+        mask |= TABLE_CONTENTS_INLINE64;
     if(!(flags & MC_TF_NOCELLFOREGROUND))
         mask |= TABLE_CONTENTS_FOREGROUNDS;
     if(!(flags & MC_TF_NOCELLBACKGROUND))
@@ -313,8 +1797,8 @@ table_create(WORD col_count, WORD row_count, value_type_t* cell_type, DWORD flag
     if(!(flags & MC_TF_NOCELLFLAGS))
         mask |= TABLE_CONTENTS_FLAGS;
 
-    TABLE_TRACE("table_create(%d, %d, %p, 0x%x)",
-                (int)col_count, (int)row_count, cell_type, mask);
+    TABLE_TRACE("table_create(%lu, %lu, %p, 0x%x)",
+                (ULONG)col_count, (ULONG)row_count, cell_type, mask);
 
     table = (table_t*) malloc(sizeof(table_t));
     if(MC_ERR(table == NULL)) {
@@ -329,17 +1813,196 @@ table_create(WORD col_count, WORD row_count, value_type_t* cell_type, DWORD flag
         return NULL;
     }
 
-    region.col0 = 0;
-    region.row0 = 0;
-    region.col1 = col_count;
-    region.row1 = row_count;
-    table_contents_init_region(&table->contents, &region);
+    table->refs = 1;
+    view_list_init(&table->vlist);
+    table->callback = NULL;
+    table->callback_data = NULL;
+    table->is_columnar = FALSE;
+    table->is_snapshot = FALSE;
+    table->update_level = 0;
+    table->dirty = FALSE;
+    table->dirty_all = FALSE;
+    table->dirty_shift_row = TABLE_NO_SHIFT;
+    table->shift_row = TABLE_NO_SHIFT;
+    table_postq_init(&table->posted);
+    table->post_win = NULL;
+    table->post_wins = NULL;
+    table->post_win_count = 0;
+    return table;
+}
+
+table_t*
+table_create_columnar(DWORD col_count, DWORD row_count, value_type_t** col_types,
+                      DWORD flags)
+{
+    table_t* table;
+
+    TABLE_TRACE("table_create_columnar(%lu, %lu, %p, 0x%x)",
+                (ULONG)col_count, (ULONG)row_count, col_types, flags);
+
+    table = (table_t*) malloc(sizeof(table_t));
+    if(MC_ERR(table == NULL)) {
+        MC_TRACE("table_create_columnar: malloc() failed.");
+        return NULL;
+    }
+
+    if(MC_ERR(table_columns_init(&table->columns, col_count, col_types) != 0)) {
+        MC_TRACE("table_create_columnar: table_columns_init() failed.");
+        free(table);
+        return NULL;
+    }
+
+    if(MC_ERR(table_columns_reserve(&table->columns, col_count, row_count) != 0)) {
+        MC_TRACE("table_create_columnar: table_columns_reserve() failed.");
+        table_columns_fini(&table->columns, col_count);
+        free(table);
+        return NULL;
+    }
+
+    /* Contents hold just the dimensions and the sparse cell attributes. */
+    memset(&table->contents, 0, sizeof(table_contents_t));
+    table->contents.mask = TABLE_CONTENTS_SPARSE;
+    if(!(flags & MC_TF_NOCELLFOREGROUND))
+        table->contents.attr_mask |= TABLE_CONTENTS_FOREGROUNDS;
+    if(!(flags & MC_TF_NOCELLBACKGROUND))
+        table->contents.attr_mask |= TABLE_CONTENTS_BACKGROUNDS;
+    if(!(flags & MC_TF_NOCELLFLAGS))
+        table->contents.attr_mask |= TABLE_CONTENTS_FLAGS;
+    table->contents.col_count = col_count;
+    table->contents.row_count = row_count;
+    table_sparse_init(&table->contents.sparse);
+
+    table->refs = 1;
+    view_list_init(&table->vlist);
+    table->callback = NULL;
+    table->callback_data = NULL;
+    table->is_columnar = TRUE;
+    table->is_snapshot = FALSE;
+    table->update_level = 0;
+    table->dirty = FALSE;
+    table->dirty_all = FALSE;
+    table->dirty_shift_row = TABLE_NO_SHIFT;
+    table->shift_row = TABLE_NO_SHIFT;
+    table_postq_init(&table->posted);
+    table->post_win = NULL;
+    table->post_wins = NULL;
+    table->post_win_count = 0;
+    return table;
+}
+
+table_t*
+table_create_virtual(DWORD col_count, DWORD row_count, MC_TABLECALLBACK callback,
+                     void* callback_data, DWORD cache_size)
+{
+    table_t* table;
+
+    TABLE_TRACE("table_create_virtual(%lu, %lu, %p, %p, %lu)",
+                (ULONG)col_count, (ULONG)row_count, callback, callback_data,
+                (ULONG)cache_size);
+
+    table = (table_t*) malloc(sizeof(table_t));
+    if(MC_ERR(table == NULL)) {
+        MC_TRACE("table_create_virtual: malloc() failed.");
+        return NULL;
+    }
+
+    if(MC_ERR(table_vcache_init(&table->vcache, cache_size) != 0)) {
+        MC_TRACE("table_create_virtual: table_vcache_init() failed.");
+        free(table);
+        return NULL;
+    }
+
+    /* Virtual table has no storage. Contents just describe its dimensions. */
+    memset(&table->contents, 0, sizeof(table_contents_t));
+    table->contents.col_count = col_count;
+    table->contents.row_count = row_count;
 
     table->refs = 1;
     view_list_init(&table->vlist);
+    table->callback = callback;
+    table->callback_data = callback_data;
+    table->is_columnar = FALSE;
+    table->is_snapshot = FALSE;
+    table->update_level = 0;
+    table->dirty = FALSE;
+    table->dirty_all = FALSE;
+    table->dirty_shift_row = TABLE_NO_SHIFT;
+    table->shift_row = TABLE_NO_SHIFT;
+    table_postq_init(&table->posted);
+    table->post_win = NULL;
+    table->post_wins = NULL;
+    table->post_win_count = 0;
     return table;
 }
 
+table_t*
+table_snapshot(table_t* table)
+{
+    table_t* snapshot;
+
+    TABLE_TRACE("table_snapshot(%p)", table);
+
+    /* Snapshot never changes, so it is a snapshot of itself. */
+    if(IS_SNAPSHOT(table)) {
+        table_ref(table);
+        return table;
+    }
+
+    if(MC_ERR(IS_VIRTUAL(table))) {
+        MC_TRACE("table_snapshot: Cannot snapshot virtual table.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+
+    snapshot = (table_t*) malloc(sizeof(table_t));
+    if(MC_ERR(snapshot == NULL)) {
+        MC_TRACE("table_snapshot: malloc() failed.");
+        return NULL;
+    }
+
+    /* Share all the blocks of rows. They get copied only when the live
+     * table modifies them. (Sparse attributes are small, so just copy them.) */
+    memcpy(&snapshot->contents, &table->contents, sizeof(table_contents_t));
+    if(MC_ERR(table_blocks_share(&table->contents.blocks, &snapshot->contents.blocks) != 0)) {
+        MC_TRACE("table_snapshot: table_blocks_share() failed.");
+        free(snapshot);
+        return NULL;
+    }
+    if(MC_ERR(table_sparse_copy(&table->contents.sparse, &snapshot->contents.sparse) != 0)) {
+        MC_TRACE("table_snapshot: table_sparse_copy() failed.");
+        table_sparse_init(&snapshot->contents.sparse);
+        table_contents_free(&snapshot->contents);
+        free(snapshot);
+        return NULL;
+    }
+    if(IS_COLUMNAR(table)) {
+        if(MC_ERR(table_columns_share(&table->columns, table->contents.col_count,
+                                      &snapshot->columns) != 0)) {
+            MC_TRACE("table_snapshot: table_columns_share() failed.");
+            table_contents_free(&snapshot->contents);
+            free(snapshot);
+            return NULL;
+        }
+    }
+
+    snapshot->refs = 1;
+    view_list_init(&snapshot->vlist);
+    snapshot->callback = NULL;
+    snapshot->callback_data = NULL;
+    snapshot->is_columnar = table->is_columnar;
+    snapshot->is_snapshot = TRUE;
+    snapshot->update_level = 0;
+    snapshot->dirty = FALSE;
+    snapshot->dirty_all = FALSE;
+    snapshot->dirty_shift_row = TABLE_NO_SHIFT;
+    snapshot->shift_row = TABLE_NO_SHIFT;
+    table_postq_init(&snapshot->posted);
+    snapshot->post_win = NULL;
+    snapshot->post_wins = NULL;
+    snapshot->post_win_count = 0;
+    return snapshot;
+}
+
 void
 table_ref(table_t* table)
 {
@@ -351,109 +2014,266 @@ table_ref(table_t* table)
 void
 table_unref(table_t* table)
 {
+    table_post_t* post;
+
     TABLE_TRACE("table_unref(%p): %u -> %u", table, table->refs, table->refs-1);
 
     if(mc_unref(&table->refs) == 0) {
-        table_region_t region;
-
         TABLE_TRACE("table_unref(%p): Freeing", table);
-        MC_ASSERT(VIEW_LIST_IS_EMPTY(&table->vlist));
+        MC_ASSERT(table->post_win == NULL);
+        MC_ASSERT(table->post_win_count == 0);
+        view_list_fini(&table->vlist);
+
+        /* Writes posted but never processed. */
+        post = table_postq_take(&table->posted);
+        while(post != NULL) {
+            table_post_t* next = post->next;
+            table_post_discard(post);
+            post = next;
+        }
 
-        region.col0 = 0;
-        region.row0 = 0;
-        region.col1 = table->contents.col_count;
-        region.row1 = table->contents.row_count;
-        table_contents_free_region(&table->contents, &region);
+        if(IS_VIRTUAL(table)) {
+            table_vcache_fini(&table->vcache);
+            free(table);
+            return;
+        }
 
+        /* (Values still shared with a snapshot or the live table survive.) */
+        if(IS_COLUMNAR(table))
+            table_columns_fini(&table->columns, table->contents.col_count);
         table_contents_free(&table->contents);
         free(table);
     }
 }
 
-WORD
+DWORD
 table_col_count(const table_t* table)
 {
     return table->contents.col_count;
 }
 
-WORD
+DWORD
 table_row_count(const table_t* table)
 {
     return table->contents.row_count;
 }
 
+DWORD
+table_shift_row(const table_t* table)
+{
+    return table->shift_row;
+}
+
 void
-table_paint_cell(const table_t* table, WORD col, WORD row, HDC dc, RECT* rect)
+table_paint_cell(table_t* table, DWORD col, DWORD row, HDC dc, RECT* rect)
 {
-    DWORD index = row * (DWORD)table->contents.col_count + col;
-    value_t* value = table->contents.values[index];
+    size_t index = row * (size_t)table->contents.col_count + col;
+    BYTE* r = NULL;
+    value_t value;
     value_type_t* type;
     DWORD flags = 0;
 
-    if(IS_HOMOGENOUS(&table->contents)) {
+    if(IS_VIRTUAL(table)) {
+        table_vcache_entry_t* e;
+
+        e = table_virtual_fetch(table, col, row);
+        if(e == NULL  ||  e->type == NULL)
+            return;
+        e->type->paint(e->value, dc, rect, e->flags & 0xf);
+        return;
+    }
+
+    if(IS_COLUMNAR(table)) {
+        table_column_t* column = &table->columns.cols[col];
+
+        type = column->type;
+        value = table_column_value(column, row);
+    } else if(IS_HOMOGENOUS(&table->contents)) {
         type = table->contents.type;
         MC_ASSERT(type != NULL);
+        r = table_blocks_row(&table->contents.blocks, row);
+        value = table_contents_value(&table->contents, r, col);
     } else {
-        type = table->contents.types[index];
-        if(type == NULL)
+        r = table_blocks_row(&table->contents.blocks, row);
+        if(r == NULL  ||  TABLE_ROW_TYPES(&table->contents, r)[col] == NULL)
             return;
+        type = TABLE_ROW_TYPES(&table->contents, r)[col];
+        value = TABLE_ROW_VALUES(r)[col];
     }
 
-    if(table->contents.mask & TABLE_CONTENTS_FLAGS)
-        flags |= table->contents.flags[index] & 0xf;  /* alignment */
+    if(table->contents.mask & TABLE_CONTENTS_FLAGS) {
+        if(r != NULL)
+            flags |= TABLE_ROW_FLAGS(&table->contents, r)[col] & 0xf;  /* alignment */
+    } else if(IS_SPARSE(&table->contents)) {
+        table_attr_t* attr = table_sparse_find(&table->contents.sparse, index);
+        if(attr != NULL)
+            flags |= attr->flags & 0xf;
+    }
 
     type->paint(value, dc, rect, flags);
 }
 
 int
-table_resize(table_t* table, WORD col_count, WORD row_count)
+table_insert_rows(table_t* table, DWORD row, DWORD count)
 {
-    table_contents_t contents;
-    value_type_t* homotype;
+    table_contents_t* contents = &table->contents;
+    DWORD col_count = contents->col_count;
+    DWORD old_row_count = contents->row_count;
+    DWORD row_count = old_row_count + count;
     table_region_t region;
 
-    if(col_count == table->contents.col_count && row_count == table->contents.row_count)
-        return 0;
+    MC_ASSERT(row <= old_row_count);
+    MC_ASSERT(count <= 0xffffffff - old_row_count);
+    MC_ASSERT(!IS_SNAPSHOT(table));
 
-    homotype = IS_HOMOGENOUS(&table->contents) ? table->contents.type : NULL;
+    if(count == 0)
+        return 0;
 
-    if(MC_ERR(table_contents_alloc(&contents, homotype, col_count, row_count,
-                                   table->contents.mask) != 0)) {
-        MC_TRACE("table_resize: table_contents_alloc() failed.");
-        return -1;
+    /* Do all what may fail first, so we fail without any side effects. */
+    if(IS_VIRTUAL(table)) {
+        table_vcache_flush(&table->vcache);
+    } else if(IS_COLUMNAR(table)) {
+        if(MC_ERR(table_columns_reserve(&table->columns, col_count, row_count) != 0  ||
+                  table_columns_ensure(&table->columns, col_count, row, row_count) != 0)) {
+            MC_TRACE("table_insert_rows: Cannot prepare the columns.");
+            return -1;
+        }
+        if(MC_ERR(table_contents_shift_sparse(contents, row, count, TRUE) != 0)) {
+            MC_TRACE("table_insert_rows: table_contents_shift_sparse() failed.");
+            return -1;
+        }
+        table_columns_move_rows(&table->columns, col_count, row, row + count,
+                                old_row_count - row);
+        table_columns_init_rows(&table->columns, col_count, row, row + count);
+    } else {
+        if(MC_ERR(table_blocks_reserve(&contents->blocks, row_count) != 0  ||
+                  table_contents_ensure(contents, row, row_count) != 0)) {
+            MC_TRACE("table_insert_rows: Cannot prepare the rows.");
+            return -1;
+        }
+        if(MC_ERR(table_contents_shift_sparse(contents, row, count, TRUE) != 0)) {
+            MC_TRACE("table_insert_rows: table_contents_shift_sparse() failed.");
+            return -1;
+        }
+        table_blocks_move_rows(&contents->blocks, row, row + count,
+                               old_row_count - row);
+        table_blocks_init_rows(&contents->blocks, row, row + count,
+                               &table_contents_block_ops, contents);
     }
 
-    /* Move intersected contents */
+    contents->row_count = row_count;
+
+    /* Only the new rows and the rows shifted down need a repaint. */
     region.col0 = 0;
-    region.row0 = 0;
-    region.col1 = MC_MIN(col_count, table->contents.col_count);
-    region.row1 = MC_MIN(row_count, table->contents.row_count);
-    table_contents_move_region(&table->contents, &region, &contents, &region);
+    region.row0 = row;
+    region.col1 = col_count;
+    region.row1 = row_count;
+    table_refresh_views_ex(table, &region, row);
+    return 0;
+}
+
+int
+table_delete_rows(table_t* table, DWORD row, DWORD count)
+{
+    table_contents_t* contents = &table->contents;
+    DWORD col_count = contents->col_count;
+    DWORD old_row_count = contents->row_count;
+    DWORD row_count = old_row_count - count;
+    table_region_t region;
+
+    MC_ASSERT(row <= old_row_count);
+    MC_ASSERT(count <= old_row_count - row);
+    MC_ASSERT(!IS_SNAPSHOT(table));
+
+    if(count == 0)
+        return 0;
 
-    /* Handle difference in col_count */
-    region.col0 = region.col1;
-    if(col_count > table->contents.col_count) {
+    if(IS_VIRTUAL(table)) {
+        table_vcache_flush(&table->vcache);
+    } else if(IS_COLUMNAR(table)) {
+        if(MC_ERR(table_columns_ensure(&table->columns, col_count, row, old_row_count) != 0)) {
+            MC_TRACE("table_delete_rows: table_columns_ensure() failed.");
+            return -1;
+        }
+        if(MC_ERR(table_contents_shift_sparse(contents, row, count, FALSE) != 0)) {
+            MC_TRACE("table_delete_rows: table_contents_shift_sparse() failed.");
+            return -1;
+        }
+        table_columns_free_rows(&table->columns, col_count, row, row + count);
+        table_columns_move_rows(&table->columns, col_count, row + count, row,
+                                row_count - row);
+        table_columns_init_rows(&table->columns, col_count, row_count, old_row_count);
+    } else {
+        if(MC_ERR(table_contents_ensure(contents, row, old_row_count) != 0)) {
+            MC_TRACE("table_delete_rows: table_contents_ensure() failed.");
+            return -1;
+        }
+        if(MC_ERR(table_contents_shift_sparse(contents, row, count, FALSE) != 0)) {
+            MC_TRACE("table_delete_rows: table_contents_shift_sparse() failed.");
+            return -1;
+        }
+        region.col0 = 0;
+        region.row0 = row;
         region.col1 = col_count;
-        table_contents_init_region(&contents, &region);
-    } else if(col_count < table->contents.col_count) {
-        region.col1 = table->contents.col_count;
-        table_contents_free_region(&contents, &region);
+        region.row1 = row + count;
+        table_contents_free_region(contents, &region);
+        table_blocks_move_rows(&contents->blocks, row + count, row, row_count - row);
+
+        /* Rows left behind the end must not keep the moved values. */
+        table_blocks_init_rows(&contents->blocks, row_count, old_row_count,
+                               &table_contents_block_ops, contents);
     }
 
-    /* Handle difference in row_count */
+    contents->row_count = row_count;
+
+    /* Repaint the rows shifted up, as well as the space they have left. */
     region.col0 = 0;
-    region.row0 = region.row1;
-    if(row_count > table->contents.row_count) {
-        region.row1 = row_count;
-        table_contents_init_region(&contents, &region);
-    } else if(row_count < table->contents.row_count) {
-        region.row1 = table->contents.row_count;
-        table_contents_free_region(&contents, &region);
+    region.row0 = row;
+    region.col1 = col_count;
+    region.row1 = old_row_count;
+    table_refresh_views_ex(table, &region, row);
+    return 0;
+}
+
+int
+table_resize(table_t* table, DWORD col_count, DWORD row_count)
+{
+    MC_ASSERT(!IS_SNAPSHOT(table));
+
+    if(col_count == table->contents.col_count && row_count == table->contents.row_count)
+        return 0;
+
+    /* If only the row count changes, there is no need to re-layout the
+     * whole table. */
+    if(col_count == table->contents.col_count) {
+        if(row_count > table->contents.row_count)
+            return table_insert_rows(table, table->contents.row_count,
+                                     row_count - table->contents.row_count);
+        else
+            return table_delete_rows(table, row_count,
+                                     table->contents.row_count - row_count);
+    }
+
+    if(IS_VIRTUAL(table)) {
+        table->contents.col_count = col_count;
+        table->contents.row_count = row_count;
+        table_vcache_flush(&table->vcache);
+        table_refresh_views(table, NULL);
+        return 0;
     }
 
-    /* Install new contents */
-    table_contents_free(&table->contents);
-    memcpy(&table->contents, &contents, sizeof(table_contents_t));
+    /* We would not know value types of new columns. */
+    if(MC_ERR(IS_COLUMNAR(table))) {
+        MC_TRACE("table_resize: Cannot change column count of columnar table.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return -1;
+    }
+
+    if(MC_ERR(table_contents_relayout(&table->contents, col_count, row_count,
+                    table->contents.mask | table->contents.attr_mask) != 0)) {
+        MC_TRACE("table_resize: table_contents_relayout() failed.");
+        return -1;
+    }
 
     table_refresh_views(table, NULL);
     return 0;
@@ -464,84 +2284,236 @@ table_clear(table_t* table)
 {
     table_region_t region;
 
+    MC_ASSERT(!IS_SNAPSHOT(table));
+
+    if(IS_VIRTUAL(table)) {
+        /* Application data has changed: forget all what we know. */
+        table_vcache_flush(&table->vcache);
+        table_refresh_views(table, NULL);
+        return;
+    }
+
+    /* Just drop all the blocks: rows with no block are empty. */
+    if(IS_COLUMNAR(table))
+        table_columns_clear(&table->columns, table->contents.col_count);
+    else
+        table_blocks_clear(&table->contents.blocks, &table_contents_block_ops,
+                           &table->contents);
+    table_sparse_reset(&table->contents.sparse);
+
     region.col0 = 0;
     region.row0 = 0;
     region.col1 = table->contents.col_count;
     region.row1 = table->contents.row_count;
-    table_contents_free_region(&table->contents, &region);
-    table_contents_init_region(&table->contents, &region);
-
     table_refresh_views(table, &region);
 }
 
+
 void
-table_get_cell(const table_t* table, WORD col, WORD row, MC_TABLECELL* cell)
+table_get_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell)
 {
-    DWORD index = row * table->contents.col_count + col;
+    size_t index = row * (size_t)table->contents.col_count + col;
+    BYTE* r = NULL;
 
-    if(cell->fMask & MC_TCM_VALUE) {
-        if(IS_HOMOGENOUS(&table->contents))
-            cell->hType = table->contents.type;
-        else
-            cell->hType = table->contents.types[index];
-        cell->hValue = table->contents.values[index];
+    if(IS_VIRTUAL(table)) {
+        table_vcache_entry_t* e;
+
+        e = table_virtual_fetch(table, col, row);
+        if(cell->fMask & MC_TCM_VALUE) {
+            cell->hType = (e != NULL ? e->type : NULL);
+            cell->hValue = (e != NULL ? e->value : NULL);
+        }
+        if(cell->fMask & MC_TCM_FOREGROUND)
+            cell->crForeground = (e != NULL ? e->foreground : MC_CLR_DEFAULT);
+        if(cell->fMask & MC_TCM_BACKGROUND)
+            cell->crBackground = (e != NULL ? e->background : MC_CLR_NONE);
+        if(cell->fMask & MC_TCM_FLAGS)
+            cell->dwFlags = (e != NULL ? e->flags : 0);
+        return;
+    }
+
+    if(IS_COLUMNAR(table)) {
+        if(cell->fMask & MC_TCM_VALUE) {
+            cell->hType = table->columns.cols[col].type;
+            cell->hValue = table_column_value(&table->columns.cols[col], row);
+        }
+    } else {
+        r = table_blocks_row(&table->contents.blocks, row);
+        if(cell->fMask & MC_TCM_VALUE) {
+            if(IS_HOMOGENOUS(&table->contents))
+                cell->hType = table->contents.type;
+            else
+                cell->hType = (r != NULL ? TABLE_ROW_TYPES(&table->contents, r)[col] : NULL);
+            cell->hValue = table_contents_value(&table->contents, r, col);
+        }
+    }
+
+    if(IS_SPARSE(&table->contents)) {
+        table_attr_t* attr = table_sparse_find(&table->contents.sparse, index);
+
+        if(cell->fMask & MC_TCM_FOREGROUND)
+            cell->crForeground = (attr != NULL ? attr->foreground : MC_CLR_DEFAULT);
+        if(cell->fMask & MC_TCM_BACKGROUND)
+            cell->crBackground = (attr != NULL ? attr->background : MC_CLR_NONE);
+        if(cell->fMask & MC_TCM_FLAGS)
+            cell->dwFlags = (attr != NULL ? attr->flags : 0);
+        return;
     }
 
     if(cell->fMask & MC_TCM_FOREGROUND) {
-        if(table->contents.mask & TABLE_CONTENTS_FOREGROUNDS)
-            cell->crForeground = table->contents.foregrounds[index];
+        if(r != NULL  &&  (table->contents.mask & TABLE_CONTENTS_FOREGROUNDS))
+            cell->crForeground = TABLE_ROW_FOREGROUNDS(&table->contents, r)[col];
         else
             cell->crForeground = MC_CLR_DEFAULT;
     }
 
     if(cell->fMask & MC_TCM_BACKGROUND) {
-        if(table->contents.mask & TABLE_CONTENTS_BACKGROUNDS)
-            cell->crBackground = table->contents.backgrounds[index];
+        if(r != NULL  &&  (table->contents.mask & TABLE_CONTENTS_BACKGROUNDS))
+            cell->crBackground = TABLE_ROW_BACKGROUNDS(&table->contents, r)[col];
         else
             cell->crBackground = MC_CLR_NONE;
     }
 
     if(cell->fMask & MC_TCM_FLAGS) {
-        if(table->contents.mask & TABLE_CONTENTS_FLAGS)
-            cell->dwFlags = table->contents.flags[index];
+        if(r != NULL  &&  (table->contents.mask & TABLE_CONTENTS_FLAGS))
+            cell->dwFlags = TABLE_ROW_FLAGS(&table->contents, r)[col];
         else
             cell->dwFlags = 0;
     }
 }
 
-void
-table_set_cell(table_t* table, WORD col, WORD row, MC_TABLECELL* cell)
+static int
+table_set_sparse_attrs(table_t* table, size_t index, MC_TABLECELL* cell)
+{
+    table_contents_t* contents = &table->contents;
+    table_attr_t* attr;
+    table_attr_t tmp;
+
+    attr = table_sparse_find(&contents->sparse, index);
+    if(attr != NULL) {
+        memcpy(&tmp, attr, sizeof(table_attr_t));
+    } else {
+        tmp.foreground = MC_CLR_DEFAULT;
+        tmp.background = MC_CLR_NONE;
+        tmp.flags = 0;
+    }
+
+    if((cell->fMask & MC_TCM_FOREGROUND)  &&  (contents->attr_mask & TABLE_CONTENTS_FOREGROUNDS))
+        tmp.foreground = cell->crForeground;
+    if((cell->fMask & MC_TCM_BACKGROUND)  &&  (contents->attr_mask & TABLE_CONTENTS_BACKGROUNDS))
+        tmp.background = cell->crBackground;
+    if((cell->fMask & MC_TCM_FLAGS)  &&  (contents->attr_mask & TABLE_CONTENTS_FLAGS))
+        tmp.flags = (BYTE) cell->dwFlags;
+
+    /* Cells with default attributes do not need any entry. */
+    if(TABLE_ATTR_IS_DEFAULT(&tmp)) {
+        if(attr != NULL)
+            table_sparse_remove(&contents->sparse, attr);
+        return 0;
+    }
+
+    if(attr == NULL) {
+        attr = table_sparse_insert(&contents->sparse, index);
+        if(MC_ERR(attr == NULL)) {
+            MC_TRACE("table_set_sparse_attrs: table_sparse_insert() failed.");
+            return -1;
+        }
+    }
+
+    attr->foreground = tmp.foreground;
+    attr->background = tmp.background;
+    attr->flags = tmp.flags;
+    return 0;
+}
+
+int
+table_set_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell)
 {
-    DWORD index = row * table->contents.col_count + col;
+    size_t index = row * (size_t)table->contents.col_count + col;
     table_region_t region;
+    table_column_t* column = NULL;
+    BYTE* r = NULL;
+
+    MC_ASSERT(!IS_SNAPSHOT(table));
+
+    /* Do all operations which may fail first, so we fail without any
+     * side effects. (Making the row modifiable has no visible effect.) */
+    if(IS_COLUMNAR(table)) {
+        column = &table->columns.cols[col];
+        if(cell->fMask & MC_TCM_VALUE) {
+            if(MC_ERR(table_blocks_ensure(&column->blocks, row, row+1,
+                                          &table_column_block_ops, column) != 0)) {
+                MC_TRACE("table_set_cell: table_blocks_ensure() failed.");
+                return -1;
+            }
+        }
+    } else if((cell->fMask & MC_TCM_VALUE)  ||
+              ((cell->fMask & MC_TCM_ATTRS)  &&  !IS_SPARSE(&table->contents))) {
+        if(MC_ERR(table_contents_ensure(&table->contents, row, row+1) != 0)) {
+            MC_TRACE("table_set_cell: table_contents_ensure() failed.");
+            return -1;
+        }
+        r = table_blocks_row(&table->contents.blocks, row);
+    }
+
+    if(IS_SPARSE(&table->contents)  &&  (cell->fMask & MC_TCM_ATTRS)) {
+        if(MC_ERR(table_set_sparse_attrs(table, index, cell) != 0)) {
+            MC_TRACE("table_set_cell: table_set_sparse_attrs() failed.");
+            return -1;
+        }
+    }
+
+    if((cell->fMask & MC_TCM_VALUE)  &&  IS_COLUMNAR(table)) {
+        table_column_set_value(column, row, (value_t) cell->hValue);
+    } else if((cell->fMask & MC_TCM_VALUE)  &&  IS_INLINE64(&table->contents)) {
+        /* Unbox the integer: the table owns the value now, so it can
+         * dispose the box immediately. */
+        if(cell->hValue != NULL) {
+            TABLE_ROW_VALUES64(r)[col] = *((int64_t*) cell->hValue);
+            table->contents.type->destroy((value_t) cell->hValue);
+        } else {
+            TABLE_ROW_VALUES64(r)[col] = 0;
+        }
+    } else if(cell->fMask & MC_TCM_VALUE) {
+        value_t* values = TABLE_ROW_VALUES(r);
 
-    if(cell->fMask & MC_TCM_VALUE) {
         if(IS_HOMOGENOUS(&table->contents)) {
             MC_ASSERT(cell->hType == NULL  ||  cell->hType == table->contents.type);
-            if(table->contents.values[index] != NULL)
-                table->contents.type->destroy(table->contents.values[index]);
+            if(values[col] != NULL)
+                table->contents.type->destroy(values[col]);
         } else {
-            if(table->contents.values[index] != NULL)
-                table->contents.types[index]->destroy(table->contents.values[index]);
-            table->contents.types[index] = (value_type_t*) cell->hType;
+            value_type_t** types = TABLE_ROW_TYPES(&table->contents, r);
+
+            if(values[col] != NULL)
+                types[col]->destroy(values[col]);
+            types[col] = (value_type_t*) cell->hType;
         }
 
-        table->contents.values[index] = (value_t) cell->hValue;
+        values[col] = (value_t) cell->hValue;
     }
 
     if(cell->fMask & MC_TCM_FOREGROUND) {
         if(table->contents.mask & TABLE_CONTENTS_FOREGROUNDS)
-            table->contents.foregrounds[index] = cell->crForeground;
+            TABLE_ROW_FOREGROUNDS(&table->contents, r)[col] = cell->crForeground;
     }
 
     if(cell->fMask & MC_TCM_BACKGROUND) {
         if(table->contents.mask & TABLE_CONTENTS_BACKGROUNDS)
-            table->contents.backgrounds[index] = cell->crBackground;
+            TABLE_ROW_BACKGROUNDS(&table->contents, r)[col] = cell->crBackground;
     }
 
     if(cell->fMask & MC_TCM_FLAGS) {
         if(table->contents.mask & TABLE_CONTENTS_FLAGS)
-            table->contents.flags[index] = cell->dwFlags;
+            TABLE_ROW_FLAGS(&table->contents, r)[col] = (BYTE) cell->dwFlags;
+    }
+
+    /* If too many cells have attributes, the dense storage is cheaper.
+     * (Column-oriented tables have no dense attribute storage.) */
+    if(IS_SPARSE(&table->contents)  &&  !IS_COLUMNAR(table)  &&
+       table->contents.sparse.count >
+       (size_t)table->contents.col_count * table->contents.row_count / TABLE_SPARSE_DENSITY) {
+        if(MC_ERR(table_contents_densify(&table->contents) != 0))
+            MC_TRACE("table_set_cell: table_contents_densify() failed.");
     }
 
     region.col0 = col;
@@ -549,30 +2521,380 @@ table_set_cell(table_t* table, WORD col, WORD row, MC_TABLECELL* cell)
     region.col1 = col+1;
     region.row1 = row+1;
     table_refresh_views(table, &region);
+    return 0;
+}
+
+value_type_t*
+table_column_type(const table_t* table, DWORD col)
+{
+    if(IS_COLUMNAR(table))
+        return table->columns.cols[col].type;
+    else if(IS_HOMOGENOUS(&table->contents))
+        return table->contents.type;
+    else
+        return NULL;
+}
+
+BOOL
+table_accepts_type(const table_t* table, DWORD col, MC_HVALUETYPE type, MC_HVALUE value)
+{
+    value_type_t* expected;
+
+    expected = table_column_type(table, col);
+    if(expected == NULL)
+        return TRUE;
+
+    /* Resetting a cell with (NULL, NULL) is always allowed. */
+    return (type == expected  ||  (type == NULL  &&  value == NULL));
+}
+
+void
+table_begin_update(table_t* table)
+{
+    table->update_level++;
+}
+
+void
+table_end_update(table_t* table)
+{
+    DWORD shift_row;
+
+    MC_ASSERT(table->update_level > 0);
+
+    table->update_level--;
+    if(table->update_level > 0  ||  !table->dirty)
+        return;
+
+    /* Now notify the views about all the changes at once. */
+    table->dirty = FALSE;
+    shift_row = table->dirty_shift_row;
+    table->dirty_shift_row = TABLE_NO_SHIFT;
+    if(table->dirty_all) {
+        table->dirty_all = FALSE;
+        table_refresh_views_ex(table, NULL, shift_row);
+    } else {
+        table_refresh_views_ex(table, &table->dirty_region, shift_row);
+    }
+}
+
+/* Does everything what may fail when setting cells of the region, so
+ * table_set_cell() then cannot fail for any of them: Rows of the region are
+ * made modifiable (this allocates lazy blocks and copies shared ones) if
+ * values are to be set, and there is room for attr_count new sparse
+ * attributes. (If so many attributes would make the sparse storage too
+ * dense, the table switches to the dense one right away.) */
+static int
+table_prepare_region(table_t* table, const table_region_t* region,
+                     BOOL values, size_t attr_count)
+{
+    table_contents_t* contents = &table->contents;
+    DWORD col;
+
+    if(attr_count > 0  &&  IS_SPARSE(contents)) {
+        if(!IS_COLUMNAR(table)  &&  contents->sparse.count + attr_count >
+           (size_t)contents->col_count * contents->row_count / TABLE_SPARSE_DENSITY) {
+            if(MC_ERR(table_contents_densify(contents) != 0)) {
+                MC_TRACE("table_prepare_region: table_contents_densify() failed.");
+                return -1;
+            }
+        } else if(MC_ERR(table_sparse_reserve(&contents->sparse,
+                                              contents->sparse.count + attr_count) != 0)) {
+            MC_TRACE("table_prepare_region: table_sparse_reserve() failed.");
+            return -1;
+        }
+    }
+
+    if(IS_COLUMNAR(table)) {
+        if(!values)
+            return 0;
+        for(col = region->col0; col < region->col1; col++) {
+            table_column_t* column = &table->columns.cols[col];
+
+            if(MC_ERR(table_blocks_ensure(&column->blocks, region->row0, region->row1,
+                                          &table_column_block_ops, column) != 0)) {
+                MC_TRACE("table_prepare_region: table_blocks_ensure() failed.");
+                return -1;
+            }
+        }
+    } else if(values  ||  (attr_count > 0  &&  !IS_SPARSE(contents))) {
+        if(MC_ERR(table_contents_ensure(contents, region->row0, region->row1) != 0)) {
+            MC_TRACE("table_prepare_region: table_contents_ensure() failed.");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+table_set_cell_range(table_t* table, const table_region_t* region,
+                     MC_TABLECELL* cells)
+{
+    DWORD col, row;
+    size_t i, n;
+    BOOL values = FALSE;
+    size_t attr_count = 0;
+
+    n = (size_t)(region->col1 - region->col0) * (region->row1 - region->row0);
+    for(i = 0; i < n; i++) {
+        if(cells[i].fMask & MC_TCM_VALUE)
+            values = TRUE;
+        if(cells[i].fMask & MC_TCM_ATTRS)
+            attr_count++;
+    }
+
+    /* Either the table takes all the cells, or none of them. */
+    if(MC_ERR(table_prepare_region(table, region, values, attr_count) != 0)) {
+        MC_TRACE("table_set_cell_range: table_prepare_region() failed.");
+        return -1;
+    }
+
+    table_begin_update(table);
+    for(row = region->row0; row < region->row1; row++) {
+        for(col = region->col0; col < region->col1; col++) {
+            /* Cannot fail as the region is prepared. */
+            if(MC_ERR(table_set_cell(table, col, row, cells) != 0))
+                MC_TRACE("table_set_cell_range: table_set_cell() failed.");
+            cells++;
+        }
+    }
+    table_end_update(table);
+    return 0;
+}
+
+void
+table_get_cell_range(table_t* table, const table_region_t* region,
+                     MC_TABLECELL* cells)
+{
+    DWORD col, row;
+
+    for(row = region->row0; row < region->row1; row++) {
+        for(col = region->col0; col < region->col1; col++) {
+            table_get_cell(table, col, row, cells);
+            cells++;
+        }
+    }
+}
+
+int
+table_post_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell)
+{
+    table_post_t* post;
+    HWND win;
+
+    MC_ASSERT(!IS_VIRTUAL(table));
+    MC_ASSERT(!IS_SNAPSHOT(table));
+
+    post = (table_post_t*) malloc(sizeof(table_post_t));
+    if(MC_ERR(post == NULL)) {
+        MC_TRACE("table_post_cell: malloc() failed.");
+        return -1;
+    }
+
+    post->col = col;
+    post->row = row;
+    memcpy(&post->cell, cell, sizeof(MC_TABLECELL));
+
+    /* Only the first write of a batch wakes up the owner thread. The rest
+     * gets processed together with it. */
+    if(table_postq_push(&table->posted, post)) {
+        win = (HWND) mc_atomic_load_ptr((void* volatile*) &table->post_win);
+        if(win != NULL)
+            PostMessage(win, TABLE_WM_PROCESSPOSTED, 0, (LPARAM) table);
+    }
+
+    return 0;
+}
+
+void
+table_process_posted(table_t* table)
+{
+    table_post_t* post;
+    table_post_t* next;
+
+    post = table_postq_take(&table->posted);
+    if(post == NULL)
+        return;
+
+    /* The views get just one refresh for the whole batch. */
+    table_begin_update(table);
+    while(post != NULL) {
+        next = post->next;
+
+        /* The table may have been resized since the cell was posted. */
+        if(MC_ERR(post->col >= table->contents.col_count  ||
+                  post->row >= table->contents.row_count)) {
+            MC_TRACE("table_process_posted: [%lu, %lu] out of range.",
+                     (ULONG)post->col, (ULONG)post->row);
+            table_post_discard(post);
+        } else if(MC_ERR(table_set_cell(table, post->col, post->row, &post->cell) != 0)) {
+            MC_TRACE("table_process_posted: table_set_cell() failed.");
+            table_post_discard(post);
+        } else {
+            free(post);
+        }
+
+        post = next;
+    }
+    table_end_update(table);
+}
+
+int
+table_set_post_window(table_t* table, HWND win)
+{
+    HWND* wins;
+
+    /* Remember all the windows, so another one can take over when the
+     * notified one goes away. */
+    wins = (HWND*) realloc(table->post_wins, (table->post_win_count + 1) * sizeof(HWND));
+    if(MC_ERR(wins == NULL)) {
+        MC_TRACE("table_set_post_window: realloc() failed.");
+        return -1;
+    }
+    wins[table->post_win_count++] = win;
+    table->post_wins = wins;
+
+    /* Only one window is needed to process the posted cells. */
+    if(!mc_atomic_cas_ptr((void* volatile*) &table->post_win, NULL, win))
+        return 0;
+
+    /* Some cells might have been posted when nobody was notified. */
+    if(!table_postq_is_empty(&table->posted))
+        PostMessage(win, TABLE_WM_PROCESSPOSTED, 0, (LPARAM) table);
+    return 0;
+}
+
+void
+table_reset_post_window(table_t* table, HWND win)
+{
+    HWND next;
+    UINT i;
+
+    for(i = 0; i < table->post_win_count; i++) {
+        if(table->post_wins[i] == win)
+            break;
+    }
+    if(i >= table->post_win_count)
+        return;
+
+    table->post_wins[i] = table->post_wins[--table->post_win_count];
+    if(table->post_win_count == 0) {
+        free(table->post_wins);
+        table->post_wins = NULL;
+    }
+
+    /* Hand over to another registered window, if any. */
+    next = (table->post_win_count > 0 ? table->post_wins[0] : NULL);
+    if(!mc_atomic_cas_ptr((void* volatile*) &table->post_win, win, next))
+        return;
+
+    if(next != NULL) {
+        /* The notification might have gone to the old window. */
+        if(!table_postq_is_empty(&table->posted))
+            PostMessage(next, TABLE_WM_PROCESSPOSTED, 0, (LPARAM) table);
+    } else {
+        /* Do not leave the pending cells behind without anyone to process
+         * them. */
+        table_process_posted(table);
+    }
 }
 
 int
 table_install_view(table_t* table, void* view, view_refresh_t refresh)
 {
-    return view_list_install_view(&table->vlist, view, refresh);
+    return view_list_install_view(&table->vlist, view, refresh);
+}
+
+void
+table_uninstall_view(table_t* table, int handle)
+{
+    view_list_uninstall_view(&table->vlist, handle);
+}
+
+void
+table_set_view_interest(table_t* table, int handle, table_interest_t* interest)
+{
+    view_list_set_interest(&table->vlist, handle, interest);
+}
+
+
+
+/* Validates region given to mcTable_xxxxRange() functions. */
+static BOOL
+table_check_range(table_t* table, DWORD col, DWORD row,
+                  DWORD col_count, DWORD row_count, table_region_t* region)
+{
+    if(MC_ERR(col > table->contents.col_count  ||
+              col_count > table->contents.col_count - col  ||
+              row > table->contents.row_count  ||
+              row_count > table->contents.row_count - row)) {
+        MC_TRACE("table_check_range: [%lu, %lu] + [%lu, %lu] out of range.",
+                 (ULONG)col, (ULONG)row, (ULONG)col_count, (ULONG)row_count);
+        return FALSE;
+    }
+
+    region->col0 = col;
+    region->row0 = row;
+    region->col1 = col + col_count;
+    region->row1 = row + row_count;
+    return TRUE;
+}
+
+
+/**************************
+ *** Exported functions ***
+ **************************/
+
+MC_HTABLE MCTRL_API
+mcTable_Create(WORD wColumnCount, WORD wRowCount, MC_HVALUETYPE hType, DWORD dwFlags)
+{
+    return mcTable_CreateEx(wColumnCount, wRowCount, hType, dwFlags);
+}
+
+MC_HTABLE MCTRL_API
+mcTable_CreateEx(DWORD dwColumnCount, DWORD dwRowCount, MC_HVALUETYPE hType,
+                 DWORD dwFlags)
+{
+    return (MC_HTABLE) table_create(dwColumnCount, dwRowCount, (value_type_t*)hType, dwFlags);
 }
 
-void
-table_uninstall_view(table_t* table, void* view)
+MC_HTABLE MCTRL_API
+mcTable_CreateColumnar(DWORD dwColumnCount, DWORD dwRowCount,
+                       const MC_HVALUETYPE* phColumnTypes, DWORD dwFlags)
 {
-    view_list_uninstall_view(&table->vlist, view);
-}
+    DWORD col;
 
+    if(MC_ERR(dwColumnCount > 0  &&  phColumnTypes == NULL)) {
+        MC_TRACE("mcTable_CreateColumnar: phColumnTypes == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
 
+    for(col = 0; col < dwColumnCount; col++) {
+        if(MC_ERR(phColumnTypes[col] == NULL)) {
+            MC_TRACE("mcTable_CreateColumnar: phColumnTypes[%lu] == NULL", (ULONG)col);
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return NULL;
+        }
+    }
 
-/**************************
- *** Exported functions ***
- **************************/
+    return (MC_HTABLE) table_create_columnar(dwColumnCount, dwRowCount,
+                                             (value_type_t**) phColumnTypes, dwFlags);
+}
 
 MC_HTABLE MCTRL_API
-mcTable_Create(WORD wColumnCount, WORD wRowCount, MC_HVALUETYPE hType, DWORD dwFlags)
+mcTable_CreateVirtual(DWORD dwColumnCount, DWORD dwRowCount,
+                      MC_TABLECALLBACK pfnCallback, void* pUserData,
+                      DWORD dwCacheSize)
 {
-    return (MC_HTABLE) table_create(wColumnCount, wRowCount, (value_type_t*)hType, dwFlags);
+    if(MC_ERR(pfnCallback == NULL)) {
+        MC_TRACE("mcTable_CreateVirtual: pfnCallback == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    return (MC_HTABLE) table_create_virtual(dwColumnCount, dwRowCount,
+                                            pfnCallback, pUserData, dwCacheSize);
 }
 
 void MCTRL_API
@@ -591,34 +2913,128 @@ mcTable_Release(MC_HTABLE hTable)
 
 WORD MCTRL_API
 mcTable_ColumnCount(MC_HTABLE hTable)
+{
+    /* Saturate rather then wrap around for tables too large for this API. */
+    return (WORD) MC_MIN(mcTable_ColumnCountEx(hTable), 0xffff);
+}
+
+DWORD MCTRL_API
+mcTable_ColumnCountEx(MC_HTABLE hTable)
 {
     return (hTable ? table_col_count((table_t*)hTable) : 0);
 }
 
 WORD MCTRL_API
 mcTable_RowCount(MC_HTABLE hTable)
+{
+    return (WORD) MC_MIN(mcTable_RowCountEx(hTable), 0xffff);
+}
+
+DWORD MCTRL_API
+mcTable_RowCountEx(MC_HTABLE hTable)
 {
     return (hTable ? table_row_count((table_t*)hTable) : 0);
 }
 
 BOOL MCTRL_API
 mcTable_Resize(MC_HTABLE hTable, WORD wColumnCount, WORD wRowCount)
+{
+    return mcTable_ResizeEx(hTable, wColumnCount, wRowCount);
+}
+
+BOOL MCTRL_API
+mcTable_ResizeEx(MC_HTABLE hTable, DWORD dwColumnCount, DWORD dwRowCount)
 {
     if(MC_ERR(hTable == NULL)) {
-        MC_TRACE("mcTable_Resize: hTable == NULL");
+        MC_TRACE("mcTable_ResizeEx: hTable == NULL");
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
-    return (table_resize((table_t*)hTable, wColumnCount, wRowCount) == 0 ?
+    if(MC_ERR(IS_SNAPSHOT((table_t*)hTable))) {
+        MC_TRACE("mcTable_ResizeEx: Cannot resize table snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
+    return (table_resize((table_t*)hTable, dwColumnCount, dwRowCount) == 0 ?
             TRUE : FALSE);
 }
 
+BOOL MCTRL_API
+mcTable_InsertRows(MC_HTABLE hTable, DWORD dwRow, DWORD dwCount)
+{
+    table_t* table = (table_t*) hTable;
+
+    if(MC_ERR(table == NULL)) {
+        MC_TRACE("mcTable_InsertRows: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if(MC_ERR(IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_InsertRows: Cannot modify table snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+    if(MC_ERR(dwRow > table_row_count(table))) {
+        MC_TRACE("mcTable_InsertRows: dwRow %lu out of range", dwRow);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if(MC_ERR(dwCount > 0xffffffff - table_row_count(table))) {
+        MC_TRACE("mcTable_InsertRows: dwCount %lu too large", dwCount);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    return (table_insert_rows(table, dwRow, dwCount) == 0 ? TRUE : FALSE);
+}
+
+BOOL MCTRL_API
+mcTable_AppendRows(MC_HTABLE hTable, DWORD dwCount)
+{
+    return mcTable_InsertRows(hTable,
+                (hTable ? table_row_count((table_t*)hTable) : 0), dwCount);
+}
+
+BOOL MCTRL_API
+mcTable_DeleteRows(MC_HTABLE hTable, DWORD dwRow, DWORD dwCount)
+{
+    table_t* table = (table_t*) hTable;
+
+    if(MC_ERR(table == NULL)) {
+        MC_TRACE("mcTable_DeleteRows: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if(MC_ERR(IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_DeleteRows: Cannot modify table snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+    if(MC_ERR(dwRow > table_row_count(table)  ||
+              dwCount > table_row_count(table) - dwRow)) {
+        MC_TRACE("mcTable_DeleteRows: rows %lu..%lu out of range",
+                 dwRow, dwRow + dwCount);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    return (table_delete_rows(table, dwRow, dwCount) == 0 ? TRUE : FALSE);
+}
+
 void MCTRL_API
 mcTable_Clear(MC_HTABLE hTable)
 {
-    if(hTable)
-        table_clear((table_t*)hTable);
+    if(hTable == NULL)
+        return;
+
+    if(MC_ERR(IS_SNAPSHOT((table_t*)hTable))) {
+        MC_TRACE("mcTable_Clear: Cannot clear table snapshot.");
+        return;
+    }
+
+    table_clear((table_t*)hTable);
 }
 
 BOOL MCTRL_API
@@ -630,7 +3046,7 @@ mcTable_SetCell(MC_HTABLE hTable, WORD wCol, WORD wRow,
     cell.fMask = MC_TCM_VALUE;
     cell.hType = hType;
     cell.hValue = hValue;
-    return mcTable_SetCellEx(hTable, wCol, wRow, &cell);
+    return mcTable_SetCellEx2(hTable, wCol, wRow, &cell);
 }
 
 BOOL MCTRL_API
@@ -640,7 +3056,7 @@ mcTable_GetCell(MC_HTABLE hTable, WORD wCol, WORD wRow,
     MC_TABLECELL cell;
 
     cell.fMask = MC_TCM_VALUE;
-    if(MC_ERR(!mcTable_GetCellEx(hTable, wCol, wRow, &cell)))
+    if(MC_ERR(!mcTable_GetCellEx2(hTable, wCol, wRow, &cell)))
         return FALSE;
     if(phType) *phType = cell.hType;
     if(phValue) *phValue = cell.hValue;
@@ -649,6 +3065,12 @@ mcTable_GetCell(MC_HTABLE hTable, WORD wCol, WORD wRow,
 
 BOOL MCTRL_API
 mcTable_SetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
+{
+    return mcTable_SetCellEx2(hTable, wCol, wRow, pCell);
+}
+
+BOOL MCTRL_API
+mcTable_SetCellEx2(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow, MC_TABLECELL* pCell)
 {
     table_t* table = (table_t*) hTable;
 
@@ -658,8 +3080,8 @@ mcTable_SetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
         return FALSE;
     }
 
-    if(MC_ERR(wCol >= table->contents.col_count || wRow >= table->contents.row_count)) {
-        MC_TRACE("mcTable_SetCell: [wCol, wRow] out of range.");
+    if(MC_ERR(dwCol >= table->contents.col_count || dwRow >= table->contents.row_count)) {
+        MC_TRACE("mcTable_SetCell: [dwCol, dwRow] out of range.");
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
@@ -670,20 +3092,34 @@ mcTable_SetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
         return FALSE;
     }
 
+    if(MC_ERR(IS_VIRTUAL(table)  ||  IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_SetCell: Cannot set cell of virtual table or snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
     if(MC_ERR((pCell->fMask & MC_TCM_VALUE)  &&
-              IS_HOMOGENOUS(&table->contents)  &&
-              pCell->hType != table->contents.type)) {
-        MC_TRACE("mcTable_SetCell: Value type mismatch in homogenous table.");
+              !table_accepts_type(table, dwCol, pCell->hType, pCell->hValue))) {
+        MC_TRACE("mcTable_SetCell: Value type mismatch.");
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
-    table_set_cell(table, wCol, wRow, pCell);
+    if(MC_ERR(table_set_cell(table, dwCol, dwRow, pCell) != 0)) {
+        MC_TRACE("mcTable_SetCell: table_set_cell() failed.");
+        return FALSE;
+    }
     return TRUE;
 }
 
 BOOL MCTRL_API
 mcTable_GetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
+{
+    return mcTable_GetCellEx2(hTable, wCol, wRow, pCell);
+}
+
+BOOL MCTRL_API
+mcTable_GetCellEx2(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow, MC_TABLECELL* pCell)
 {
     table_t* table = (table_t*) hTable;
 
@@ -693,8 +3129,8 @@ mcTable_GetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
         return FALSE;
     }
 
-    if(MC_ERR(wCol >= table->contents.col_count || wRow >= table->contents.row_count)) {
-        MC_TRACE("mcTable_GetCell: [wCol, wRow] out of range.");
+    if(MC_ERR(dwCol >= table->contents.col_count || dwRow >= table->contents.row_count)) {
+        MC_TRACE("mcTable_GetCell: [dwCol, dwRow] out of range.");
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
@@ -705,6 +3141,333 @@ mcTable_GetCellEx(MC_HTABLE hTable, WORD wCol, WORD wRow, MC_TABLECELL* pCell)
         return FALSE;
     }
 
-    table_get_cell(table, wCol, wRow, pCell);
+    table_get_cell(table, dwCol, dwRow, pCell);
+    return TRUE;
+}
+
+BOOL MCTRL_API
+mcTable_SetCellRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                     DWORD dwColCount, DWORD dwRowCount, MC_TABLECELL* pCells)
+{
+    table_t* table = (table_t*) hTable;
+    table_region_t region;
+    DWORD col, row;
+    MC_TABLECELL* cell;
+
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_SetCellRange: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(!table_check_range(table, dwCol, dwRow, dwColCount, dwRowCount, &region))) {
+        MC_TRACE("mcTable_SetCellRange: Region out of range.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(IS_VIRTUAL(table)  ||  IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_SetCellRange: Cannot set cells of virtual table or snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
+    /* Validate all the cells before we touch the table. */
+    cell = pCells;
+    for(row = region.row0; row < region.row1; row++) {
+        for(col = region.col0; col < region.col1; col++) {
+            if(MC_ERR(cell->fMask & ~MC_TCM_ALL)) {
+                MC_TRACE("mcTable_SetCellRange: Unsupported pCells[%lu]->fMask",
+                         (ULONG)(cell - pCells));
+                SetLastError(ERROR_INVALID_PARAMETER);
+                return FALSE;
+            }
+            if(MC_ERR((cell->fMask & MC_TCM_VALUE)  &&
+                      !table_accepts_type(table, col, cell->hType, cell->hValue))) {
+                MC_TRACE("mcTable_SetCellRange: Value type mismatch in "
+                         "pCells[%lu].", (ULONG)(cell - pCells));
+                SetLastError(ERROR_INVALID_PARAMETER);
+                return FALSE;
+            }
+            cell++;
+        }
+    }
+
+    if(MC_ERR(table_set_cell_range(table, &region, pCells) != 0)) {
+        MC_TRACE("mcTable_SetCellRange: table_set_cell_range() failed.");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL MCTRL_API
+mcTable_GetCellRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                     DWORD dwColCount, DWORD dwRowCount, MC_TABLECELL* pCells)
+{
+    table_t* table = (table_t*) hTable;
+    table_region_t region;
+    size_t i, n;
+
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_GetCellRange: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(!table_check_range(table, dwCol, dwRow, dwColCount, dwRowCount, &region))) {
+        MC_TRACE("mcTable_GetCellRange: Region out of range.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Values of virtual table live in its cache. If the range does not fit
+     * in, fetching its later cells would destroy values of the earlier ones. */
+    if(MC_ERR(!table_range_fits_cache(table, dwColCount, dwRowCount))) {
+        MC_TRACE("mcTable_GetCellRange: Range exceeds the cache of virtual table.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    n = (size_t)dwColCount * dwRowCount;
+    for(i = 0; i < n; i++) {
+        if(MC_ERR(pCells[i].fMask & ~MC_TCM_ALL)) {
+            MC_TRACE("mcTable_GetCellRange: Unsupported pCells[%lu]->fMask",
+                     (ULONG)i);
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return FALSE;
+        }
+    }
+
+    table_get_cell_range(table, &region, pCells);
+    return TRUE;
+}
+
+BOOL MCTRL_API
+mcTable_SetValueRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                      DWORD dwColCount, DWORD dwRowCount,
+                      const MC_HVALUETYPE* phTypes, const MC_HVALUE* phValues)
+{
+    table_t* table = (table_t*) hTable;
+    table_region_t region;
+    DWORD col, row;
+    MC_TABLECELL cell;
+    size_t i;
+
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_SetValueRange: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(!table_check_range(table, dwCol, dwRow, dwColCount, dwRowCount, &region))) {
+        MC_TRACE("mcTable_SetValueRange: Region out of range.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(IS_VIRTUAL(table)  ||  IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_SetValueRange: Cannot set cells of virtual table or snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
+    /* Validate all the values before we touch the table. When phTypes is
+     * NULL, each value is of the type its column requires. */
+    i = 0;
+    for(row = region.row0; row < region.row1; row++) {
+        for(col = region.col0; col < region.col1; col++) {
+            if(phTypes != NULL) {
+                cell.hType = phTypes[i];
+            } else {
+                cell.hType = table_column_type(table, col);
+                if(MC_ERR(cell.hType == NULL  &&  phValues[i] != NULL)) {
+                    MC_TRACE("mcTable_SetValueRange: phTypes == NULL for "
+                             "heterogenous column %lu", (ULONG)col);
+                    SetLastError(ERROR_INVALID_PARAMETER);
+                    return FALSE;
+                }
+            }
+            if(MC_ERR(!table_accepts_type(table, col, cell.hType, phValues[i]))) {
+                MC_TRACE("mcTable_SetValueRange: Value type mismatch in "
+                         "phValues[%lu].", (ULONG)i);
+                SetLastError(ERROR_INVALID_PARAMETER);
+                return FALSE;
+            }
+            i++;
+        }
+    }
+
+    /* Setting the values then cannot fail, so the table takes all the
+     * values or none of them. */
+    if(MC_ERR(table_prepare_region(table, &region, TRUE, 0) != 0)) {
+        MC_TRACE("mcTable_SetValueRange: table_prepare_region() failed.");
+        return FALSE;
+    }
+
+    cell.fMask = MC_TCM_VALUE;
+    i = 0;
+    table_begin_update(table);
+    for(row = region.row0; row < region.row1; row++) {
+        for(col = region.col0; col < region.col1; col++) {
+            cell.hValue = phValues[i];
+            if(phTypes != NULL)
+                cell.hType = phTypes[i];
+            else
+                cell.hType = (cell.hValue != NULL ? table_column_type(table, col) : NULL);
+            /* Cannot fail as the rows are ready. */
+            if(MC_ERR(table_set_cell(table, col, row, &cell) != 0))
+                MC_TRACE("mcTable_SetValueRange: table_set_cell() failed.");
+            i++;
+        }
+    }
+    table_end_update(table);
+    return TRUE;
+}
+
+BOOL MCTRL_API
+mcTable_GetValueRange(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow,
+                      DWORD dwColCount, DWORD dwRowCount,
+                      MC_HVALUETYPE* phTypes, MC_HVALUE* phValues)
+{
+    table_t* table = (table_t*) hTable;
+    table_region_t region;
+    DWORD col, row;
+    MC_TABLECELL cell;
+    size_t i;
+
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_GetValueRange: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(!table_check_range(table, dwCol, dwRow, dwColCount, dwRowCount, &region))) {
+        MC_TRACE("mcTable_GetValueRange: Region out of range.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Values of virtual table live in its cache. If the range does not fit
+     * in, fetching its later cells would destroy values of the earlier ones. */
+    if(MC_ERR(!table_range_fits_cache(table, dwColCount, dwRowCount))) {
+        MC_TRACE("mcTable_GetValueRange: Range exceeds the cache of virtual table.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    cell.fMask = MC_TCM_VALUE;
+    i = 0;
+    for(row = region.row0; row < region.row1; row++) {
+        for(col = region.col0; col < region.col1; col++) {
+            table_get_cell(table, col, row, &cell);
+            if(phTypes != NULL)
+                phTypes[i] = cell.hType;
+            if(phValues != NULL)
+                phValues[i] = cell.hValue;
+            i++;
+        }
+    }
+    return TRUE;
+}
+
+MC_HTABLE MCTRL_API
+mcTable_Snapshot(MC_HTABLE hTable)
+{
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_Snapshot: hTable == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    return (MC_HTABLE) table_snapshot((table_t*) hTable);
+}
+
+BOOL MCTRL_API
+mcTable_PostCell(MC_HTABLE hTable, DWORD dwCol, DWORD dwRow, MC_TABLECELL* pCell)
+{
+    table_t* table = (table_t*) hTable;
+    MC_TABLECELL cell;
+
+    if(MC_ERR(hTable == NULL  ||  pCell == NULL)) {
+        MC_TRACE("mcTable_PostCell: hTable == NULL || pCell == NULL");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    if(MC_ERR(pCell->fMask & ~MC_TCM_ALL)) {
+        MC_TRACE("mcTable_PostCell: Unsupported pCell->fMask");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* We may be called from any thread, so we may only check what never
+     * changes during the life of the table. The rest is checked when the
+     * cell is processed. */
+    if(MC_ERR(IS_VIRTUAL(table)  ||  IS_SNAPSHOT(table))) {
+        MC_TRACE("mcTable_PostCell: Cannot set cell of virtual table or snapshot.");
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
+    if(MC_ERR(IS_COLUMNAR(table)  &&  dwCol >= table->contents.col_count)) {
+        MC_TRACE("mcTable_PostCell: dwCol out of range.");
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    memcpy(&cell, pCell, sizeof(MC_TABLECELL));
+    if(cell.fMask & MC_TCM_VALUE) {
+        /* (Column types never change.) */
+        value_type_t* expected = table_column_type(table, dwCol);
+
+        if(cell.hValue == NULL) {
+            cell.hType = NULL;
+        } else {
+            if(cell.hType == NULL)
+                cell.hType = expected;
+            if(MC_ERR(cell.hType == NULL  ||
+                      (expected != NULL  &&  cell.hType != expected))) {
+                MC_TRACE("mcTable_PostCell: Value type mismatch.");
+                SetLastError(ERROR_INVALID_PARAMETER);
+                return FALSE;
+            }
+        }
+    }
+
+    if(MC_ERR(table_post_cell(table, dwCol, dwRow, &cell) != 0)) {
+        MC_TRACE("mcTable_PostCell: table_post_cell() failed.");
+        return FALSE;
+    }
     return TRUE;
 }
+
+void MCTRL_API
+mcTable_ProcessPostedCells(MC_HTABLE hTable)
+{
+    if(MC_ERR(hTable == NULL)) {
+        MC_TRACE("mcTable_ProcessPostedCells: hTable == NULL");
+        return;
+    }
+
+    table_process_posted((table_t*) hTable);
+}
+
+void MCTRL_API
+mcTable_BeginUpdate(MC_HTABLE hTable)
+{
+    if(hTable)
+        table_begin_update((table_t*)hTable);
+}
+
+void MCTRL_API
+mcTable_EndUpdate(MC_HTABLE hTable)
+{
+    table_t* table = (table_t*) hTable;
+
+    if(MC_ERR(table == NULL  ||  table->update_level == 0)) {
+        MC_TRACE("mcTable_EndUpdate: Not paired with mcTable_BeginUpdate().");
+        return;
+    }
+
+    table_end_update(table);
+}
@@ -32,36 +32,118 @@ typedef struct table_tag table_t;
 /* [col0, row0] inclusive; [col1, row1] exclusive */
 typedef struct table_region_tag table_region_t;
 struct table_region_tag {
-    WORD col0;
-    WORD row0;
-    WORD col1;
-    WORD row1;
+    DWORD col0;
+    DWORD row0;
+    DWORD col1;
+    DWORD row1;
 };
 
 
-table_t* table_create(WORD col_count, WORD row_count,
+table_t* table_create(DWORD col_count, DWORD row_count,
                       value_type_t* cell_type, DWORD mask);
+table_t* table_create_columnar(DWORD col_count, DWORD row_count,
+                               value_type_t** col_types, DWORD flags);
+table_t* table_create_virtual(DWORD col_count, DWORD row_count,
+                              MC_TABLECALLBACK callback, void* callback_data,
+                              DWORD cache_size);
+
+/* Returns read-only copy of the table. It shares cells with the table
+ * (copy-on-write), so it is cheap to make, and it may be read from another
+ * thread while the table is being modified. */
+table_t* table_snapshot(table_t* table);
 
 void table_ref(table_t* table);
 void table_unref(table_t* table);
 
-WORD table_col_count(const table_t* table);
-WORD table_row_count(const table_t* table);
+DWORD table_col_count(const table_t* table);
+DWORD table_row_count(const table_t* table);
 
-void table_paint_cell(const table_t* table, WORD col, WORD row, HDC dc, RECT* rect);
+void table_paint_cell(table_t* table, DWORD col, DWORD row, HDC dc, RECT* rect);
 
-int table_resize(table_t* table, WORD col_count, WORD row_count);
+int table_resize(table_t* table, DWORD col_count, DWORD row_count);
+int table_insert_rows(table_t* table, DWORD row, DWORD count);
+int table_delete_rows(table_t* table, DWORD row, DWORD count);
 void table_clear(table_t* table);
 
-void table_get_cell(const table_t* table, WORD col, WORD row, MC_TABLECELL* cell);
-void table_set_cell(table_t* table, WORD col, WORD row, MC_TABLECELL* cell);
+void table_get_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell);
+int table_set_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell);
+
+/* Cells of the region are passed in the array row by row. */
+int table_set_cell_range(table_t* table, const table_region_t* region,
+                         MC_TABLECELL* cells);
+void table_get_cell_range(table_t* table, const table_region_t* region,
+                          MC_TABLECELL* cells);
+
+/* Returns the value type all cells of the column must have, or NULL if
+ * the column may hold values of any type. */
+value_type_t* table_column_type(const table_t* table, DWORD col);
+
+/* Checks whether the value (of the given type) may be set into the column. */
+BOOL table_accepts_type(const table_t* table, DWORD col,
+                        MC_HVALUETYPE type, MC_HVALUE value);
+
+/* Views are not refreshed until the outermost table_end_update(). Then they
+ * get single refresh with the bounding box of all the changed regions. */
+void table_begin_update(table_t* table);
+void table_end_update(table_t* table);
+
+
+/* table_post_cell() may be called from any thread. The cell is only queued,
+ * and it gets set later in the thread owning the table, when it calls
+ * table_process_posted(). All cells queued meanwhile are set at once, within
+ * single table_begin_update() ... table_end_update() bracket.
+ *
+ * The value type of posted value must be already resolved (non-NULL). */
+int table_post_cell(table_t* table, DWORD col, DWORD row, MC_TABLECELL* cell);
+void table_process_posted(table_t* table);
+
+/* Window set with table_set_post_window() is notified with message
+ * TABLE_WM_PROCESSPOSTED (lParam being the table) whenever some cells get
+ * posted, and it should call table_process_posted() in response. Only one
+ * of the registered windows is notified at a time; when it is reset, another
+ * registered one takes over. Both functions must be called from the thread
+ * owning the table. */
+#define TABLE_WM_PROCESSPOSTED    (WM_USER + 0x7f00)
+
+int table_set_post_window(table_t* table, HWND win);
+void table_reset_post_window(table_t* table, HWND win);
 
 
 /* table_region_t is passed to the refresh function as the detail where 
  * the change happened. On some more substantial changes (e.g. resize) it may
- * be NULL (meaning redraw everything). */
+ * be NULL (meaning redraw everything).
+ *
+ * table_install_view() returns a handle to be passed to table_uninstall_view()
+ * later, or -1 on failure. */
 int table_install_view(table_t* table, void* view, view_refresh_t refresh);
-void table_uninstall_view(table_t* table, void* view);
+void table_uninstall_view(table_t* table, int handle);
+
+/* When called from the refresh function, table_shift_row() tells where rows
+ * have been inserted or deleted, so the view may move its per-row state
+ * along (the row count tells how many). It is TABLE_NO_SHIFT if the row count
+ * has not changed that way, and TABLE_SHIFT_UNKNOWN if several insertions
+ * or deletions got batched by table_begin_update(). */
+#define TABLE_NO_SHIFT          0xffffffff
+#define TABLE_SHIFT_UNKNOWN     0xfffffffe
+
+DWORD table_shift_row(const table_t* table);
+
+
+/* View showing only part of the table (e.g. the grid scrolled somewhere)
+ * may tell the table what region it shows. Changes of cells outside of it
+ * are then not passed to the view at all, they are only counted in the
+ * skipped member. (Changes of the row count and changes with NULL detail
+ * are passed to all the views.)
+ *
+ * The table keeps just the pointer to the interest, so the view updates the
+ * region in place whenever it scrolls. NULL interest means all changes. */
+typedef struct table_interest_tag table_interest_t;
+struct table_interest_tag {
+    table_region_t region;
+    UINT skipped;         /* changes outside the region, since forever */
+};
+
+void table_set_view_interest(table_t* table, int handle, table_interest_t* interest);
 
 
 #endif  /* MC_TABLE_H */
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2012 Martin Mitas
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "textcache.h"
+
+
+/* Uncomment this to have more verbose traces from this module. */
+/*#define TEXTCACHE_DEBUG     1*/
+
+#ifdef TEXTCACHE_DEBUG
+    #define TEXTCACHE_TRACE       MC_TRACE
+#else
+    #define TEXTCACHE_TRACE(...)  do { } while(0)
+#endif
+
+
+/* Max. count of cached layouts. When reached, the least recently used one
+ * is forgotten. */
+#define TEXTCACHE_MAX_ENTRIES     512
+
+/* Longer strings are not cached (so the memory consumed by the cache stays
+ * bounded). */
+#define TEXTCACHE_MAX_LEN         128
+
+/* Count of hash buckets. Must be power of 2. */
+#define TEXTCACHE_BUCKETS         1024
+
+/* DrawText() flags we can handle. */
+#define TEXTCACHE_SUPPORTED_FORMAT                                            \
+        (DT_LEFT | DT_CENTER | DT_RIGHT | DT_TOP | DT_VCENTER | DT_BOTTOM |   \
+         DT_SINGLELINE | DT_END_ELLIPSIS | DT_NOPREFIX | DT_HIDEPREFIX |      \
+         DT_NOCLIP)
+
+/* Of them, only these affect the layout. The others are applied when
+ * painting. */
+#define TEXTCACHE_LAYOUT_FORMAT   (DT_END_ELLIPSIS)
+
+
+typedef struct textcache_entry_tag textcache_entry_t;
+struct textcache_entry_tag {
+    textcache_entry_t* hash_next;
+    textcache_entry_t* lru_prev;   /* more recently used */
+    textcache_entry_t* lru_next;   /* less recently used */
+    UINT hash;
+    HFONT font;
+    int width;
+    UINT format;
+    SIZE extent;                   /* extent of text[] */
+    WORD len;                      /* length of str[] */
+    WORD text_len;                 /* length of text[] */
+    TCHAR* text;                   /* points to str[], or to shortened copy */
+    TCHAR str[1];                  /* (the key, followed by the copy) */
+};
+
+
+static CRITICAL_SECTION textcache_lock;
+static BOOL textcache_enabled = FALSE;
+static textcache_entry_t* textcache_buckets[TEXTCACHE_BUCKETS];
+static textcache_entry_t* textcache_lru_head = NULL;
+static textcache_entry_t* textcache_lru_tail = NULL;
+static textcache_stats_t textcache_counters;
+static LONG volatile textcache_bypasses = 0;
+
+
+static UINT
+textcache_hash(HFONT font, int width, UINT format, const TCHAR* str, int len)
+{
+    /* FNV-1a */
+    UINT hash = 2166136261U;
+    int i;
+
+    for(i = 0; i < len; i++) {
+        hash ^= (UINT) str[i];
+        hash *= 16777619U;
+    }
+    hash ^= (UINT) (UINT_PTR) font;
+    hash *= 16777619U;
+    hash ^= (UINT) width;
+    hash *= 16777619U;
+    hash ^= format;
+    hash *= 16777619U;
+    return hash;
+}
+
+static textcache_entry_t*
+textcache_lookup(UINT hash, HFONT font, int width, UINT format,
+                 const TCHAR* str, int len)
+{
+    textcache_entry_t* entry;
+
+    for(entry = textcache_buckets[hash & (TEXTCACHE_BUCKETS-1)];
+        entry != NULL; entry = entry->hash_next)
+    {
+        if(entry->hash == hash  &&  entry->font == font  &&
+           entry->width == width  &&  entry->format == format  &&
+           entry->len == len  &&
+           memcmp(entry->str, str, len * sizeof(TCHAR)) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void
+textcache_lru_unlink(textcache_entry_t* entry)
+{
+    if(entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        textcache_lru_head = entry->lru_next;
+
+    if(entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        textcache_lru_tail = entry->lru_prev;
+}
+
+static void
+textcache_lru_link(textcache_entry_t* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = textcache_lru_head;
+    if(textcache_lru_head != NULL)
+        textcache_lru_head->lru_prev = entry;
+    else
+        textcache_lru_tail = entry;
+    textcache_lru_head = entry;
+}
+
+static void
+textcache_insert(textcache_entry_t* entry)
+{
+    textcache_entry_t** bucket;
+
+    bucket = &textcache_buckets[entry->hash & (TEXTCACHE_BUCKETS-1)];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    textcache_lru_link(entry);
+    textcache_counters.entries++;
+}
+
+static void
+textcache_remove(textcache_entry_t* entry)
+{
+    textcache_entry_t** link;
+
+    link = &textcache_buckets[entry->hash & (TEXTCACHE_BUCKETS-1)];
+    while(*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+
+    textcache_lru_unlink(entry);
+    textcache_counters.entries--;
+    free(entry);
+}
+
+/* Measures the text, and creates new entry for it. (Called without the lock
+ * held, as this is the expensive part.) */
+static textcache_entry_t*
+textcache_layout(HDC dc, UINT hash, HFONT font, int width, UINT format,
+                 const TCHAR* str, int len)
+{
+    static const TCHAR ellipsis[] = _T("...");
+    textcache_entry_t* entry;
+    SIZE size;
+    int fit = len;
+
+    GetTextExtentPoint32(dc, str, len, &size);
+    if((format & DT_END_ELLIPSIS)  &&  size.cx > width) {
+        GetTextExtentPoint32(dc, ellipsis, MC_ARRAY_SIZE(ellipsis) - 1, &size);
+        GetTextExtentExPoint(dc, str, len, MC_MAX(0, width - size.cx),
+                             &fit, NULL, &size);
+    }
+
+    entry = (textcache_entry_t*) malloc(sizeof(textcache_entry_t) +
+                (len + (fit < len ? fit + MC_ARRAY_SIZE(ellipsis) : 0)) * sizeof(TCHAR));
+    if(MC_ERR(entry == NULL)) {
+        MC_TRACE("textcache_layout: malloc() failed.");
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->font = font;
+    entry->width = width;
+    entry->format = format;
+    entry->len = len;
+    memcpy(entry->str, str, len * sizeof(TCHAR));
+    entry->str[len] = _T('\0');
+
+    if(fit < len) {
+        entry->text = entry->str + len + 1;
+        memcpy(entry->text, str, fit * sizeof(TCHAR));
+        memcpy(entry->text + fit, ellipsis, sizeof(ellipsis));
+        entry->text_len = fit + MC_ARRAY_SIZE(ellipsis) - 1;
+        GetTextExtentPoint32(dc, entry->text, entry->text_len, &size);
+    } else {
+        entry->text = entry->str;
+        entry->text_len = len;
+    }
+    entry->extent = size;
+
+    return entry;
+}
+
+static BOOL
+textcache_can_handle(HDC dc, const TCHAR* str, int len, UINT format)
+{
+    int i;
+
+    if(!textcache_enabled)
+        return FALSE;
+    if(!(format & DT_SINGLELINE)  ||  (format & ~TEXTCACHE_SUPPORTED_FORMAT))
+        return FALSE;
+    if(len > TEXTCACHE_MAX_LEN)
+        return FALSE;
+
+    /* Prefix characters need DrawText(). */
+    if(!(format & DT_NOPREFIX)) {
+        for(i = 0; i < len; i++) {
+            if(str[i] == _T('&'))
+                return FALSE;
+        }
+    }
+
+    /* Layouts are remembered for screen metrics only (consider e.g.
+     * WM_PRINTCLIENT with a printer DC). */
+    if(GetMapMode(dc) != MM_TEXT  ||  GetDeviceCaps(dc, TECHNOLOGY) != DT_RASDISPLAY)
+        return FALSE;
+
+    return TRUE;
+}
+
+void
+textcache_draw(HDC dc, const TCHAR* str, int len, RECT* rect, UINT format)
+{
+    HFONT font;
+    int width;
+    UINT layout_format;
+    UINT hash;
+    textcache_entry_t* entry;
+    textcache_entry_t* new_entry = NULL;
+    TCHAR text[TEXTCACHE_MAX_LEN + 4];
+    int text_len;
+    SIZE extent;
+    int x, y;
+    UINT old_align;
+
+    if(str == NULL)
+        return;
+    if(len < 0)
+        len = _tcslen(str);
+
+    if(!textcache_can_handle(dc, str, len, format))
+        goto bypass;
+
+    font = (HFONT) GetCurrentObject(dc, OBJ_FONT);
+    layout_format = (format & TEXTCACHE_LAYOUT_FORMAT);
+    width = ((format & DT_END_ELLIPSIS) ? mc_width(rect) : 0);
+    hash = textcache_hash(font, width, layout_format, str, len);
+
+    EnterCriticalSection(&textcache_lock);
+    entry = textcache_lookup(hash, font, width, layout_format, str, len);
+    if(entry != NULL) {
+        textcache_counters.hits++;
+        textcache_lru_unlink(entry);
+        textcache_lru_link(entry);
+        text_len = entry->text_len;
+        memcpy(text, entry->text, text_len * sizeof(TCHAR));
+        extent = entry->extent;
+    }
+    LeaveCriticalSection(&textcache_lock);
+
+    if(entry == NULL) {
+        new_entry = textcache_layout(dc, hash, font, width, layout_format, str, len);
+        if(MC_ERR(new_entry == NULL)) {
+            MC_TRACE("textcache_draw: textcache_layout() failed.");
+            goto bypass;
+        }
+
+        text_len = new_entry->text_len;
+        memcpy(text, new_entry->text, text_len * sizeof(TCHAR));
+        extent = new_entry->extent;
+
+        EnterCriticalSection(&textcache_lock);
+        textcache_counters.misses++;
+        /* Another thread may have been faster. */
+        if(textcache_lookup(hash, font, width, layout_format, str, len) == NULL) {
+            textcache_insert(new_entry);
+            new_entry = NULL;
+            if(textcache_counters.entries > TEXTCACHE_MAX_ENTRIES) {
+                textcache_remove(textcache_lru_tail);
+                textcache_counters.evictions++;
+            }
+        }
+        LeaveCriticalSection(&textcache_lock);
+
+        if(new_entry != NULL)
+            free(new_entry);
+    }
+
+    switch(format & (DT_CENTER | DT_RIGHT)) {
+        case DT_CENTER:  x = rect->left + (mc_width(rect) - extent.cx) / 2; break;
+        case DT_RIGHT:   x = rect->right - extent.cx; break;
+        default:         x = rect->left; break;
+    }
+
+    if(format & DT_VCENTER)
+        y = rect->top + (mc_height(rect) - extent.cy) / 2;
+    else if(format & DT_BOTTOM)
+        y = rect->bottom - extent.cy;
+    else
+        y = rect->top;
+
+    old_align = SetTextAlign(dc, TA_LEFT | TA_TOP | TA_NOUPDATECP);
+    ExtTextOut(dc, x, y, ((format & DT_NOCLIP) ? 0 : ETO_CLIPPED), rect,
+               text, text_len, NULL);
+    SetTextAlign(dc, old_align);
+    return;
+
+bypass:
+    InterlockedIncrement(&textcache_bypasses);
+    DrawText(dc, str, len, rect, format);
+}
+
+void
+textcache_invalidate(HFONT font)
+{
+    textcache_entry_t* entry;
+    textcache_entry_t* next;
+
+    TEXTCACHE_TRACE("textcache_invalidate(%p)", font);
+
+    if(!textcache_enabled)
+        return;
+
+    EnterCriticalSection(&textcache_lock);
+    for(entry = textcache_lru_head; entry != NULL; entry = next) {
+        next = entry->lru_next;
+        if(font == NULL  ||  entry->font == font)
+            textcache_remove(entry);
+    }
+    LeaveCriticalSection(&textcache_lock);
+}
+
+void
+textcache_stats(textcache_stats_t* stats)
+{
+    if(textcache_enabled) {
+        EnterCriticalSection(&textcache_lock);
+        memcpy(stats, &textcache_counters, sizeof(textcache_stats_t));
+        LeaveCriticalSection(&textcache_lock);
+    } else {
+        memset(stats, 0, sizeof(textcache_stats_t));
+    }
+    stats->bypasses = textcache_bypasses;
+}
+
+
+int
+textcache_init(void)
+{
+    InitializeCriticalSection(&textcache_lock);
+    memset(textcache_buckets, 0, sizeof(textcache_buckets));
+    memset(&textcache_counters, 0, sizeof(textcache_stats_t));
+    textcache_lru_head = NULL;
+    textcache_lru_tail = NULL;
+    textcache_bypasses = 0;
+    textcache_enabled = TRUE;
+    return 0;
+}
+
+void
+textcache_fini(void)
+{
+    textcache_stats_t stats;
+
+    textcache_stats(&stats);
+    MC_TRACE("textcache_fini: %u hits, %u misses, %u evictions, %u bypasses",
+             stats.hits, stats.misses, stats.evictions, stats.bypasses);
+
+    textcache_invalidate(NULL);
+    textcache_enabled = FALSE;
+    DeleteCriticalSection(&textcache_lock);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012 Martin Mitas
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MC_TEXTCACHE_H
+#define MC_TEXTCACHE_H
+
+#include "misc.h"
+
+
+/* Replacement of DrawText() for single-line text. It remembers how the text
+ * has been laid out (the text extent and, with DT_END_ELLIPSIS, the shortened
+ * string) for the font of the DC and the rect width, so repainting the same
+ * text does not measure the glyphs again. Formats the cache cannot handle are
+ * simply passed to DrawText(). */
+void textcache_draw(HDC dc, const TCHAR* str, int len, RECT* rect, UINT format);
+
+/* Forgets all the layouts made with the font (or all the layouts if font is
+ * NULL). Controls call this when they get new font (GDI may reuse a handle
+ * of deleted font for a new one) or on theme change. */
+void textcache_invalidate(HFONT font);
+
+
+typedef struct textcache_stats_tag textcache_stats_t;
+struct textcache_stats_tag {
+    UINT hits;
+    UINT misses;
+    UINT evictions;
+    UINT bypasses;    /* calls passed directly to DrawText() */
+    UINT entries;
+};
+
+void textcache_stats(textcache_stats_t* stats);
+
+
+int textcache_init(void);
+void textcache_fini(void);
+
+
+#endif  /* MC_TEXTCACHE_H */
@@ -17,6 +17,7 @@
  */
 
 #include "value.h"
+#include "textcache.h"
 
 
 static UINT
@@ -157,8 +158,8 @@ int32_paint(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
-    DrawText(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
-             draw_text_format(flags, DT_RIGHT | DT_VCENTER));
+    textcache_draw(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
+                   draw_text_format(flags, DT_RIGHT | DT_VCENTER));
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -257,8 +258,8 @@ uint32_paint(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
-    DrawText(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
-             draw_text_format(flags, DT_RIGHT | DT_VCENTER));
+    textcache_draw(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
+                   draw_text_format(flags, DT_RIGHT | DT_VCENTER));
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -389,8 +390,8 @@ int64_paint(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
-    DrawText(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
-             draw_text_format(flags, DT_RIGHT | DT_VCENTER));
+    textcache_draw(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
+                   draw_text_format(flags, DT_RIGHT | DT_VCENTER));
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -519,8 +520,8 @@ uint64_paint(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
-    DrawText(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
-             draw_text_format(flags, DT_RIGHT | DT_VCENTER));
+    textcache_draw(dc, buffer, -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
+                   draw_text_format(flags, DT_RIGHT | DT_VCENTER));
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -640,8 +641,13 @@ str_paint_W(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
+#ifdef UNICODE
+    textcache_draw(dc, value_get_string_W(v), -1, rect, DT_SINGLELINE |
+                   DT_END_ELLIPSIS | draw_text_format(flags, DT_LEFT | DT_VCENTER));
+#else
     DrawTextW(dc, value_get_string_W(v), -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
               draw_text_format(flags, DT_LEFT | DT_VCENTER));
+#endif
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -753,8 +759,27 @@ str_paint_A(const value_t v, HDC dc, RECT* rect, DWORD flags)
 
     old_bkmode = SetBkMode(dc, TRANSPARENT);
     old_color = SetTextColor(dc, GetSysColor(COLOR_BTNTEXT));
-    DrawTextA(dc, value_get_string_A(v), -1, rect, DT_SINGLELINE | DT_END_ELLIPSIS |
-              draw_text_format(flags, DT_LEFT | DT_VCENTER));
+#ifdef UNICODE
+    {
+        /* The text cache works with TCHAR strings. Short strings are
+         * converted; the long ones would not be cached anyway. */
+        WCHAR buffer[256];
+        int len;
+
+        len = MultiByteToWideChar(CP_ACP, 0, value_get_string_A(v), -1,
+                                  buffer, MC_ARRAY_SIZE(buffer));
+        if(len > 0) {
+            textcache_draw(dc, buffer, len - 1, rect, DT_SINGLELINE |
+                    DT_END_ELLIPSIS | draw_text_format(flags, DT_LEFT | DT_VCENTER));
+        } else {
+            DrawTextA(dc, value_get_string_A(v), -1, rect, DT_SINGLELINE |
+                    DT_END_ELLIPSIS | draw_text_format(flags, DT_LEFT | DT_VCENTER));
+        }
+    }
+#else
+    textcache_draw(dc, value_get_string_A(v), -1, rect, DT_SINGLELINE |
+                   DT_END_ELLIPSIS | draw_text_format(flags, DT_LEFT | DT_VCENTER));
+#endif
     SetTextColor(dc, old_color);
     SetBkMode(dc, old_bkmode);
 }
@@ -940,6 +965,18 @@ hicon_paint(const value_t v, HDC dc, RECT* rect, DWORD flags)
         default:                     MC_UNREACHABLE;
     }
 
+    /* Painters must not paint out of the rect (the caller does not clip
+     * each cell separately), so clip the icon if it does not fit. */
+    if(icon_size.cx > mc_width(rect)  ||  icon_size.cy > mc_height(rect)) {
+        int old_dc_state;
+
+        old_dc_state = SaveDC(dc);
+        IntersectClipRect(dc, rect->left, rect->top, rect->right, rect->bottom);
+        DrawIconEx(dc, x, y, icon, 0, 0, 0, NULL, DI_NORMAL);
+        RestoreDC(dc, old_dc_state);
+        return;
+    }
+
     DrawIconEx(dc, x, y, icon, 0, 0, 0, NULL, DI_NORMAL);
 }
 
@@ -955,6 +992,17 @@ static const struct value_type_tag hicon_type = {
 const value_type_t* VALUE_TYPE_HICON = &hicon_type;
 
 
+/***********************
+ *** Type properties ***
+ ***********************/
+
+int
+value_type_is_trivial(const value_type_t* type)
+{
+    return (type->destroy == scalar_destroy);
+}
+
+
 /**************************
  *** Exported functions ***
  **************************/
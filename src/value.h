@@ -55,6 +55,8 @@ struct value_type_tag {
     int    (*cmp)(const value_t, const value_t);
     int    (*from_string)(value_t*, const TCHAR*);
     size_t (*to_string)(const value_t, TCHAR*, size_t);
+    /* Paints the value into the rect. It must not paint out of it, and it
+     * must leave the DC in the state it has got it. */
     void   (*paint)(const value_t, HDC, RECT*, DWORD);
 };
 
@@ -74,6 +76,11 @@ extern const value_type_t* VALUE_TYPE_HICON;
 #define VALUE_TYPE_IMMUTABLE_STRING   MC_NAME_AW(VALUE_TYPE_IMMUTABLE_STRING_)
 
 
+/* Returns non-zero if values of the type own no resources, i.e. if
+ * destroying them is a no-op and containers may just forget them. */
+int value_type_is_trivial(const value_type_t* type);
+
+
 void value_set_int32(value_t* v, int32_t i);
 int32_t value_get_int32(const value_t v);
 
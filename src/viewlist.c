@@ -19,46 +19,210 @@
 #include "viewlist.h"
 
 
+#define VIEW_LIST_INITIAL_CAPACITY     4
+
+/* The nodes array is aligned to this. */
+#define VIEW_LIST_CACHE_LINE          64
+
+
+void
+view_list_fini(view_list_t* vlist)
+{
+    MC_ASSERT(vlist->count == 0);
+    MC_ASSERT(vlist->refresh_level == 0);
+
+    _aligned_free(vlist->nodes);
+    free(vlist->slots);
+}
+
+static int
+view_list_grow(view_list_t* vlist)
+{
+    int capacity;
+    view_node_t* nodes;
+    int* slots;
+
+    capacity = (vlist->capacity > 0 ? vlist->capacity * 2 : VIEW_LIST_INITIAL_CAPACITY);
+
+    nodes = (view_node_t*) _aligned_realloc(vlist->nodes,
+                capacity * sizeof(view_node_t), VIEW_LIST_CACHE_LINE);
+    if(MC_ERR(nodes == NULL)) {
+        MC_TRACE("view_list_grow: _aligned_realloc() failed.");
+        return -1;
+    }
+    vlist->nodes = nodes;
+
+    slots = (int*) realloc(vlist->slots, capacity * sizeof(int));
+    if(MC_ERR(slots == NULL)) {
+        MC_TRACE("view_list_grow: realloc() failed.");
+        return -1;
+    }
+    vlist->slots = slots;
+
+    vlist->capacity = capacity;
+    return 0;
+}
+
 int
 view_list_install_view(view_list_t* vlist, void* view, view_refresh_t refresh)
 {
     view_node_t* node;
+    int handle;
 
     /* View can be installed only once in the list */
 #ifdef DEBUG
-    for(node = vlist->head; node != NULL; node = node->next)
-        MC_ASSERT(node->view != view);
+    {
+        int i;
+        for(i = 0; i < vlist->count; i++)
+            MC_ASSERT(vlist->nodes[i].view != view);
+    }
 #endif
 
-    node = (view_node_t*) malloc(sizeof(view_node_t));
-    if(MC_ERR(node == NULL)) {
-        MC_TRACE("view_install: malloc() failed.");
-        return -1;
+    /* Dead nodes still occupy the array during the refresh, and each live
+     * node holds a handle, so the capacity bounds the handle count too. */
+    if(vlist->count >= vlist->capacity) {
+        if(MC_ERR(view_list_grow(vlist) != 0)) {
+            MC_TRACE("view_install: view_list_grow() failed.");
+            return -1;
+        }
+    }
+
+    if(vlist->free_handle >= 0) {
+        handle = vlist->free_handle;
+        vlist->free_handle = vlist->slots[handle];
+    } else {
+        MC_ASSERT(vlist->handle_count < vlist->capacity);
+        handle = vlist->handle_count++;
     }
 
+    node = &vlist->nodes[vlist->count];
     node->view = view;
     node->refresh = refresh;
-    node->next = vlist->head;
-    vlist->head = node;
-    return 0;
+    node->interest = NULL;
+    node->handle = handle;
+    vlist->slots[handle] = vlist->count;
+    vlist->count++;
+    return handle;
 }
 
 void
-view_list_uninstall_view(view_list_t* vlist, void* view)
+view_list_uninstall_view(view_list_t* vlist, int handle)
 {
-    view_node_t* node = vlist->head;
-    view_node_t* prev = NULL;
+    int index;
+
+    MC_ASSERT(handle >= 0  &&  handle < vlist->handle_count);
+    index = vlist->slots[handle];
+    MC_ASSERT(index < vlist->count);
+    MC_ASSERT(vlist->nodes[index].handle == handle);
+    MC_ASSERT(vlist->nodes[index].view != NULL);
 
-    while(node->view != view) {
-        MC_ASSERT(node != NULL);
-        prev = node;
-        node = node->next;
+    vlist->slots[handle] = vlist->free_handle;
+    vlist->free_handle = handle;
+
+    if(vlist->refresh_level > 0) {
+        /* Do not move nodes under the hands of view_list_refresh_filtered(). */
+        vlist->nodes[index].view = NULL;
+        vlist->nodes[index].refresh = NULL;
+        vlist->nodes[index].handle = -1;
+        vlist->has_dead = TRUE;
+        return;
     }
 
-    if(prev)
-        prev->next = node->next;
-    else
-        vlist->head = node->next;
-    free(node);
+    /* Move the last node into the hole. */
+    vlist->count--;
+    if(index < vlist->count) {
+        memcpy(&vlist->nodes[index], &vlist->nodes[vlist->count], sizeof(view_node_t));
+        vlist->slots[vlist->nodes[index].handle] = index;
+    }
 }
 
+void
+view_list_set_interest(view_list_t* vlist, int handle, void* interest)
+{
+    MC_ASSERT(handle >= 0  &&  handle < vlist->handle_count);
+    MC_ASSERT(vlist->slots[handle] < vlist->count);
+
+    vlist->nodes[vlist->slots[handle]].interest = interest;
+}
+
+static void
+view_list_compact(view_list_t* vlist)
+{
+    int i, j;
+
+    for(i = 0, j = 0; i < vlist->count; i++) {
+        if(vlist->nodes[i].view == NULL)
+            continue;
+        if(j < i) {
+            memcpy(&vlist->nodes[j], &vlist->nodes[i], sizeof(view_node_t));
+            vlist->slots[vlist->nodes[j].handle] = j;
+        }
+        j++;
+    }
+
+    vlist->count = j;
+    vlist->has_dead = FALSE;
+}
+
+void
+view_list_refresh_filtered(view_list_t* vlist, void* detail, view_filter_t filter)
+{
+    int i, n;
+    view_node_t* node;
+
+    /* Views installed by the callbacks are not called for this change. */
+    n = vlist->count;
+
+    vlist->refresh_level++;
+    for(i = 0; i < n; i++) {
+        /* The callback may reallocate the array, so no pointer into it may
+         * survive the call. */
+        node = &vlist->nodes[i];
+        if(node->view == NULL)
+            continue;
+        if(filter != NULL  &&  detail != NULL  &&  node->interest != NULL  &&
+           !filter(node->interest, detail))
+            continue;
+        node->refresh(node->view, detail);
+    }
+    vlist->refresh_level--;
+
+    if(vlist->refresh_level == 0  &&  vlist->has_dead)
+        view_list_compact(vlist);
+}
+
+
+BOOL
+view_sched_request(view_sched_t* sched, HWND win, UINT_PTR timer_id)
+{
+    DWORD elapsed;
+
+    MC_ASSERT(sched->interval > 0);
+
+    if(sched->timer_pending)
+        return FALSE;
+
+    /* The first change after a quiet period is applied immediately. */
+    elapsed = GetTickCount() - sched->last_flush;
+    if(elapsed >= sched->interval)
+        return TRUE;
+
+    if(MC_ERR(SetTimer(win, timer_id, sched->interval - elapsed, NULL) == 0)) {
+        MC_TRACE("view_sched_request: SetTimer() failed [%lu]", GetLastError());
+        return TRUE;
+    }
+
+    sched->timer_pending = TRUE;
+    return FALSE;
+}
+
+void
+view_sched_flushed(view_sched_t* sched, HWND win, UINT_PTR timer_id)
+{
+    if(sched->timer_pending) {
+        KillTimer(win, timer_id);
+        sched->timer_pending = FALSE;
+    }
+
+    sched->last_flush = GetTickCount();
+}
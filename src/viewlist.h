@@ -33,39 +33,117 @@
 
 typedef void (*view_refresh_t)(void* /*view*/, void* /*detail*/);
 
+/* Decides whether a change (detail) touches what the view is interested in.
+ * The meaning of both is up to the model. The filter may update the interest
+ * (e.g. count the skipped changes). */
+typedef BOOL (*view_filter_t)(void* /*interest*/, const void* /*detail*/);
+
+
+/* The views live in a dense array so the refresh is a linear walk over it.
+ * The array is aligned to a cache line and the node is four pointers big,
+ * so the nodes never straddle a cache line.
+ *
+ * The index of a node changes when other views are uninstalled, so the view
+ * is identified by a handle returned from view_list_install_view(). The list
+ * maps the handles to the node indexes (free handles are chained through the
+ * same map), so uninstalling is O(1).
+ *
+ * Views may be installed or uninstalled from within the refresh callback.
+ * Views installed during the refresh are not called for the change being
+ * dispatched. Views uninstalled during the refresh are only marked dead and
+ * the array is compacted when the (outermost) refresh ends.
+ */
 
 typedef struct view_node_tag view_node_t;
 struct view_node_tag {
-    void* view;
+    void* view;               /* NULL if uninstalled during the refresh */
     view_refresh_t refresh;
-    view_node_t* next;
+    void* interest;           /* NULL means all changes */
+    INT_PTR handle;
 };
 
 typedef struct view_list_tag view_list_t;
 struct view_list_tag {
-    view_node_t* head;
+    view_node_t* nodes;       /* nodes[0] ... nodes[count-1] */
+    int* slots;               /* handle -> index into nodes[] */
+    int count;
+    int capacity;             /* of both nodes[] and slots[] */
+    int handle_count;         /* handles ever allocated */
+    int free_handle;          /* chain of free handles, or -1 */
+    int refresh_level;        /* nesting of view_list_refresh_filtered() */
+    BOOL has_dead;            /* some node uninstalled during the refresh */
 };
 
-#define VIEW_LIST_IS_EMPTY(vlist)    ((vlist)->head == NULL)
-#define VIEW_LIST_INITIALIZER        { 0 }
+#define VIEW_LIST_IS_EMPTY(vlist)    ((vlist)->count == 0)
+#define VIEW_LIST_INITIALIZER        { NULL, NULL, 0, 0, 0, -1, 0, FALSE }
 
 
 static inline void
 view_list_init(view_list_t* vlist)
 {
-    vlist->head = NULL;
+    vlist->nodes = NULL;
+    vlist->slots = NULL;
+    vlist->count = 0;
+    vlist->capacity = 0;
+    vlist->handle_count = 0;
+    vlist->free_handle = -1;
+    vlist->refresh_level = 0;
+    vlist->has_dead = FALSE;
 }
 
+void view_list_fini(view_list_t* vlist);
+
+/* Returns handle of the view (>= 0), or -1 on failure. */
 int view_list_install_view(view_list_t* vlist, void* view, view_refresh_t refresh);
-void view_list_uninstall_view(view_list_t* vlist, void* view);
+void view_list_uninstall_view(view_list_t* vlist, int handle);
+
+/* Sets what the view is interested in. The model keeps just the pointer,
+ * so the view may update the pointed data later without telling the list.
+ * NULL (the default) means the view wants to know about everything. */
+void view_list_set_interest(view_list_t* vlist, int handle, void* interest);
+
+/* Calls the refresh callback of the views. If filter is not NULL, it is
+ * asked first for each view with an interest set, and the view is skipped
+ * when the filter says the change does not touch it. NULL detail is passed
+ * to all the views. */
+void view_list_refresh_filtered(view_list_t* vlist, void* detail, view_filter_t filter);
 
 static inline void
 view_list_refresh(view_list_t* vlist, void* detail)
 {
-    view_node_t* node;
-    for(node = vlist->head; node != NULL; node = node->next)
-        node->refresh(node->view, detail);
+    view_list_refresh_filtered(vlist, detail, NULL);
+}
+
+
+/* Optional rate limiting of refreshes, for views which are windows.
+ *
+ * If enabled (interval > 0), the view only accumulates the changes reported
+ * to its refresh callback, and then asks view_sched_request() whether to
+ * apply them right now. If not, a timer is started and the window gets
+ * WM_TIMER (with the given timer id) when the interval elapses. The view
+ * applies all the accumulated changes then, and calls view_sched_flushed().
+ *
+ * This way the view is refreshed at most once per the interval, no matter
+ * how often the model changes.
+ */
+
+typedef struct view_sched_tag view_sched_t;
+struct view_sched_tag {
+    DWORD interval;       /* in milliseconds; 0 = no rate limiting */
+    DWORD last_flush;     /* GetTickCount() of the last flush */
+    BOOL timer_pending;
+};
+
+static inline void
+view_sched_init(view_sched_t* sched)
+{
+    sched->interval = 0;
+    sched->last_flush = 0;
+    sched->timer_pending = FALSE;
 }
 
+BOOL view_sched_request(view_sched_t* sched, HWND win, UINT_PTR timer_id);
+void view_sched_flushed(view_sched_t* sched, HWND win, UINT_PTR timer_id);
+
 
 #endif  /* MC_VIEWLIST_H */